@@ -3,13 +3,16 @@
 APP            = encrypt
 ALT            = decrypt
 
-COMMON_SRC     = src/common/error.c src/common/ccrypt.c src/common/list.c src/common/tlv.c src/common/version.c src/common/config.c src/common/cli.c src/common/dir.c src/common/ecc.c src/common/non-gnu.c
-CLI_SRC        = ${COMMON_SRC} src/main.c src/crypt.c src/encrypt.c src/decrypt.c src/crypt_io.c
+COMMON_SRC     = src/common/error.c src/common/ccrypt.c src/common/list.c src/common/ring.c src/common/uring.c src/common/tlv.c src/common/version.c src/common/config.c src/common/cli.c src/common/dir.c src/common/walk.c src/common/ecc.c src/common/non-gnu.c
+CLI_SRC        = ${COMMON_SRC} src/main.c src/crypt.c src/encrypt.c src/decrypt.c src/crypt_io.c src/batch.c src/benchmark.c
 GUI_SRC        = ${CLI_SRC} src/gui-gtk.c
 MISC           = src/common/misc.h
 
 CLI_CFLAGS     = ${CFLAGS} -Wall -Wextra -std=gnu99 $(shell libgcrypt-config --cflags) -pipe -O2 -Wrestrict -Wformat=2 -Wno-unused-result
-CLI_CPPFLAGS   = ${CPPFLAGS} -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64 -DGCRYPT_NO_DEPRECATED -DUSE_GCRYPT -DGIT_COMMIT=\"$(shell git log | head -n1 | cut -f2 -d' ')\" -DBUILD_OS=\"$(shell grep PRETTY_NAME /etc/os-release | cut -d= -f2)\"
+CODEC_CPPFLAGS = $(shell pkg-config --exists libzstd && echo -DHAVE_ZSTD) $(shell pkg-config --exists liblz4 && echo -DHAVE_LZ4)
+CODEC_LIBS     = $(shell pkg-config --exists libzstd && pkg-config --libs libzstd) $(shell pkg-config --exists liblz4 && pkg-config --libs liblz4)
+
+CLI_CPPFLAGS   = ${CPPFLAGS} ${CODEC_CPPFLAGS} -D_GNU_SOURCE -D_FILE_OFFSET_BITS=64 -DGCRYPT_NO_DEPRECATED -DUSE_GCRYPT -DGIT_COMMIT=\"$(shell git log | head -n1 | cut -f2 -d' ')\" -DBUILD_OS=\"$(shell grep PRETTY_NAME /etc/os-release | cut -d= -f2)\"
 GUI_CFLAGS     = ${CLI_CFLAGS} $(shell pkg-config --cflags gtk+-3.0 gmodule-2.0)
 GUI_CPPFLAGS   = ${CLI_CPPFLAGS} -DBUILD_GUI
 
@@ -17,7 +20,7 @@ DEBUG_CFLAGS   = -O0 -ggdb -pg
 DEBUG_CPPFLAGS = -D__DEBUG__ -D__DEBUG_GUI__ -DMALLOC_CHECK_=1
 DEBUG_ENC      = ${DEBUG_CPPFLAGS} -D__DEBUG_WITH_ENCRYPTION__
 
-CLI_LIBS       = $(shell libgcrypt-config --libs) -lpthread -lcurl -llzma
+CLI_LIBS       = $(shell libgcrypt-config --libs) -lpthread -lcurl -llzma ${CODEC_LIBS}
 GUI_LIBS       = ${CLI_LIBS} $(shell pkg-config --libs gtk+-3.0 gmodule-2.0)
 
 all: gui symlink language man
@@ -7,9 +7,9 @@ _encrypt()
 
 	opts="-h --help -v --version -l --licence \
 		  -k --key -p --password \
-		  -q --quiet -d --debug"
+		  -q --quiet -d --direct-io --range --extract --list --batch --batch-list --benchmark --stats"
 
-	[ "$1" == "encrypt" ] && opts="$opts -c --cipher -s --hash -x --no-compress"
+	[ "$1" == "encrypt" ] && opts="$opts -c --cipher -s --hash -x --no-compress -z --codec"
 
 	if [[ "${cur}" == -* ]]
 	then
@@ -18,7 +18,7 @@ _encrypt()
 		case "${prev}" in
 			-h|--help|-v|--version|-l|--licence)
 				;;
-			-k|--key)
+			-k|--key|--batch-list)
 				COMPREPLY=($(compgen -A file -- "${cur}"))
 				;;
 			-c|--cipher)
@@ -30,7 +30,10 @@ _encrypt()
 			-m|--mode)
 				COMPREPLY=($(compgen -W "list $(encrypt -m list 2>&1 | tr '[A-Z]' '[a-z]')" -- "${cur}"))
 				;;
-			-p|--password|-x|--no-compress|-g|--no-gui|-f|--follow|-b|--back-compat|-r|--raw)
+			-z|--codec)
+				COMPREPLY=($(compgen -W "list xz zstd lz4" -- "${cur}"))
+				;;
+			-p|--password|-x|--no-compress|-g|--no-gui|-f|--follow|-b|--back-compat|-r|--raw|-t|--threads|--compress|-d|--direct-io|--range|--extract|--list|--batch|--benchmark|--stats)
 				;;
 			*)
 				COMPREPLY=($(compgen -A file -- "${cur}"))
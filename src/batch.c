@@ -0,0 +1,408 @@
+/*
+ * encrypt ~ a simple, multi-OS encryption utility
+ * Copyright © 2005-2027, albinoloverats ~ Software Development
+ * email: encrypt@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <pthread.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <sys/stat.h>
+
+#include "common/common.h"
+#include "common/non-gnu.h"
+#include "common/error.h"
+#include "common/cli.h"
+#include "common/dir.h"
+
+#include "crypt.h"
+#include "encrypt.h"
+#include "decrypt.h"
+#include "batch.h"
+
+/*!
+ * \brief  A job, which encrypts (or decrypts) one file after another
+ */
+typedef struct
+{
+	batch_t *batch;   /*!< The batch the job is part of */
+	crypto_t *crypto; /*!< What it’s doing now (if anything) */
+	pthread_t thread; /*!< The thread it’s running on */
+	bool started;     /*!< Whether the thread was started */
+}
+batch_job_t;
+
+static void *batch_process(void *);
+static void *batch_job(void *);
+static crypto_t *batch_start(batch_t *, batch_file_t *);
+static char *batch_absolute(const char *);
+
+#define BATCH_FILES 0x40 /*!< Initial space for files in a batch */
+
+extern batch_t *batch_init(size_t j, const batch_options_t *o)
+{
+	batch_t *b = calloc(1, sizeof( batch_t ));
+	if (!b)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( batch_t ));
+	b->options = *o;
+	/*
+	 * keep the full path, so it doesn’t matter where (or when) each
+	 * file is encrypted
+	 */
+	if (!o->length)
+		b->options.key = b->key_file = batch_absolute(o->key);
+#ifdef _SC_NPROCESSORS_ONLN
+	size_t n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (!j)
+		j = n;
+#endif
+	b->jobs = j ? : 1;
+#ifdef _SC_NPROCESSORS_ONLN
+	/*
+	 * one thread per CPU is for the whole batch, not for each file,
+	 * otherwise there’d be as many threads as CPUs squared
+	 */
+	if (!o->threads)
+		b->options.threads = n / b->jobs ? : 1;
+	if (!o->compress_threads)
+		b->options.compress_threads = n / b->jobs ? : 1;
+#endif
+	b->master = io_master_init();
+	b->status = STATUS_INIT;
+	return b;
+}
+
+extern void batch_add(batch_t *b, const char *f)
+{
+	if (b->count == b->size)
+	{
+		size_t z = b->size ? b->size * 2 : BATCH_FILES;
+		batch_file_t *x = realloc(b->files, z * sizeof( batch_file_t ));
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z * sizeof( batch_file_t ));
+		b->files = x;
+		b->size = z;
+	}
+	batch_file_t *e = &b->files[b->count++];
+	e->source = batch_absolute(f);
+	for (char *sl = e->source + strlen(e->source) - 1; sl > e->source && *sl == DIR_SEPARATOR_CHAR; sl--)
+		*sl = '\0';
+	struct stat s;
+	e->size = stat(e->source, &s) == 0 && S_ISREG(s.st_mode) ? (uint64_t)s.st_size : 0;
+	e->decrypt = b->options.decrypt || is_encrypted(e->source);
+	/*
+	 * encrypted files are written next to the original; decrypting is
+	 * done into the same directory, which restores the original name
+	 * (for directories too)
+	 */
+	size_t l = strlen(e->source);
+	if (e->decrypt)
+	{
+		if (!(e->output = strndup(e->source, strrchr(e->source, DIR_SEPARATOR_CHAR) - e->source ? : 1)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l);
+	}
+	else if (asprintf(&e->output, "%s%s", e->source, BATCH_SUFFIX) < 0)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l + strlen(BATCH_SUFFIX));
+	e->status = STATUS_INIT;
+	return;
+}
+
+extern bool batch_add_from(batch_t *b, const char *l)
+{
+	int64_t f = strcmp(l, "-") ? open(l, O_RDONLY | O_BINARY) : STDIN_FILENO;
+	if (f < 0)
+		return false;
+	char *d = NULL;
+	size_t z = 0;
+	size_t n = 0;
+	for (ssize_t r = 1; r > 0; n += r)
+	{
+		if (n + BLOCK_SIZE + sizeof( byte_t ) > z)
+		{
+			z = z ? z * 2 : BLOCK_SIZE + sizeof( byte_t );
+			char *x = realloc(d, z);
+			if (!x)
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+			d = x;
+		}
+		if ((r = read(f, d + n, BLOCK_SIZE)) < 0)
+		{
+			if (f != STDIN_FILENO)
+				close(f);
+			free(d);
+			return false;
+		}
+	}
+	if (f != STDIN_FILENO)
+		close(f);
+	/*
+	 * names are separated by NUL if there are any, otherwise by new
+	 * lines; either way empty names are skipped
+	 */
+	char s = memchr(d, '\0', n) ? '\0' : '\n';
+	d[n] = s;
+	for (char *p = d, *e; p < d + n; p = e + 1)
+	{
+		e = memchr(p, s, d + n + 1 - p);
+		*e = '\0';
+		if (*p)
+			batch_add(b, p);
+	}
+	free(d);
+	return true;
+}
+
+extern void batch_execute(batch_t *b)
+{
+	b->total.size = b->count;
+	b->total.offset = 0;
+	b->current.size = 0;
+	b->current.offset = 0;
+	for (size_t i = 0; i < b->count; i++)
+		b->current.size += b->files[i].size;
+	b->thread = malloc(sizeof( pthread_t ));
+	if (!b->thread)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( pthread_t ));
+	b->status = STATUS_RUNNING;
+	pthread_attr_t a;
+	pthread_attr_init(&a);
+	pthread_attr_setdetachstate(&a, PTHREAD_CREATE_JOINABLE);
+	pthread_create(b->thread, &a, batch_process, b);
+	pthread_attr_destroy(&a);
+	return;
+}
+
+extern size_t batch_report(const batch_t *b)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < b->count; i++)
+	{
+		const batch_file_t *e = &b->files[i];
+		const char *s = status_message(e->status);
+		if (e->status == STATUS_SUCCESS)
+			cli_printf("‘%s’ → ‘%s’ : %s\n", e->source, e->output, _(s));
+		else
+		{
+			cli_printf("‘%s’ → ‘%s’ : " ANSI_COLOUR_RED "%s" ANSI_COLOUR_RESET "\n", e->source, e->output, _(s));
+			n++;
+		}
+	}
+	return n;
+}
+
+extern void batch_deinit(batch_t **b)
+{
+	batch_t *z = *b;
+	if (z->thread)
+	{
+		if (z->status == STATUS_RUNNING)
+			z->status = STATUS_CANCELLED;
+		pthread_join(*z->thread, NULL);
+		free(z->thread);
+	}
+	for (size_t i = 0; i < z->count; i++)
+	{
+		free(z->files[i].source);
+		free(z->files[i].output);
+	}
+	free(z->files);
+	free(z->key_file);
+	io_master_deinit(z->master);
+	free(z);
+	*b = NULL;
+	return;
+}
+
+static void *batch_process(void *ptr)
+{
+	batch_t *b = ptr;
+	/*
+	 * each job takes the next file whenever it’s finished the last;
+	 * meanwhile this just keeps track of how they’re all getting on
+	 */
+	size_t n = b->jobs < b->count ? b->jobs : b->count;
+	batch_job_t *jobs = calloc(n, sizeof( batch_job_t ));
+	if (!jobs)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, n * sizeof( batch_job_t ));
+	pthread_mutex_init(&b->mutex, NULL);
+	/*
+	 * no job can get going until they’ve all been started
+	 */
+	pthread_mutex_lock(&b->mutex);
+	b->active = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		jobs[i].batch = b;
+		if ((jobs[i].started = !pthread_create(&jobs[i].thread, NULL, batch_job, &jobs[i])))
+			b->active++;
+	}
+	pthread_mutex_unlock(&b->mutex);
+	/*
+	 * if no jobs could be started, just do everything here
+	 */
+	if (n && !b->active)
+	{
+		b->active++;
+		batch_job(&jobs[0]);
+	}
+	for (bool r = true; r; )
+	{
+		struct timespec s = { 0, 10 * MILLION }; /* 10 milliseconds */
+		nanosleep(&s, NULL);
+		pthread_mutex_lock(&b->mutex);
+		uint64_t x = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			crypto_t *c = jobs[i].crypto;
+			if (!c)
+				continue;
+			if (b->status != STATUS_RUNNING)
+				c->status = STATUS_CANCELLED;
+			else if (!c->directory)
+				x += c->current.offset;
+		}
+		b->current.offset = b->done + x;
+		r = b->active;
+		pthread_mutex_unlock(&b->mutex);
+	}
+	for (size_t i = 0; i < n; i++)
+		if (jobs[i].started)
+			pthread_join(jobs[i].thread, NULL);
+	free(jobs);
+	pthread_mutex_destroy(&b->mutex);
+	/*
+	 * if the batch was cancelled, so is everything that wasn’t started
+	 */
+	for (; b->next < b->count; b->next++)
+		b->files[b->next].status = STATUS_CANCELLED;
+	if (b->status == STATUS_RUNNING)
+		b->status = STATUS_SUCCESS;
+	return NULL;
+}
+
+static void *batch_job(void *ptr)
+{
+	batch_job_t *j = ptr;
+	batch_t *b = j->batch;
+	for (;;)
+	{
+		pthread_mutex_lock(&b->mutex);
+		if (b->status != STATUS_RUNNING || b->next >= b->count)
+			break;
+		batch_file_t *e = &b->files[b->next++];
+		pthread_mutex_unlock(&b->mutex);
+		crypto_t *c = batch_start(b, e);
+		if (c)
+		{
+			pthread_mutex_lock(&b->mutex);
+			j->crypto = c;
+			pthread_mutex_unlock(&b->mutex);
+			execute(c);
+#ifndef __DEBUG__
+			/*
+			 * wait for it here, rather than polling, so the next one
+			 * can start as soon as it’s done
+			 */
+			pthread_join(*c->thread, NULL);
+			gcry_free(c->thread);
+			c->thread = NULL;
+#endif
+			pthread_mutex_lock(&b->mutex);
+			j->crypto = NULL;
+			io_stats_add(&b->stats, &c->stats);
+			pthread_mutex_unlock(&b->mutex);
+			e->status = c->status;
+			/*
+			 * report which file was actually decrypted to
+			 */
+			if (e->decrypt && !c->directory && c->path)
+			{
+				free(e->output);
+				if (!(e->output = strdup(c->path)))
+					die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(c->path));
+			}
+			deinit(&c);
+		}
+		pthread_mutex_lock(&b->mutex);
+		b->done += e->size;
+		b->total.offset++;
+		pthread_mutex_unlock(&b->mutex);
+	}
+	b->active--;
+	pthread_mutex_unlock(&b->mutex);
+	return NULL;
+}
+
+static crypto_t *batch_start(batch_t *b, batch_file_t *e)
+{
+	const batch_options_t *o = &b->options;
+	crypto_t *c;
+	if (e->decrypt)
+		c = decrypt_init(e->source, e->output, o->cipher, o->hash, o->mode, o->mac, o->key, o->length, o->kdf_iterations, o->raw);
+	else if (o->compress && (e->status = encrypt_codec_check(o->codec, o->raw ? VERSION_CURRENT : o->version)) != STATUS_INIT)
+		return NULL;
+	else
+	{
+		c = encrypt_init(e->source, e->output, o->cipher, o->hash, o->mode, o->mac, o->key, o->length, o->kdf_iterations, o->raw, o->compress, o->follow_links, o->version);
+		c->codec = o->codec;
+		c->compress_level = o->compress_level;
+	}
+	/*
+	 * every file has the same key, so it only needs stretching once
+	 */
+	c->master = b->master;
+	c->threads = o->threads;
+	c->compress_threads = o->compress_threads;
+	c->compress_block = o->compress_block;
+	c->direct_io = o->direct_io;
+	if (c->status != STATUS_INIT)
+	{
+		e->status = c->status;
+		deinit(&c);
+		return NULL;
+	}
+	return c;
+}
+
+static char *batch_absolute(const char *p)
+{
+	char *a = NULL;
+	if (*p == DIR_SEPARATOR_CHAR)
+		a = strdup(p);
+	else
+	{
+		char *cwd = getcwd(NULL, 0);
+		if (!cwd)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(p));
+		if (asprintf(&a, "%s%s%s", cwd, DIR_SEPARATOR, p) < 0)
+			a = NULL;
+		free(cwd);
+	}
+	if (!a)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(p));
+	return a;
+}
@@ -0,0 +1,165 @@
+/*
+ * encrypt ~ a simple, multi-OS encryption utility
+ * Copyright © 2005-2027, albinoloverats ~ Software Development
+ * email: encrypt@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _ENCRYPT_BATCH_H_
+#define _ENCRYPT_BATCH_H_
+
+/*!
+ * \file    batch.h
+ * \author  Ashley M Anderson
+ * \date    2027
+ * \brief   Encrypt (or decrypt) many files at once
+ *
+ * Each file gets a crypto instance of its own, just as if encrypt had
+ * been run once for each of them, but only a few are run at a time and
+ * everything is done from the one process; from 2027.07 they also share
+ * the master key, so the key data is only stretched once.
+ */
+
+#include "crypt.h"
+
+#define BATCH_SUFFIX ".X" /*!< Added to the name of each file that’s encrypted */
+
+/*!
+ * \brief  How each file should be encrypted (or decrypted)
+ *
+ * The same as the options for a single file, which are passed on to
+ * encrypt_init() or decrypt_init() (see there for details).
+ */
+typedef struct
+{
+	const char *cipher;        /*!< The name of the cipher */
+	const char *hash;          /*!< The name of the hash */
+	const char *mode;          /*!< The name of the mode */
+	const char *mac;           /*!< The name of the MAC */
+	const void *key;           /*!< Key data (or the name of the key file) */
+	size_t length;             /*!< Size of key data (0 for a key file) */
+	uint64_t kdf_iterations;   /*!< Number of KDF iterations */
+	bool raw;                  /*!< Raw - no header or any verification */
+	bool compress;             /*!< Compress data before encryption */
+	bool follow_links;         /*!< Follow symlinks */
+	bool decrypt;              /*!< Decrypt everything (otherwise only files which are already encrypted are) */
+	version_e version;         /*!< Backwards compatibility version */
+	io_codec_e codec;          /*!< Compression codec */
+	int compress_level;        /*!< Compression level */
+	uint64_t threads;          /*!< Number of threads to use for each file */
+	uint64_t compress_threads; /*!< Number of threads to compress each file with */
+	uint64_t compress_block;   /*!< Size of each compression block */
+	bool direct_io;            /*!< Whether to bypass the page cache */
+}
+batch_options_t;
+
+/*!
+ * \brief  A file in the batch
+ */
+typedef struct
+{
+	char *source;           /*!< The file to encrypt (or decrypt) */
+	char *output;           /*!< Where it was written (for a directory, where it was decrypted to) */
+	uint64_t size;          /*!< Its size (0 for directories) */
+	bool decrypt;           /*!< Whether it was decrypted */
+	crypto_status_e status; /*!< How it went */
+}
+batch_file_t;
+
+/*!
+ * \brief  Batch instance
+ *
+ * The status and progress can be passed to the CLI progress bar; the
+ * total is the number of files and the current is the number of bytes
+ * (of files) done so far.
+ */
+typedef struct
+{
+	batch_options_t options; /*!< How to encrypt (or decrypt) each file */
+	char *key_file;          /*!< Full path of the key file (if there is one) */
+	batch_file_t *files;     /*!< Every file in the batch */
+	size_t count;            /*!< Number of files */
+	size_t size;             /*!< Space for files */
+	size_t jobs;             /*!< Most files to encrypt (or decrypt) at once */
+	IO_MASTER master;        /*!< Master keys shared by every file (from 2027.07) */
+	crypto_status_e status;  /*!< Status of the batch as a whole */
+	cli_progress_t current;  /*!< Number of bytes done */
+	cli_progress_t total;    /*!< Number of files done */
+	pthread_t *thread;       /*!< Background thread */
+	pthread_mutex_t mutex;   /*!< Guards everything below, and what each job is doing */
+	size_t next;             /*!< The next file to start */
+	size_t active;           /*!< Number of jobs still running */
+	uint64_t done;           /*!< Bytes of files already finished */
+	io_stats_t stats;        /*!< Counters for each stage of the IO, for every file finished */
+}
+batch_t;
+
+/*!
+ * \brief         Create a new batch
+ * \param[in]  j  Most files to encrypt (or decrypt) at once; 0 for one per CPU
+ * \param[in]  o  How to encrypt (or decrypt) each file; which must remain valid until the batch is finished with
+ * \return        A new (empty) batch
+ */
+extern batch_t *batch_init(size_t j, const batch_options_t *o) __attribute__((malloc, nonnull(2)));
+
+/*!
+ * \brief         Add a file to a batch
+ * \param[in]  b  The batch
+ * \param[in]  f  The file (or directory) to encrypt (or decrypt)
+ *
+ * Anything which is already encrypted will be decrypted; everything
+ * else is encrypted. Encrypted files are written alongside the original
+ * with BATCH_SUFFIX added to the name; decrypted files (and directories)
+ * are written to the same directory, with their original name.
+ * Names are kept as full paths.
+ */
+extern void batch_add(batch_t *b, const char *f) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Add each file named in a list to a batch
+ * \param[in]  b  The batch
+ * \param[in]  l  The file containing the list, or - for stdin
+ * \return        Whether the list could be read
+ *
+ * The names can be one per line, or separated by NUL characters (as
+ * from find -print0), in which case they can contain new lines.
+ */
+extern bool batch_add_from(batch_t *b, const char *l) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Start the batch
+ * \param[in]  b  The batch
+ *
+ * Runs in the background, with each job starting on the next file as
+ * soon as it’s finished the last; the batch status stays as running
+ * until every file is done.
+ */
+extern void batch_execute(batch_t *b) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Report how each file went
+ * \param[in]  b  The batch
+ * \return        The number of files that failed
+ */
+extern size_t batch_report(const batch_t *b) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Finish with a batch
+ * \param[in]  b  The batch; anything still running is cancelled
+ */
+extern void batch_deinit(batch_t **b) __attribute__((nonnull(1)));
+
+#endif /* ! _ENCRYPT_BATCH_H_ */
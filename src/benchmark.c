@@ -0,0 +1,511 @@
+/*
+ * encrypt ~ a simple, multi-OS encryption utility
+ * Copyright © 2005-2027, albinoloverats ~ Software Development
+ * email: encrypt@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <inttypes.h>
+
+#include <gcrypt.h>
+#include <lzma.h>
+
+#include "common/common.h"
+#include "common/non-gnu.h"
+#include "common/error.h"
+#include "common/list.h"
+#include "common/ccrypt.h"
+#include "common/ecc.h"
+#include "common/cli.h"
+
+#include "crypt_io.h"
+#include "benchmark.h"
+
+#define BENCHMARK_BUFFER (256 * KILOBYTE) /*!< Amount of data processed at a time (a multiple of every block size) */
+#define BENCHMARK_TIME   (50 * MILLION)   /*!< How long (in nanoseconds) to keep going with each measurement */
+#define BENCHMARK_KDF    0x4000           /*!< Number of KDF iterations actually timed */
+#define BENCHMARK_NUMBER 0x20             /*!< Space for a formatted result */
+#define BENCHMARK_NONCE  8                /*!< Length of the nonce for stream ciphers */
+#define BENCHMARK_NONCE_AEAD 12           /*!< Length of the nonce for GCM-SIV */
+#define BENCHMARK_TAG    16               /*!< Length of the tag SIV modes check when decrypting */
+
+/*!
+ * \brief  Something to measure; processes l bytes of b, returning whether it could
+ */
+typedef bool (*benchmark_f)(void *, uint8_t *, size_t);
+
+/*!
+ * \brief  A cipher (and mode) being measured
+ */
+typedef struct
+{
+	gcry_cipher_hd_t handle;     /*!< The cipher */
+	enum gcry_cipher_modes mode; /*!< The mode */
+	uint8_t iv[BENCHMARK_NUMBER];/*!< The IV (or nonce) */
+	size_t length;               /*!< Length of the IV; 0 if it doesn’t take one */
+	bool encrypt;                /*!< Whether to encrypt (or decrypt) */
+}
+benchmark_cipher_t;
+
+/*!
+ * \brief  Data being compressed (or decompressed)
+ */
+typedef struct
+{
+	uint32_t preset;             /*!< The compression preset */
+	uint8_t *data;               /*!< The compressed data */
+	size_t length;               /*!< Its length */
+	size_t size;                 /*!< Space for it */
+}
+benchmark_codec_t;
+
+static uint64_t benchmark_now(void);
+static uint64_t benchmark_run(benchmark_f, void *, uint8_t *, size_t);
+static void benchmark_section(bool, const char *, const char *);
+static void benchmark_end(bool);
+static const char *benchmark_rate(char *, uint64_t, bool);
+
+static void benchmark_ciphers(bool, uint8_t *);
+static void benchmark_hashes(bool, uint8_t *);
+static void benchmark_macs(bool, uint8_t *);
+static void benchmark_kdf(bool, uint64_t);
+static void benchmark_ecc(bool, uint8_t *);
+static void benchmark_codec(bool, uint8_t *);
+
+static bool benchmark_cipher_init(benchmark_cipher_t *, enum gcry_cipher_algos, enum gcry_cipher_modes);
+static bool benchmark_iv(benchmark_cipher_t *, size_t);
+static bool benchmark_cipher(void *, uint8_t *, size_t);
+static bool benchmark_hash(void *, uint8_t *, size_t);
+static bool benchmark_mac(void *, uint8_t *, size_t);
+static bool benchmark_ecc_encode(void *, uint8_t *, size_t);
+static bool benchmark_ecc_decode(void *, uint8_t *, size_t);
+static bool benchmark_compress(void *, uint8_t *, size_t);
+static bool benchmark_decompress(void *, uint8_t *, size_t);
+
+static size_t sections = 0; /*!< Number of sections written so far (for JSON) */
+static size_t rows = 0;     /*!< Number of rows written in the current section (for JSON) */
+
+extern void benchmark(bool j, uint64_t i)
+{
+	uint8_t *b = malloc(BENCHMARK_BUFFER);
+	if (!b)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, (size_t)BENCHMARK_BUFFER);
+	gcry_randomize(b, BENCHMARK_BUFFER, GCRY_WEAK_RANDOM);
+
+	if (j)
+	{
+		long n = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+		cli_printf("{\n\t\"libgcrypt\": \"%s\",\n\t\"cpus\": %ld,\n\t\"buffer\": %" PRIu64 ",", gcry_check_version(NULL), n, (uint64_t)BENCHMARK_BUFFER);
+	}
+	else
+		cli_printf(_("Throughput in MB/s of %" PRIu64 "KB at a time, in memory (so without any file IO)\n"), (uint64_t)(BENCHMARK_BUFFER / KILOBYTE));
+
+	benchmark_ciphers(j, b);
+	benchmark_hashes(j, b);
+	benchmark_macs(j, b);
+	benchmark_kdf(j, i);
+	benchmark_ecc(j, b);
+	benchmark_codec(j, b);
+
+	if (j)
+		cli_printf("\n}\n");
+	free(b);
+	return;
+}
+
+static void benchmark_ciphers(bool j, uint8_t *b)
+{
+	benchmark_section(j, "ciphers", _("Cipher              Mode            Encrypt      Decrypt"));
+	LIST ciphers = list_of_ciphers();
+	LIST modes = list_of_modes();
+	for (size_t x = 0; x < list_size(ciphers); x++)
+		for (size_t y = 0; y < list_size(modes); y++)
+		{
+			const char *cn = list_get(ciphers, x);
+			const char *mn = list_get(modes, y);
+			enum gcry_cipher_algos c = cipher_id_from_name(cn);
+			enum gcry_cipher_modes m = mode_id_from_name(mn);
+			if (!mode_valid_for_cipher(c, m))
+				continue;
+			uint64_t r[2] = { 0, 0 };
+			for (int i = 0; i < 2; i++)
+			{
+				benchmark_cipher_t z = { .encrypt = !i };
+				if (!benchmark_cipher_init(&z, c, m))
+					continue;
+				r[i] = benchmark_run(benchmark_cipher, &z, b, BENCHMARK_BUFFER);
+				gcry_cipher_close(z.handle);
+			}
+			char e[BENCHMARK_NUMBER];
+			char d[BENCHMARK_NUMBER];
+			if (j)
+				cli_printf("%s\n\t\t{ \"cipher\": \"%s\", \"mode\": \"%s\", \"encrypt\": %s, \"decrypt\": %s }", rows++ ? "," : "", cn, mn, benchmark_rate(e, r[0], j), benchmark_rate(d, r[1], j));
+			else
+				cli_printf("%-20s%-12s%12s %12s\n", cn, mn, benchmark_rate(e, r[0], j), benchmark_rate(d, r[1], j));
+		}
+	benchmark_end(j);
+	return;
+}
+
+static void benchmark_hashes(bool j, uint8_t *b)
+{
+	benchmark_section(j, "hashes", _("Hash                                 Rate"));
+	LIST hashes = list_of_hashes();
+	for (size_t x = 0; x < list_size(hashes); x++)
+	{
+		const char *hn = list_get(hashes, x);
+		uint64_t r = 0;
+		gcry_md_hd_t h;
+		if (gcry_md_open(&h, hash_id_from_name(hn), 0) == GPG_ERR_NO_ERROR)
+		{
+			r = benchmark_run(benchmark_hash, h, b, BENCHMARK_BUFFER);
+			gcry_md_close(h);
+		}
+		char s[BENCHMARK_NUMBER];
+		if (j)
+			cli_printf("%s\n\t\t{ \"hash\": \"%s\", \"rate\": %s }", rows++ ? "," : "", hn, benchmark_rate(s, r, j));
+		else
+			cli_printf("%-32s%12s\n", hn, benchmark_rate(s, r, j));
+	}
+	benchmark_end(j);
+	return;
+}
+
+static void benchmark_macs(bool j, uint8_t *b)
+{
+	benchmark_section(j, "macs", _("MAC                                  Rate"));
+	LIST macs = list_of_macs();
+	for (size_t x = 0; x < list_size(macs); x++)
+	{
+		const char *an = list_get(macs, x);
+		enum gcry_mac_algos a = mac_id_from_name(an);
+		uint64_t r = 0;
+		gcry_mac_hd_t h;
+		if (gcry_mac_open(&h, a, 0, NULL) == GPG_ERR_NO_ERROR)
+		{
+			uint8_t k[4 * BENCHMARK_NUMBER];
+			gcry_randomize(k, sizeof k, GCRY_WEAK_RANDOM);
+			size_t l = gcry_mac_get_algo_keylen(a);
+			/*
+			 * GMAC and Poly1305 (with a cipher) need a nonce as well
+			 */
+			if (l <= sizeof k && gcry_mac_setkey(h, k, l) == GPG_ERR_NO_ERROR)
+			{
+				if (gcry_mac_setiv(h, k, 16) != GPG_ERR_NO_ERROR)
+					gcry_mac_setiv(h, k, 12);
+				r = benchmark_run(benchmark_mac, h, b, BENCHMARK_BUFFER);
+			}
+			gcry_mac_close(h);
+		}
+		char s[BENCHMARK_NUMBER];
+		if (j)
+			cli_printf("%s\n\t\t{ \"mac\": \"%s\", \"rate\": %s }", rows++ ? "," : "", an, benchmark_rate(s, r, j));
+		else
+			cli_printf("%-32s%12s\n", an, benchmark_rate(s, r, j));
+	}
+	benchmark_end(j);
+	return;
+}
+
+static void benchmark_kdf(bool j, uint64_t i)
+{
+	char t[0x40];
+	snprintf(t, sizeof t, _("KDF                            Iterations/s   ms for %'" PRIu64), i);
+	benchmark_section(j, "kdf", t);
+	LIST hashes = list_of_hashes();
+	for (size_t x = 0; x < list_size(hashes); x++)
+	{
+		const char *hn = list_get(hashes, x);
+		enum gcry_md_algos h = hash_id_from_name(hn);
+		/*
+		 * time a fixed number of iterations, and work out the rest; the
+		 * KDF takes as long for each iteration as any other
+		 */
+		size_t l = gcry_md_get_algo_dlen(h) ? : 64;
+		uint8_t k[0x40] = { 0x0 };
+		uint8_t s[0x20] = { 0x0 };
+		uint8_t *d = gcry_malloc_secure(l);
+		if (!d)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l);
+		uint64_t n = benchmark_now();
+		bool ok = gcry_kdf_derive(k, sizeof k, GCRY_KDF_PBKDF2, h, s, sizeof s, BENCHMARK_KDF, l, d) == GPG_ERR_NO_ERROR;
+		n = benchmark_now() - n ? : 1;
+		gcry_free(d);
+		uint64_t r = ok ? BENCHMARK_KDF * THOUSAND_MILLION / n : 0;
+		uint64_t e = ok ? n * i / BENCHMARK_KDF : 0;
+		if (j)
+		{
+			if (ok)
+				cli_printf("%s\n\t\t{ \"hash\": \"%s\", \"rate\": %" PRIu64 ", \"iterations\": %" PRIu64 ", \"nanoseconds\": %" PRIu64 " }", rows++ ? "," : "", hn, r, i, e);
+			else
+				cli_printf("%s\n\t\t{ \"hash\": \"%s\", \"rate\": null, \"iterations\": %" PRIu64 ", \"nanoseconds\": null }", rows++ ? "," : "", hn, i);
+		}
+		else if (ok)
+			cli_printf("%-32s%'12" PRIu64 " %'14.1f\n", hn, r, e / (double)MILLION);
+		else
+			cli_printf("%-32s%12s %14s\n", hn, "-", "-");
+	}
+	benchmark_end(j);
+	return;
+}
+
+static void benchmark_ecc(bool j, uint8_t *b)
+{
+	benchmark_section(j, "ecc", _("Error correction                     Rate"));
+	/*
+	 * each frame of payload is encoded into a slightly larger frame;
+	 * rates are of the payload
+	 */
+	size_t n = BENCHMARK_BUFFER / ECC_PAYLOAD;
+	uint8_t *c = calloc(n, ECC_CAPACITY);
+	if (!c)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, n * ECC_CAPACITY);
+	uint64_t r[2];
+	r[0] = benchmark_run(benchmark_ecc_encode, c, b, n * ECC_PAYLOAD);
+	r[1] = benchmark_run(benchmark_ecc_decode, c, b, n * ECC_PAYLOAD);
+	free(c);
+	const char *o[] = { "encode", "decode" };
+	for (int i = 0; i < 2; i++)
+	{
+		char s[BENCHMARK_NUMBER];
+		if (j)
+			cli_printf("%s\n\t\t{ \"operation\": \"%s\", \"rate\": %s }", rows++ ? "," : "", o[i], benchmark_rate(s, r[i], j));
+		else
+			cli_printf("%-32s%12s\n", o[i], benchmark_rate(s, r[i], j));
+	}
+	benchmark_end(j);
+	return;
+}
+
+static void benchmark_codec(bool j, uint8_t *b)
+{
+	benchmark_section(j, "compression", _("Compression          Level    Compress   Decompress    Ratio"));
+	/*
+	 * random data doesn’t compress, so use something more like text;
+	 * it’s put back afterwards, for anything measured after this
+	 */
+	uint8_t *t = malloc(BENCHMARK_BUFFER);
+	if (!t)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, (size_t)BENCHMARK_BUFFER);
+	const char *letters = "etaoin shrdlucmfwypvbgkqjxz\n.,'";
+	size_t n = strlen(letters);
+	for (size_t i = 0; i < BENCHMARK_BUFFER; i++)
+		t[i] = letters[b[i] % n];
+	benchmark_codec_t z = { io_codec_level(CODEC_XZ, CODEC_LEVEL_DEFAULT), NULL, 0, lzma_stream_buffer_bound(BENCHMARK_BUFFER) };
+	if (!(z.data = malloc(z.size)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z.size);
+	uint64_t r[2] = { 0, 0 };
+	if ((r[0] = benchmark_run(benchmark_compress, &z, t, BENCHMARK_BUFFER)))
+		r[1] = benchmark_run(benchmark_decompress, &z, b, BENCHMARK_BUFFER);
+	/*
+	 * check it came back as it went in
+	 */
+	if (r[1] && memcmp(t, b, BENCHMARK_BUFFER))
+		r[1] = 0;
+	gcry_randomize(b, BENCHMARK_BUFFER, GCRY_WEAK_RANDOM);
+	char c[BENCHMARK_NUMBER];
+	char d[BENCHMARK_NUMBER];
+	if (j)
+		cli_printf("%s\n\t\t{ \"codec\": \"%s\", \"level\": %" PRIu32 ", \"compress\": %s, \"decompress\": %s, \"length\": %" PRIu64 ", \"compressed\": %zu }", rows++ ? "," : "", io_codec_name(CODEC_XZ), z.preset, benchmark_rate(c, r[0], j), benchmark_rate(d, r[1], j), (uint64_t)BENCHMARK_BUFFER, r[0] ? z.length : 0);
+	else
+		cli_printf("%-20s%6" PRIu32 "%12s %12s %7.1f%%\n", io_codec_name(CODEC_XZ), z.preset, benchmark_rate(c, r[0], j), benchmark_rate(d, r[1], j), r[0] ? 100.0 * z.length / BENCHMARK_BUFFER : 0.0);
+	free(z.data);
+	free(t);
+	benchmark_end(j);
+	return;
+}
+
+static uint64_t benchmark_now(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * THOUSAND_MILLION + t.tv_nsec;
+}
+
+static uint64_t benchmark_run(benchmark_f f, void *x, uint8_t *b, size_t l)
+{
+	/*
+	 * keep going until enough time has passed to get a fair idea of how
+	 * quickly it goes; the rate is in bytes per second (0 if it failed)
+	 */
+	uint64_t n = 0;
+	uint64_t s = benchmark_now();
+	uint64_t e;
+	do
+	{
+		if (!f(x, b, l))
+			return 0;
+		n += l;
+	}
+	while ((e = benchmark_now()) - s < BENCHMARK_TIME);
+	return n * THOUSAND_MILLION / (e - s);
+}
+
+static void benchmark_section(bool j, const char *k, const char *t)
+{
+	rows = 0;
+	if (j)
+		cli_printf("%s\n\t\"%s\": [", sections++ ? "," : "", k);
+	else
+		cli_printf("\n%s\n", t);
+	return;
+}
+
+static void benchmark_end(bool j)
+{
+	if (j)
+		cli_printf("\n\t]");
+	return;
+}
+
+static const char *benchmark_rate(char *s, uint64_t r, bool j)
+{
+	/*
+	 * JSON gets the exact number of bytes per second (so there’s no
+	 * doubt over decimal points), everyone else gets MB/s
+	 */
+	if (!r)
+		snprintf(s, BENCHMARK_NUMBER, "%s", j ? "null" : "-");
+	else if (j)
+		snprintf(s, BENCHMARK_NUMBER, "%" PRIu64, r);
+	else
+		snprintf(s, BENCHMARK_NUMBER, "%'.1f", r / (double)MEGABYTE);
+	return s;
+}
+
+static bool benchmark_cipher_init(benchmark_cipher_t *z, enum gcry_cipher_algos c, enum gcry_cipher_modes m)
+{
+	if (gcry_cipher_open(&z->handle, c, m, 0) != GPG_ERR_NO_ERROR)
+		return false;
+	z->mode = m;
+	/*
+	 * some modes (XTS and SIV) need twice the usual key length; and the
+	 * key is random as a few ciphers (DES) refuse weak keys
+	 */
+	uint8_t k[4 * BENCHMARK_NUMBER];
+	gcry_randomize(k, sizeof k, GCRY_WEAK_RANDOM);
+	size_t l = gcry_cipher_get_algo_keylen(c);
+	if (l > sizeof k / 2 || (gcry_cipher_setkey(z->handle, k, l) != GPG_ERR_NO_ERROR && gcry_cipher_setkey(z->handle, k, l * 2) != GPG_ERR_NO_ERROR))
+		return gcry_cipher_close(z->handle) , false;
+	/*
+	 * the IV is usually a block, but stream ciphers (which have a block
+	 * length of 1) and GCM-SIV want a nonce instead; ARCFOUR doesn’t take
+	 * either
+	 */
+	memset(z->iv, 0x00, sizeof z->iv);
+	z->length = 0;
+	if (c == GCRY_CIPHER_ARCFOUR)
+		return true;
+	size_t n = gcry_cipher_get_algo_blklen(c);
+	if (n > 1 && n <= sizeof z->iv && benchmark_iv(z, n))
+		z->length = n;
+	else if (benchmark_iv(z, n > 1 ? BENCHMARK_NONCE_AEAD : BENCHMARK_NONCE))
+		z->length = n > 1 ? BENCHMARK_NONCE_AEAD : BENCHMARK_NONCE;
+	return true;
+}
+
+static bool benchmark_iv(benchmark_cipher_t *z, size_t l)
+{
+	if (z->mode == GCRY_CIPHER_MODE_CTR)
+		return gcry_cipher_setctr(z->handle, z->iv, l) == GPG_ERR_NO_ERROR;
+	return gcry_cipher_setiv(z->handle, z->iv, l) == GPG_ERR_NO_ERROR;
+}
+
+static bool benchmark_cipher(void *ptr, uint8_t *b, size_t l)
+{
+	benchmark_cipher_t *z = ptr;
+	/*
+	 * start again each time, as some modes only allow a single message
+	 */
+	gcry_cipher_reset(z->handle);
+	if (z->length)
+		benchmark_iv(z, z->length);
+	if (z->encrypt)
+		return gcry_cipher_encrypt(z->handle, b, l, NULL, 0) == GPG_ERR_NO_ERROR;
+	/*
+	 * SIV modes won’t decrypt without the tag to check; it won’t match,
+	 * but only once everything has been decrypted
+	 */
+	bool siv = z->mode == 15 /*GCRY_CIPHER_MODE_SIV*/ || z->mode == 16 /*GCRY_CIPHER_MODE_GCM_SIV*/;
+	if (siv)
+		gcry_cipher_ctl(z->handle, 80 /*GCRYCTL_SET_DECRYPTION_TAG*/, z->iv, BENCHMARK_TAG);
+	gcry_error_t e = gcry_cipher_decrypt(z->handle, b, l, NULL, 0);
+	return e == GPG_ERR_NO_ERROR || (siv && gcry_err_code(e) == GPG_ERR_CHECKSUM);
+}
+
+static bool benchmark_hash(void *ptr, uint8_t *b, size_t l)
+{
+	gcry_md_write((gcry_md_hd_t)ptr, b, l);
+	return true;
+}
+
+static bool benchmark_mac(void *ptr, uint8_t *b, size_t l)
+{
+	return gcry_mac_write((gcry_mac_hd_t)ptr, b, l) == GPG_ERR_NO_ERROR;
+}
+
+static bool benchmark_ecc_encode(void *ptr, uint8_t *b, size_t l)
+{
+	uint8_t *c = ptr;
+	for (size_t i = 0; i < l / ECC_PAYLOAD; i++)
+		ecc_encode(b + i * ECC_PAYLOAD, c + i * ECC_CAPACITY);
+	return true;
+}
+
+static bool benchmark_ecc_decode(void *ptr, uint8_t *b, size_t l)
+{
+	/*
+	 * decode what was encoded (so there’s nothing to correct, as with
+	 * nearly all data), but the rate is still of the payload
+	 */
+	uint8_t *c = ptr;
+	uint8_t m[ECC_CAPACITY];
+	for (size_t i = 0; i < l / ECC_PAYLOAD; i++)
+	{
+		int e;
+		ecc_decode(c + i * ECC_CAPACITY, m, &e);
+		if (e)
+			return false;
+	}
+	return (void)b , true;
+}
+
+static bool benchmark_compress(void *ptr, uint8_t *b, size_t l)
+{
+	benchmark_codec_t *z = ptr;
+	z->length = 0;
+	return lzma_easy_buffer_encode(z->preset, LZMA_CHECK_NONE, NULL, b, l, z->data, &z->length, z->size) == LZMA_OK;
+}
+
+static bool benchmark_decompress(void *ptr, uint8_t *b, size_t l)
+{
+	benchmark_codec_t *z = ptr;
+	uint64_t m = UINT64_MAX;
+	size_t i = 0;
+	size_t o = 0;
+	return lzma_stream_buffer_decode(&m, 0, NULL, z->data, &i, z->length, b, &o, l) == LZMA_OK && o == l;
+}
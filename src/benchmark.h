@@ -0,0 +1,50 @@
+/*
+ * encrypt ~ a simple, multi-OS encryption utility
+ * Copyright © 2005-2027, albinoloverats ~ Software Development
+ * email: encrypt@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _ENCRYPT_BENCHMARK_H_
+#define _ENCRYPT_BENCHMARK_H_
+
+/*!
+ * \file    benchmark.h
+ * \author  Ashley M Anderson
+ * \date    2027
+ * \brief   Measure how quickly each algorithm runs on this machine
+ *
+ * Everything is done in memory, so only the algorithms themselves are
+ * measured (not the file system). The data passes through each stage in
+ * turn when it’s encrypted, so the throughput of any combination of
+ * cipher, mode, hash and MAC follows from the throughput of each.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*!
+ * \brief         Run the benchmark
+ * \param[in]  j  Whether to write the results as JSON (rather than a table)
+ * \param[in]  i  Number of KDF iterations to give the time for
+ *
+ * Measures every cipher with each mode it can be used with (both ways),
+ * every hash and MAC, the KDF with each hash, the error correction and
+ * xz compression. Results are written to stdout as each is measured.
+ */
+extern void benchmark(bool j, uint64_t i);
+
+#endif /* ! _ENCRYPT_BENCHMARK_H_ */
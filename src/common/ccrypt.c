@@ -127,7 +127,7 @@ extern LIST list_of_ciphers(void)
 	static LIST *l = NULL;
 	if (!l)
 	{
-		l = list_init((int (*)(const void *, const void *))strcmp, false, true);
+		l = list_init((int (*)(const void *, const void *))strcmp, false, true, LIST_VECTOR);
 		for (int i = 0; i < len; i++)
 		{
 			const char *n = cipher_name_from_id(lid[i]);
@@ -158,7 +158,7 @@ extern LIST list_of_hashes(void)
 	static LIST *l = NULL;
 	if (!l)
 	{
-		l = list_init((int (*)(const void *, const void *))strcmp, false, true);
+		l = list_init((int (*)(const void *, const void *))strcmp, false, true, LIST_VECTOR);
 		for (int i = 0; i < len; i++)
 		{
 			const char *n = hash_name_from_id(lid[i]);
@@ -178,7 +178,7 @@ extern LIST list_of_modes(void)
 	if (!l)
 	{
 		unsigned m = sizeof MODES / sizeof( block_mode_t );
-		l = list_init((int (*)(const void *, const void *))strcmp, false, true);
+		l = list_init((int (*)(const void *, const void *))strcmp, false, true, LIST_VECTOR);
 		for (unsigned i = 0; i < m; i++)
 		{
 			gcry_cipher_hd_t c;
@@ -212,7 +212,7 @@ extern LIST list_of_macs(void)
 	static LIST *l = NULL;
 	if (!l)
 	{
-		l = list_init((int (*)(const void *, const void *))strcmp, false, true);
+		l = list_init((int (*)(const void *, const void *))strcmp, false, true, LIST_VECTOR);
 		for (int i = 0; i < len; i++)
 		{
 			const char *n = gcry_mac_algo_name(lid[i]);
@@ -139,7 +139,7 @@ extern int config_parse_aux(int argc, char **argv, LIST args, LIST extra, LIST n
 		return -1;
 	}
 
-	LIST largs = list_init((void *)strcmp, true, false);
+	LIST largs = list_init((void *)strcmp, true, false, LIST_VECTOR);
 	for (int i = 1; i < argc; i++) // from 1, skip invokation name
 	{
 		char *x = argv[i];
@@ -657,7 +657,13 @@ inline static void print_usage(LIST args, LIST extra)
 			{
 				if ((int)(j + 4 + (arg->option_type ? strlen(arg->option_type) : 0)) > max_width)
 					j = cli_eprintf("\n%*s  ", (int)strlen(about.name), " ");
-				if (arg->required)
+				/*
+				 * options without a (printable) short option are
+				 * shown by their long option instead
+				 */
+				if (!isalnum((unsigned char)arg->short_option))
+					j += cli_eprintf("%s--%s", arg->required ? ANSI_COLOUR_RED " <" : ANSI_COLOUR_YELLOW " [", arg->long_option);
+				else if (arg->required)
 					j += cli_eprintf(ANSI_COLOUR_RED " <-%c", arg->short_option);
 				else
 					j += cli_eprintf(ANSI_COLOUR_YELLOW " [-%c", arg->short_option);
@@ -689,9 +695,14 @@ static void print_option(int indent, char sopt, char *lopt, char *type, char *de
 		z -= strlen(lopt);
 	else
 		z += 4;
-	cli_eprintf("  " ANSI_COLOUR_WHITE "-%c" ANSI_COLOUR_RESET, sopt);
-	if (lopt)
-		cli_eprintf(", " ANSI_COLOUR_WHITE "--%s" ANSI_COLOUR_RESET, lopt);
+	if (!isalnum((unsigned char)sopt))
+		cli_eprintf("      " ANSI_COLOUR_WHITE "--%s" ANSI_COLOUR_RESET, lopt);
+	else
+	{
+		cli_eprintf("  " ANSI_COLOUR_WHITE "-%c" ANSI_COLOUR_RESET, sopt);
+		if (lopt)
+			cli_eprintf(", " ANSI_COLOUR_WHITE "--%s" ANSI_COLOUR_RESET, lopt);
+	}
 	if (type)
 	{
 		if (req)
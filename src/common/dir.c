@@ -214,7 +214,7 @@ static void get_tree(LIST l, const char *path, dir_type_e type)
 
 extern LIST dir_get_tree(const char *path, dir_type_e type)
 {
-	LIST l = list_string();
+	LIST l = list_init((void *)strcmp, true, true, LIST_VECTOR);
 	get_tree(l, path, type);
 	return l;
 }
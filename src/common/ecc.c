@@ -35,6 +35,14 @@
 #include <string.h>
 #include <inttypes.h>
 
+#if (defined __x86_64__ || defined __i386__) && defined __GNUC__
+	#define ECC_X86
+	#include <immintrin.h>
+#elif defined __aarch64__ && defined __ARM_NEON
+	#define ECC_NEON
+	#include <arm_neon.h>
+#endif
+
 #include "ecc.h"
 
 
@@ -47,15 +55,6 @@
 /* Exponentiation. Convert to exponential notation, mod ECC_CAPACITY */
 #define GF_EXP(A, B) ((A) == 0 ? 0 : e2v[(v2e[A] * (B)) % ECC_CAPACITY])
 
-#define REVERSE(A, L)                                                   \
-	for (int i = 0, j = (L) - 1; i < (L) / 2; i++, j--)             \
-	{                                                               \
-		A[i] ^= A[j];                                           \
-		A[j] ^= A[i];                                           \
-		A[i] ^= A[j];                                           \
-	}
-
-
 static const uint8_t g[ECC_OFFSET] = { 0x75, 0x31, 0x3A, 0x9E, 0x04, 0x7E };
 
 static const uint8_t e2v[ECC_CAPACITY + 1] =
@@ -100,32 +99,187 @@ static const uint8_t v2e[ECC_CAPACITY + 1] =
 
 
 /*
- * Polynomial Evaluator, used to determine the Syndrome Vector. This is
- * relatively straightforward, and there are faster algorithms.
+ * Lookup tables, built once at start up (see ecc_tables() below):
+ *   parity: the change to the encoder's shift register for each
+ *           possible input byte, with all 6 bytes of the register
+ *           packed in to one integer
+ *   power:  multiplication by each root of the generator polynomial
+ *           (alpha^1 .. alpha^6), used for the syndromes
+ *   nibble: multiplication by (powers of) each root, split in to the
+ *           low and high nibbles so that 16 (or 32) bytes can be
+ *           multiplied at once using a byte shuffle
+ */
+#define NIBBLE_POWERS 6 /* x^1, x^2, x^4, x^8, x^16, x^32 */
+
+static uint64_t parity[ECC_CAPACITY + 1];
+static uint8_t power[ECC_OFFSET][ECC_CAPACITY + 1];
+static uint8_t nibble[ECC_OFFSET][NIBBLE_POWERS][2][16] __attribute__((aligned(32)));
+
+static void syndrome_scalar(const uint8_t [ECC_CAPACITY], uint8_t [ECC_OFFSET + 1]);
+#if defined ECC_X86
+static void syndrome_ssse3(const uint8_t [ECC_CAPACITY], uint8_t [ECC_OFFSET + 1]);
+static void syndrome_avx2(const uint8_t [ECC_CAPACITY], uint8_t [ECC_OFFSET + 1]);
+#elif defined ECC_NEON
+static void syndrome_neon(const uint8_t [ECC_CAPACITY], uint8_t [ECC_OFFSET + 1]);
+#endif
+
+/*
+ * Determine the Syndrome Vector. Note that in s[0] we return the OR of
+ * all of the syndromes; this allows for an easy check for the no - error
+ * condition. Which implementation is used depends on what the CPU can
+ * do; they all give the same result.
+ */
+static void (*syndrome)(const uint8_t [ECC_CAPACITY], uint8_t [ECC_OFFSET + 1]) = syndrome_scalar;
+
+static void __attribute__((constructor)) ecc_tables(void)
+{
+	for (int i = 0; i < ECC_CAPACITY + 1; i++)
+	{
+		parity[i] = 0;
+		for (int j = 0; j < ECC_OFFSET; j++)
+			parity[i] |= (uint64_t)GF_MUL(i, g[j]) << (j * 8);
+		for (int j = 0; j < ECC_OFFSET; j++)
+			power[j][i] = GF_MUL(i, e2v[j + 1]);
+	}
+	for (int j = 0; j < ECC_OFFSET; j++)
+		for (int k = 0; k < NIBBLE_POWERS; k++)
+		{
+			uint8_t x = GF_EXP(e2v[j + 1], 1 << k);
+			for (int i = 0; i < 16; i++)
+			{
+				nibble[j][k][0][i] = GF_MUL(x, i);
+				nibble[j][k][1][i] = GF_MUL(x, i << 4);
+			}
+		}
+
+#if defined ECC_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		syndrome = syndrome_avx2;
+	else if (__builtin_cpu_supports("ssse3"))
+		syndrome = syndrome_ssse3;
+#elif defined ECC_NEON
+	syndrome = syndrome_neon;
+#endif
+}
+
+/*
+ * Evaluate the code (as a polynomial, first byte being the highest
+ * power) at each root of the generator using Horner's method.
  */
-static uint8_t evalpoly(uint8_t p[ECC_CAPACITY], uint8_t x)
+static void syndrome_scalar(const uint8_t c[ECC_CAPACITY], uint8_t s[ECC_OFFSET + 1])
 {
-	uint8_t y = 0;
+	uint8_t y[ECC_OFFSET] = { 0x0 };
 	for (int i = 0; i < ECC_CAPACITY; i++)
-		y = GF_ADD(y, GF_MUL(p[i], GF_EXP(x, i)));
-	return y;
+		for (int j = 0; j < ECC_OFFSET; j++)
+			y[j] = GF_ADD(power[j][y[j]], c[i]);
+	s[0] = 0;
+	for (int j = 0; j < ECC_OFFSET; j++)
+		s[0] |= (s[j + 1] = y[j]);
 }
 
 /*
- * Determine the Syndrome Vector. Note that in s[0] we return the OR of
- * all of the syndromes; this allows for an easy check for the no - error
- * condition.
+ * The vector versions do the same, but for every 16th (or 32nd) byte in
+ * each lane at once; multiplying by x^16 (or x^32) each time. The lanes
+ * are then combined by repeatedly multiplying by x^8, x^4, x^2, x^1 and
+ * adding the neighbouring lane. The code is prefixed with a zero byte
+ * so that it's a whole number of vectors long.
  */
-static void syndrome(uint8_t c[ECC_CAPACITY], uint8_t s[7])
+#if defined ECC_X86
+
+#define SSSE3_MUL(A, T) _mm_xor_si128(_mm_shuffle_epi8(_mm_load_si128((const __m128i *)(T)[0]), _mm_and_si128((A), _mm_set1_epi8(0x0F))), \
+                                      _mm_shuffle_epi8(_mm_load_si128((const __m128i *)(T)[1]), _mm_and_si128(_mm_srli_epi16((A), 4), _mm_set1_epi8(0x0F))))
+
+__attribute__((target("ssse3")))
+static void syndrome_ssse3(const uint8_t c[ECC_CAPACITY], uint8_t s[ECC_OFFSET + 1])
+{
+	uint8_t p[ECC_CAPACITY + 1] __attribute__((aligned(16))) = { 0x0 };
+	memcpy(p + 1, c, ECC_CAPACITY);
+	__m128i y[ECC_OFFSET];
+	for (int j = 0; j < ECC_OFFSET; j++)
+		y[j] = _mm_setzero_si128();
+	for (int i = 0; i < ECC_CAPACITY + 1; i += 16)
+	{
+		__m128i d = _mm_load_si128((const __m128i *)(p + i));
+		for (int j = 0; j < ECC_OFFSET; j++)
+			y[j] = _mm_xor_si128(SSSE3_MUL(y[j], nibble[j][4]), d);
+	}
+	s[0] = 0;
+	for (int j = 0; j < ECC_OFFSET; j++)
+	{
+		__m128i x = y[j];
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][3]), _mm_srli_si128(x, 8));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][2]), _mm_srli_si128(x, 4));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][1]), _mm_srli_si128(x, 2));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][0]), _mm_srli_si128(x, 1));
+		s[0] |= (s[j + 1] = (uint8_t)_mm_cvtsi128_si32(x));
+	}
+}
+
+#define AVX2_MUL(A, T) _mm256_xor_si256(_mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(T)[0])), _mm256_and_si256((A), _mm256_set1_epi8(0x0F))), \
+                                        _mm256_shuffle_epi8(_mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)(T)[1])), _mm256_and_si256(_mm256_srli_epi16((A), 4), _mm256_set1_epi8(0x0F))))
+
+__attribute__((target("avx2")))
+static void syndrome_avx2(const uint8_t c[ECC_CAPACITY], uint8_t s[ECC_OFFSET + 1])
+{
+	uint8_t p[ECC_CAPACITY + 1] __attribute__((aligned(32))) = { 0x0 };
+	memcpy(p + 1, c, ECC_CAPACITY);
+	__m256i y[ECC_OFFSET];
+	for (int j = 0; j < ECC_OFFSET; j++)
+		y[j] = _mm256_setzero_si256();
+	for (int i = 0; i < ECC_CAPACITY + 1; i += 32)
+	{
+		__m256i d = _mm256_load_si256((const __m256i *)(p + i));
+		for (int j = 0; j < ECC_OFFSET; j++)
+			y[j] = _mm256_xor_si256(AVX2_MUL(y[j], nibble[j][5]), d);
+	}
+	s[0] = 0;
+	for (int j = 0; j < ECC_OFFSET; j++)
+	{
+		/*
+		 * the low half is 16 bytes further from the end of the code
+		 */
+		__m128i x = _mm_xor_si128(SSSE3_MUL(_mm256_castsi256_si128(y[j]), nibble[j][4]), _mm256_extracti128_si256(y[j], 1));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][3]), _mm_srli_si128(x, 8));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][2]), _mm_srli_si128(x, 4));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][1]), _mm_srli_si128(x, 2));
+		x = _mm_xor_si128(SSSE3_MUL(x, nibble[j][0]), _mm_srli_si128(x, 1));
+		s[0] |= (s[j + 1] = (uint8_t)_mm_cvtsi128_si32(x));
+	}
+}
+
+#elif defined ECC_NEON
+
+#define NEON_MUL(A, T) veorq_u8(vqtbl1q_u8(vld1q_u8((T)[0]), vandq_u8((A), vdupq_n_u8(0x0F))), vqtbl1q_u8(vld1q_u8((T)[1]), vshrq_n_u8((A), 4)))
+
+static void syndrome_neon(const uint8_t c[ECC_CAPACITY], uint8_t s[ECC_OFFSET + 1])
 {
+	uint8_t p[ECC_CAPACITY + 1] __attribute__((aligned(16))) = { 0x0 };
+	memcpy(p + 1, c, ECC_CAPACITY);
+	uint8x16_t y[ECC_OFFSET];
+	for (int j = 0; j < ECC_OFFSET; j++)
+		y[j] = vdupq_n_u8(0x0);
+	for (int i = 0; i < ECC_CAPACITY + 1; i += 16)
+	{
+		uint8x16_t d = vld1q_u8(p + i);
+		for (int j = 0; j < ECC_OFFSET; j++)
+			y[j] = veorq_u8(NEON_MUL(y[j], nibble[j][4]), d);
+	}
 	s[0] = 0;
-	for (int i = 1; i < ECC_OFFSET + 1; i++)
+	for (int j = 0; j < ECC_OFFSET; j++)
 	{
-		s[i] = evalpoly(c, e2v[i]);
-		s[0] |= s[i];
+		uint8x16_t x = y[j];
+		uint8x16_t z = vdupq_n_u8(0x0);
+		x = veorq_u8(NEON_MUL(x, nibble[j][3]), vextq_u8(x, z, 8));
+		x = veorq_u8(NEON_MUL(x, nibble[j][2]), vextq_u8(x, z, 4));
+		x = veorq_u8(NEON_MUL(x, nibble[j][1]), vextq_u8(x, z, 2));
+		x = veorq_u8(NEON_MUL(x, nibble[j][0]), vextq_u8(x, z, 1));
+		s[0] |= (s[j + 1] = vgetq_lane_u8(x, 0));
 	}
 }
 
+#endif
+
 /*
  * Determine the number of errors in a block. Since we have to find the
  * determinant of the S[] matrix in order to determine singularity, we
@@ -182,8 +336,6 @@ static void polysolve(uint8_t polynom[4], uint8_t roots[3], int *numsol)
  */
 extern void ecc_decode(uint8_t code[ECC_CAPACITY], uint8_t mesg[ECC_CAPACITY], int *errcode)
 {
-	REVERSE(code, ECC_CAPACITY);
-
 	uint8_t syn[ECC_OFFSET + 1], deter, z[4], e0, e1, e2, n0, n1, n2, w0, w1, w2, x0, x[3];
 	int sols;
 
@@ -193,11 +345,14 @@ extern void ecc_decode(uint8_t code[ECC_CAPACITY], uint8_t mesg[ECC_CAPACITY], i
 	 * First, get the message out of the code, so that even if we can't correct
 	 * it, we return an estimate.
 	 */
-	for (int i = 0; i < ECC_PAYLOAD; i++)
-		mesg[i] = code[(ECC_CAPACITY - 1) - i];
+	memcpy(mesg, code, ECC_PAYLOAD);
 
 	syndrome(code, syn);
 
+	/*
+	 * Most of the time there won't be any errors, so there's nothing
+	 * more to do.
+	 */
 	if (syn[0] == 0)
 		return;
 
@@ -310,24 +465,19 @@ extern void ecc_decode(uint8_t code[ECC_CAPACITY], uint8_t mesg[ECC_CAPACITY], i
 /*
  * Reed - Solomon Encoder. The Encoder uses a shift register algorithm,
  * as detailed in _Applied Modern Algebra_ by Dornhoff and Hohn (p.446).
- * Note that the message is reversed in the code array; this was done to
- * allow for (emergency) recovery of the message directly from the
- * data stream.
+ * Note that the message is stored, unaltered, at the start of the code;
+ * this was done to allow for (emergency) recovery of the message
+ * directly from the data stream. The 6 bytes of the shift register are
+ * kept together so each message byte only needs a single table lookup.
  */
 extern void ecc_encode(uint8_t m[ECC_PAYLOAD], uint8_t c[ECC_CAPACITY])
 {
-	uint8_t r[ECC_OFFSET] = { 0x0 };
+	uint64_t r = 0;
 
 	for (int i = 0; i < ECC_PAYLOAD; i++)
-	{
-		c[(ECC_CAPACITY - 1) - i] = m[i];
-		uint8_t rtmp = GF_ADD(m[i], r[5]);
-		for (int j = ECC_OFFSET - 1; j > 0; j--)
-			r[j] = GF_ADD(GF_MUL(rtmp, g[j]), r[j - 1]);
-		r[0] = GF_MUL(rtmp, g[0]);
-	}
-	for (int i = 0; i < ECC_OFFSET; i++)
-		c[i] = r[i];
+		r = ((r << 8) & 0xFFFFFFFFFFFFLLU) ^ parity[GF_ADD(m[i], (uint8_t)(r >> 40))];
 
-	REVERSE(c, ECC_CAPACITY);
+	memcpy(c, m, ECC_PAYLOAD);
+	for (int i = 0; i < ECC_OFFSET; i++)
+		c[(ECC_CAPACITY - 1) - i] = (uint8_t)(r >> (i * 8));
 }
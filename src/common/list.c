@@ -19,7 +19,9 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "common.h"
@@ -27,6 +29,9 @@
 #include "list.h"
 #include "error.h"
 
+#define LIST_VECTOR_SIZE 0x10 /*!< Initial number of items there's space for in a vector */
+#define LIST_INDEX_SIZE  0x40 /*!< Initial number of slots in a hash index */
+
 typedef struct _item_t
 {
 	struct _item_t *next;
@@ -38,8 +43,16 @@ typedef struct
 {
 	item_t *head;                               /*!< The first item in the list */
 	item_t *tail;                               /*!< The last item in the list - allows easy appending of items */
+	const void **items;                         /*!< The items in the list, when it's a vector */
+	size_t  capacity;                           /*!< How many items there's space for in the vector */
+	size_t  ordered;                            /*!< How many items at the start of the vector are known to be in order (sorted lists only) */
+	const void **index;                         /*!< Hash index of the items, when the list is hashed */
+	size_t  slots;                              /*!< Number of slots in the index (always a power of 2) */
+	size_t  used;                               /*!< Number of slots in the index that aren't empty (including removed items) */
 	size_t  size;                               /*!< The number of items in the list - gives constant lookup, so no need to count each time */
 	int (*compare)(const void *, const void *); /*!< How to compare items in the list */
+	size_t (*hash)(const void *);               /*!< How to hash items in the list (consistent with compare) */
+	list_type_e type;                           /*!< How the list is stored */
 	bool duplicates:1;                          /*!< Whether to allow duplicate items in the list */
 	bool sorted:1;                              /*!< Whether the items should be sorted */
 }
@@ -48,18 +61,46 @@ list_t;
 typedef struct
 {
 	item_t *next;
+	list_t *list;
+	size_t index;
 }
 iterator_t;
 
-extern LIST list_init(int comparison_fn_t(const void *, const void *), bool dupes, bool sorted)
+static const byte_t REMOVED = 0x00; /*!< Marks index slots of items which were removed */
+
+static bool vector_append(list_t *, const void *);
+static bool vector_insert(list_t *, size_t, const void *);
+static bool vector_add(list_t *, const void *);
+static const void *vector_contains(list_t *, const void *);
+static const void *vector_remove_item(list_t *, const void *);
+static const void *vector_remove_index(list_t *, size_t);
+static void vector_sort(list_t *);
+static void vector_order(list_t *);
+static void vector_grow(list_t *);
+static void index_add(list_t *, const void *);
+static void index_remove(list_t *, const void *);
+static void index_rebuild(list_t *, size_t);
+static size_t index_hash(list_t *, const void *);
+static void merge_sort(const void **, const void **, size_t, int (*)(const void *, const void *));
+static void merge(const void **, const void **, size_t, size_t, int (*)(const void *, const void *));
+
+extern LIST list_init_aux(int comparison_fn_t(const void *, const void *), bool dupes, bool sorted, list_type_e type, size_t hash_fn_t(const void *))
 {
 	list_t *list = calloc(sizeof( list_t ), sizeof( byte_t ));
 	if (!list)
 		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( list_t ));
 	list->size = 0;
 	list->compare = comparison_fn_t;
+	list->hash = hash_fn_t;
 	list->duplicates = dupes;
 	list->sorted = sorted;
+	/*
+	 * items can only be found by their hash if equal items always have
+	 * the same hash; without a comparator that's just their address
+	 */
+	if (type == LIST_HASHED && comparison_fn_t && !hash_fn_t)
+		type = LIST_VECTOR;
+	list->type = type;
 	return list;
 }
 
@@ -68,6 +109,16 @@ extern void list_deinit_aux(LIST ptr, void f(void *))
 	list_t *list_ptr = (list_t *)ptr;
 	if (!list_ptr)
 		return;
+	if (list_ptr->type != LIST_LINKED)
+	{
+		if (f)
+			for (size_t i = 0; i < list_ptr->size; i++)
+				f((void *)list_ptr->items[i]);
+		free(list_ptr->items);
+		free(list_ptr->index);
+		free(list_ptr);
+		return;
+	}
 	item_t *item = list_ptr->head;
 	while (item)
 	{
@@ -86,9 +137,16 @@ extern LIST list_copy(LIST ptr, void *c(const void *))
 	list_t *list_ptr = (list_t *)ptr;
 	if (!list_ptr)
 		return NULL;
-	LIST copy = list_init(list_ptr->compare, list_ptr->duplicates, list_ptr->sorted);
+	LIST copy = list_init_aux(list_ptr->compare, list_ptr->duplicates, list_ptr->sorted, list_ptr->type, list_ptr->hash);
 	if (!list_ptr->size)
 		return copy;
+	if (list_ptr->type != LIST_LINKED)
+	{
+		vector_order(list_ptr);
+		for (size_t i = 0; i < list_ptr->size; i++)
+			list_append(copy, c(list_ptr->items[i]));
+		return copy;
+	}
 	item_t *item = list_ptr->head;
 	do
 	{
@@ -117,6 +175,8 @@ extern bool list_append(LIST ptr, const void *d)
 		return false;
 	if (list_ptr->sorted)
 		return list_add(ptr, d);
+	if (list_ptr->type != LIST_LINKED)
+		return vector_append(list_ptr, d);
 	if (!list_ptr->duplicates && list_contains(ptr, d))
 		return false;
 	item_t *new = calloc(sizeof( item_t ), sizeof( byte_t ));
@@ -142,6 +202,8 @@ extern bool list_insert(LIST ptr, size_t i, const void *d)
 		return list_add(ptr, d);
 	if (i >= list_ptr->size)
 		return list_append(ptr, d);
+	if (list_ptr->type != LIST_LINKED)
+		return vector_insert(list_ptr, i, d);
 	if (!list_ptr->duplicates && list_contains(ptr, d))
 		return false;
 	item_t *new = calloc(sizeof( item_t ), sizeof( byte_t ));
@@ -173,6 +235,8 @@ extern bool list_add(LIST ptr, const void *d)
 		return false;
 	if (!list_ptr->sorted)
 		return list_append(ptr, d);
+	if (list_ptr->type != LIST_LINKED)
+		return vector_add(list_ptr, d);
 	if (!list_ptr->duplicates && list_contains(ptr, d))
 		return false;
 	item_t *new = calloc(sizeof( item_t ), sizeof( byte_t ));
@@ -242,6 +306,14 @@ extern int list_add_all(LIST ptr, LIST otr, void *c(const void *))
 	if (!list_otr->size)
 		return 0;
 	int r = 0;
+	if (list_otr->type != LIST_LINKED)
+	{
+		vector_order(list_otr);
+		for (size_t i = 0; i < list_otr->size; i++)
+			if (list_append(list_ptr, c(list_otr->items[i])))
+				r++;
+		return r;
+	}
 	item_t *item = list_otr->head;
 	do
 	{
@@ -260,6 +332,11 @@ extern const void *list_get(LIST ptr, size_t i)
 		return NULL;
 	if (i >= list_ptr->size)
 		return NULL;
+	if (list_ptr->type != LIST_LINKED)
+	{
+		vector_order(list_ptr);
+		return list_ptr->items[i];
+	}
 	item_t *item = list_ptr->head;
 	for (size_t j = 0; j < i; j++)
 		item = item->next;
@@ -273,6 +350,8 @@ extern const void *list_contains(LIST ptr, const void *d)
 		return NULL;
 	if (!list_ptr->size)
 		return NULL;
+	if (list_ptr->type != LIST_LINKED)
+		return vector_contains(list_ptr, d);
 	item_t *item = list_ptr->head;
 	do
 	{
@@ -291,6 +370,8 @@ extern const void *list_remove_item(LIST ptr, const void *d)
 		return NULL;
 	if (!list_ptr->size)
 		return NULL;
+	if (list_ptr->type != LIST_LINKED)
+		return vector_remove_item(list_ptr, d);
 	void *data = NULL;
 	item_t *item = list_ptr->head;
 	item_t *prev = NULL;
@@ -324,6 +405,8 @@ extern const void *list_remove_index(LIST ptr, size_t i)
 		return NULL;
 	if (i >= list_ptr->size)
 		return NULL;
+	if (list_ptr->type != LIST_LINKED)
+		return vector_remove_index(list_ptr, i);
 	item_t *item = list_ptr->head;
 	if (i == 0)
 		list_ptr->head = item->next;
@@ -351,6 +434,8 @@ extern ITER list_iterator(LIST ptr)
 	if (!iter)
 		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( iterator_t ));
 	iter->next = list_ptr->head;
+	iter->list = list_ptr->type != LIST_LINKED ? list_ptr : NULL;
+	iter->index = 0;
 	return iter;
 }
 
@@ -359,6 +444,13 @@ extern const void *list_get_next(ITER ptr)
 	iterator_t *iter_ptr = (iterator_t *)ptr;
 	if (!iter_ptr)
 		return NULL;
+	if (iter_ptr->list)
+	{
+		if (iter_ptr->index >= iter_ptr->list->size)
+			return NULL;
+		vector_order(iter_ptr->list);
+		return iter_ptr->list->items[iter_ptr->index++];
+	}
 	item_t *next = iter_ptr->next;
 	if (!next)
 		return NULL;
@@ -371,6 +463,8 @@ extern bool list_has_next(ITER ptr)
 	iterator_t *iter_ptr = (iterator_t *)ptr;
 	if (!iter_ptr)
 		return false;
+	if (iter_ptr->list)
+		return iter_ptr->index < iter_ptr->list->size;
 	return iter_ptr->next;
 }
 
@@ -381,6 +475,13 @@ extern void list_for_each(LIST ptr, void f(const void *))
 		return;
 	if (!list_ptr->size)
 		return;
+	if (list_ptr->type != LIST_LINKED)
+	{
+		vector_order(list_ptr);
+		for (size_t i = 0; i < list_ptr->size; i++)
+			f(list_ptr->items[i]);
+		return;
+	}
 	item_t *item = list_ptr->head;
 	do
 	{
@@ -391,11 +492,6 @@ extern void list_for_each(LIST ptr, void f(const void *))
 	return;
 }
 
-static void *list_sort_noop(const void *x)
-{
-	return (void *)x;
-}
-
 extern void list_sort(LIST ptr)
 {
 	list_t *list_ptr = (list_t *)ptr;
@@ -405,19 +501,46 @@ extern void list_sort(LIST ptr)
 		return;
 	if (!list_ptr->size)
 		return;
+	if (list_ptr->type != LIST_LINKED)
+	{
+		vector_sort(list_ptr);
+		return;
+	}
 
-	list_t *copy = list_init(list_ptr->compare, list_ptr->duplicates, true);
-	list_add_all(copy, list_ptr, list_sort_noop);
+	/*
+	 * sort everything at once, then put the items back in order
+	 */
+	const void **v = malloc(list_ptr->size * 2 * sizeof( void * ));
+	if (!v)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, list_ptr->size * 2 * sizeof( void * ));
+	size_t z = 0;
+	for (item_t *item = list_ptr->head; item; item = item->next)
+		v[z++] = item->data;
+	merge_sort(v, v + z, z, list_ptr->compare);
 
-	size_t z = list_ptr->size;
+	item_t *item = list_ptr->head;
+	item_t *prev = NULL;
+	list_ptr->size = 0;
 	for (size_t i = 0; i < z; i++)
-		list_remove_index(list_ptr, 0);
+	{
+		if (!list_ptr->duplicates && prev && !list_ptr->compare(v[i], prev->data))
+			continue;
+		item->data = v[i];
+		prev = item;
+		item = item->next;
+		list_ptr->size++;
+	}
+	list_ptr->tail = prev;
+	prev->next = NULL;
+	while (item)
+	{
+		item_t *next = item->next;
+		free(item);
+		item = next;
+	}
+	free(v);
 
 	list_ptr->sorted = true;
-	list_add_all(list_ptr, copy, list_sort_noop);
-
-	list_deinit(copy);
-
 	return;
 }
 
@@ -427,6 +550,8 @@ extern void list_add_comparator(LIST ptr, int c(const void *, const void *))
 	if (!list_ptr)
 		return;
 	list_ptr->compare = c;
+	if (list_ptr->type == LIST_HASHED && !list_ptr->hash)
+		list_ptr->type = LIST_VECTOR;
 	return;
 }
 
@@ -445,3 +570,287 @@ extern int list_compare_decimal(const void *a, const void *b)
 	const long double *y = b;
 	return *x - *y;
 }
+
+extern size_t list_hash_string(const void *a)
+{
+	/*
+	 * FNV-1a
+	 */
+	size_t h = 0xCBF29CE484222325LLU;
+	for (const char *x = a; *x; x++)
+		h = (h ^ (uint8_t)*x) * 0x100000001B3LLU;
+	return h;
+}
+
+extern size_t list_hash_integer(const void *a)
+{
+	return (size_t)*(const int64_t *)a;
+}
+
+static bool vector_append(list_t *list_ptr, const void *d)
+{
+	if (!list_ptr->duplicates && vector_contains(list_ptr, d))
+		return false;
+	if (list_ptr->type == LIST_HASHED)
+		index_add(list_ptr, d);
+	vector_grow(list_ptr);
+	list_ptr->items[list_ptr->size++] = d;
+	return true;
+}
+
+static bool vector_insert(list_t *list_ptr, size_t i, const void *d)
+{
+	if (!list_ptr->duplicates && vector_contains(list_ptr, d))
+		return false;
+	if (list_ptr->type == LIST_HASHED)
+		index_add(list_ptr, d);
+	vector_grow(list_ptr);
+	memmove(list_ptr->items + i + 1, list_ptr->items + i, (list_ptr->size - i) * sizeof( void * ));
+	list_ptr->items[i] = d;
+	list_ptr->size++;
+	return true;
+}
+
+static bool vector_add(list_t *list_ptr, const void *d)
+{
+	/*
+	 * new items are only put in order when they're next needed, so
+	 * that adding lots of items at once only needs one sort
+	 */
+	if (!list_ptr->duplicates && vector_contains(list_ptr, d))
+		return false;
+	if (list_ptr->type == LIST_HASHED)
+		index_add(list_ptr, d);
+	vector_grow(list_ptr);
+	list_ptr->items[list_ptr->size++] = d;
+	return true;
+}
+
+static const void *vector_contains(list_t *list_ptr, const void *d)
+{
+	if (list_ptr->type == LIST_HASHED)
+	{
+		if (!list_ptr->slots)
+			return NULL;
+		for (size_t i = index_hash(list_ptr, d); list_ptr->index[i]; i = (i + 1) & (list_ptr->slots - 1))
+			if (list_ptr->index[i] != &REMOVED && (list_ptr->index[i] == d || (list_ptr->compare && !list_ptr->compare(d, list_ptr->index[i]))))
+				return list_ptr->index[i];
+		return NULL;
+	}
+	if (list_ptr->sorted)
+	{
+		/*
+		 * ordering every time would make adding lots of items at once
+		 * quadratic, so only put new items in order once there are
+		 * more of them than is worth checking one by one (about the
+		 * square root of how many there are in all)
+		 */
+		size_t n = list_ptr->size - list_ptr->ordered;
+		if (n * n > list_ptr->size)
+			vector_order(list_ptr);
+		/*
+		 * find the first matching item in those that are in order...
+		 */
+		size_t l = 0;
+		for (size_t h = list_ptr->ordered; l < h; )
+		{
+			size_t m = l + (h - l) / 2;
+			if (list_ptr->compare(list_ptr->items[m], d) < 0)
+				l = m + 1;
+			else
+				h = m;
+		}
+		if (l < list_ptr->ordered && !list_ptr->compare(d, list_ptr->items[l]))
+			return list_ptr->items[l];
+		/*
+		 * ...and then in any which aren't yet
+		 */
+		for (size_t i = list_ptr->ordered; i < list_ptr->size; i++)
+			if (!list_ptr->compare(d, list_ptr->items[i]))
+				return list_ptr->items[i];
+		return NULL;
+	}
+	for (size_t i = 0; i < list_ptr->size; i++)
+		if (list_ptr->items[i] == d || (list_ptr->compare && !list_ptr->compare(d, list_ptr->items[i])))
+			return list_ptr->items[i];
+	return NULL;
+}
+
+static const void *vector_remove_item(list_t *list_ptr, const void *d)
+{
+	vector_order(list_ptr);
+	const void *data = NULL;
+	size_t j = 0;
+	for (size_t i = 0; i < list_ptr->size; i++)
+		if (list_ptr->items[i] == d || (list_ptr->compare && !list_ptr->compare(d, list_ptr->items[i])))
+		{
+			data = list_ptr->items[i];
+			if (list_ptr->type == LIST_HASHED)
+				index_remove(list_ptr, data);
+		}
+		else
+			list_ptr->items[j++] = list_ptr->items[i];
+	list_ptr->size = list_ptr->ordered = j;
+	return data;
+}
+
+static const void *vector_remove_index(list_t *list_ptr, size_t i)
+{
+	vector_order(list_ptr);
+	const void *data = list_ptr->items[i];
+	memmove(list_ptr->items + i, list_ptr->items + i + 1, (list_ptr->size - i - 1) * sizeof( void * ));
+	list_ptr->size--;
+	list_ptr->ordered = list_ptr->size;
+	if (list_ptr->type == LIST_HASHED)
+		index_remove(list_ptr, data);
+	return data;
+}
+
+static void vector_sort(list_t *list_ptr)
+{
+	list_ptr->sorted = true;
+	list_ptr->ordered = 0;
+	vector_order(list_ptr);
+	if (list_ptr->duplicates)
+		return;
+	size_t j = 0;
+	for (size_t i = 0; i < list_ptr->size; i++)
+		if (j && !list_ptr->compare(list_ptr->items[i], list_ptr->items[j - 1]))
+		{
+			if (list_ptr->type == LIST_HASHED)
+				index_remove(list_ptr, list_ptr->items[i]);
+		}
+		else
+			list_ptr->items[j++] = list_ptr->items[i];
+	list_ptr->size = list_ptr->ordered = j;
+	return;
+}
+
+static void vector_order(list_t *list_ptr)
+{
+	if (!list_ptr->sorted || list_ptr->ordered >= list_ptr->size)
+		return;
+	/*
+	 * sort the new items, then merge them in with those that were
+	 * already in order; new items go after any existing equal items
+	 */
+	size_t n = list_ptr->size - list_ptr->ordered;
+	const void **t = malloc((list_ptr->size > n ? list_ptr->size : n) * sizeof( void * ));
+	if (!t)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, list_ptr->size * sizeof( void * ));
+	merge_sort(list_ptr->items + list_ptr->ordered, t, n, list_ptr->compare);
+	merge(list_ptr->items, t, list_ptr->ordered, list_ptr->size, list_ptr->compare);
+	free(t);
+	list_ptr->ordered = list_ptr->size;
+	return;
+}
+
+static void vector_grow(list_t *list_ptr)
+{
+	if (list_ptr->size < list_ptr->capacity)
+		return;
+	size_t z = list_ptr->capacity ? list_ptr->capacity * 2 : LIST_VECTOR_SIZE;
+	const void **x = realloc(list_ptr->items, z * sizeof( void * ));
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z * sizeof( void * ));
+	list_ptr->items = x;
+	list_ptr->capacity = z;
+	return;
+}
+
+static void index_add(list_t *list_ptr, const void *d)
+{
+	if ((list_ptr->used + 1) * 2 > list_ptr->slots)
+	{
+		/*
+		 * only grow if it's the items filling the index rather than
+		 * those that have been removed
+		 */
+		size_t z = list_ptr->slots ? : LIST_INDEX_SIZE;
+		if ((list_ptr->size + 1) * 4 > z)
+			z *= 2;
+		index_rebuild(list_ptr, z);
+	}
+	size_t i = index_hash(list_ptr, d);
+	while (list_ptr->index[i] && list_ptr->index[i] != &REMOVED)
+		i = (i + 1) & (list_ptr->slots - 1);
+	if (!list_ptr->index[i])
+		list_ptr->used++;
+	list_ptr->index[i] = d;
+	return;
+}
+
+static void index_remove(list_t *list_ptr, const void *d)
+{
+	for (size_t i = index_hash(list_ptr, d); list_ptr->index[i]; i = (i + 1) & (list_ptr->slots - 1))
+		if (list_ptr->index[i] == d)
+		{
+			list_ptr->index[i] = &REMOVED;
+			break;
+		}
+	return;
+}
+
+static void index_rebuild(list_t *list_ptr, size_t z)
+{
+	/*
+	 * also clears out removed items; all the items (except the one
+	 * about to be added) are already in the vector
+	 */
+	free(list_ptr->index);
+	if (!(list_ptr->index = calloc(z, sizeof( void * ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z * sizeof( void * ));
+	list_ptr->slots = z;
+	list_ptr->used = 0;
+	for (size_t j = 0; j < list_ptr->size; j++)
+	{
+		size_t i = index_hash(list_ptr, list_ptr->items[j]);
+		while (list_ptr->index[i])
+			i = (i + 1) & (z - 1);
+		list_ptr->index[i] = list_ptr->items[j];
+		list_ptr->used++;
+	}
+	return;
+}
+
+static size_t index_hash(list_t *list_ptr, const void *d)
+{
+	uint64_t x = list_ptr->hash ? list_ptr->hash(d) : (uintptr_t)d;
+	/*
+	 * mix the bits up, so that similar hashes (or addresses) don't all
+	 * end up in the same part of the index
+	 */
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9LLU;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBLLU;
+	return (x ^ (x >> 31)) & (list_ptr->slots - 1);
+}
+
+static void merge_sort(const void **v, const void **t, size_t n, int c(const void *, const void *))
+{
+	/*
+	 * stable, so items which compare equal stay in the order they
+	 * were added
+	 */
+	if (n < 2)
+		return;
+	size_t m = n / 2;
+	merge_sort(v, t, m, c);
+	merge_sort(v + m, t, n - m, c);
+	merge(v, t, m, n, c);
+	return;
+}
+
+static void merge(const void **v, const void **t, size_t m, size_t n, int c(const void *, const void *))
+{
+	if (!m || m == n || c(v[m], v[m - 1]) >= 0)
+		return;
+	memcpy(t, v, m * sizeof( void * ));
+	size_t i = 0;
+	size_t j = m;
+	size_t k = 0;
+	while (i < m && j < n)
+		v[k++] = c(v[j], t[i]) < 0 ? v[j++] : t[i++];
+	while (i < m)
+		v[k++] = t[i++];
+	return;
+}
@@ -39,16 +39,24 @@ typedef void * LIST; /*!< The user visible LIST type */
 
 typedef void * ITER;
 
-#if 0
-#define LIST_INIT_COUNT(...) LIST_INIT_COUNT2(__VA_ARGS__, 3, 2, 1) /*!< Function overloading argument count (part 1) */
-#define LIST_INIT_COUNT2(_1, _2, _3, _, ...) _                      /*!< Function overloading argument count (part 2) */
-// doesn't (yet) work with zero arguments
-#define list_init_0()         list_init_aux(NULL, true, false) /*<! Call list_init_aux with NULL and true for parameters    */
-#define list_init_1(A)        list_init_aux(A, true, false)    /*<! Call list_init_aux with true for second parameter       */
-#define list_init_2(A, B)     list_init_aux(A, B, false)       /*<! Call list_init_aux with both user supplied parameters   */
-#define list_init_3(A, B, C)  list_init_aux(A, B, C)           /*<! Call list_init_aux with both user supplied parameters   */
+/*!
+ * \brief  How the items in a list are stored
+ */
+typedef enum
+{
+	LIST_LINKED, /*!< A linked list; items can be added and removed anywhere cheaply, but finding them means walking the list */
+	LIST_VECTOR, /*!< A contiguous array; getting an item by its index is constant time, as is finding it if the list is sorted */
+	LIST_HASHED  /*!< A contiguous array with a hash index; finding an item is also constant time */
+}
+list_type_e;
+
+#define LIST_INIT_COUNT(...) LIST_INIT_COUNT2(__VA_ARGS__, 5, 4, 3, 2, 1) /*!< Function overloading argument count (part 1) */
+#define LIST_INIT_COUNT2(_1, _2, _3, _4, _5, _, ...) _                    /*!< Function overloading argument count (part 2) */
+
+#define list_init_3(A, B, C)        list_init_aux(A, B, C, LIST_LINKED, NULL) /*<! Call list_init_aux for a linked list */
+#define list_init_4(A, B, C, D)     list_init_aux(A, B, C, D, NULL)           /*<! Call list_init_aux without a hash function */
+#define list_init_5(A, B, C, D, E)  list_init_aux(A, B, C, D, E)              /*<! Call list_init_aux with all user supplied parameters */
 #define list_init(...) CONCAT(list_init_, LIST_INIT_COUNT(__VA_ARGS__))(__VA_ARGS__) /*!< Decide how to call list_init */
-#endif
 
 /*!
  * \brief         Create a new linked list
@@ -94,6 +102,8 @@ typedef void * ITER;
  * \param[in]  c  A function to compare items within the list (can be NULL)
  * \param[in]  d  Whether to allow duplicates in the list
  * \param[in]  s  Whether items in the list should be sorted
+ * \param[in]  t  How the items should be stored (optional; LIST_LINKED by default)
+ * \param[in]  h  A function to hash items within the list (optional)
  * \return        A new linked list
  *
  * Create a new linked list instance; all further operations are then
@@ -102,8 +112,15 @@ typedef void * ITER;
  * item has been found or whether the item can be deleted. Use
  * list_default() if you are happy with no comparator and allowing
  * duplicates in your list.
+ *
+ * Items added to a sorted LIST_VECTOR or LIST_HASHED list are only put
+ * in order when next needed, so adding lots of items at once needs just
+ * one sort. A LIST_HASHED list needs a hash function that gives equal
+ * items (according to the comparator) the same hash; without one (and
+ * with a comparator) it is stored as a LIST_VECTOR instead. If the list
+ * allows duplicates, list_contains() might return any of the equal items.
  */
-extern LIST list_init(int c(const void *, const void *), bool d, bool s) __attribute__((malloc));
+extern LIST list_init_aux(int c(const void *, const void *), bool d, bool s, list_type_e t, size_t h(const void *)) __attribute__((malloc));
 
 #define LIST_DEINIT_ARGS_COUNT(...) LIST_DEINIT_ARGS_COUNT2(__VA_ARGS__, 2, 1) /*!< Function overloading argument count (part 1) */
 #define LIST_DEINIT_ARGS_COUNT2(_1, _2, _, ...) _                              /*!< Function overloading argument count (part 2) */
@@ -311,4 +328,8 @@ extern int list_compare_integer(const void *a, const void *b);
 
 extern int list_compare_decimal(const void *a, const void *b);
 
+extern size_t list_hash_string(const void *a);
+
+extern size_t list_hash_integer(const void *a);
+
 #endif
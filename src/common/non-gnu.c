@@ -184,6 +184,18 @@ extern char *strchrnul(const char *s, int c_in)
 	return NULL;
 }
 
+extern void explicit_bzero(void *s, size_t l)
+{
+	/*
+	 * writing through a volatile pointer stops the compiler from
+	 * dropping the writes because the memory is about to be freed
+	 */
+	volatile unsigned char *p = s;
+	while (l--)
+		*p++ = 0x00;
+	return;
+}
+
 #endif /* __APPLE__ || _WIN32 */
 
 
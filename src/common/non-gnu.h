@@ -22,11 +22,16 @@
 #define _NON_GNU_EXT_H_
 
 #if defined __APPLE__ || defined _WIN32
+	#include <stddef.h>
 	/*
 	 * Taken, once upon a time, from:
 	 * https://github.com/lattera/glibc/blob/master/string/strchrnul.c
 	 */
 	extern char *strchrnul(const char *string, int c);
+	/*
+	 * Like memset, but not one the compiler can decide isn’t needed
+	 */
+	extern void explicit_bzero(void *s, size_t l);
 #endif
 
 #if defined __APPLE__ || defined _WIN32 || defined __FreeBSD__ || defined __sun
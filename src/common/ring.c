@@ -0,0 +1,157 @@
+/*
+ * Common code for passing blocks of data between threads.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "non-gnu.h"
+#include "ring.h"
+#include "error.h"
+
+#define RING_SPIN 0x40 /*!< Number of times to yield before sleeping while waiting */
+#define RING_NAP  50   /*!< How long to sleep for at first (in microseconds) */
+#define RING_DOZE 5    /*!< How many times the nap can double in length (to 1.6ms) */
+
+typedef struct
+{
+	uint8_t *blocks;  /*!< The data; n blocks of s bytes */
+	size_t  *length;  /*!< Length of the data in each block */
+	size_t   count;   /*!< Number of blocks */
+	size_t   size;    /*!< Size of each block */
+	uint64_t head;    /*!< Total number of blocks pushed; only changed by the producer */
+	uint64_t tail;    /*!< Total number of blocks popped; only changed by the consumer */
+	bool     closed;  /*!< Whether either side has closed the ring */
+}
+ring_t;
+
+static void ring_wait(unsigned *);
+
+extern RING ring_init(size_t n, size_t s)
+{
+	ring_t *ring = calloc(1, sizeof( ring_t ));
+	if (!ring)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( ring_t ));
+	ring->count = n ? : 1;
+	ring->size = s;
+	if (!(ring->blocks = malloc(ring->count * ring->size)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, ring->count * ring->size);
+	if (!(ring->length = calloc(ring->count, sizeof( size_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, ring->count * sizeof( size_t ));
+	return (RING)ring;
+}
+
+extern void ring_deinit(RING ptr)
+{
+	ring_t *ring = (ring_t *)ptr;
+	/*
+	 * the blocks may well have been holding plaintext
+	 */
+	explicit_bzero(ring->blocks, ring->count * ring->size);
+	free(ring->blocks);
+	free(ring->length);
+	free(ring);
+	return;
+}
+
+extern size_t ring_block_size(RING ptr)
+{
+	return ((ring_t *)ptr)->size;
+}
+
+extern void *ring_claim(RING ptr)
+{
+	ring_t *ring = (ring_t *)ptr;
+	uint64_t head = ring->head;
+	for (unsigned w = 0; head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= ring->count; ring_wait(&w))
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE))
+			return NULL;
+	return ring->blocks + (head % ring->count) * ring->size;
+}
+
+extern void ring_push(RING ptr, size_t l)
+{
+	ring_t *ring = (ring_t *)ptr;
+	ring->length[ring->head % ring->count] = l;
+	/*
+	 * the length (and data) must be visible before the block is
+	 */
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+extern void *ring_peek(RING ptr, size_t *l)
+{
+	ring_t *ring = (ring_t *)ptr;
+	uint64_t tail = ring->tail;
+	for (unsigned w = 0; __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail; ring_wait(&w))
+		/*
+		 * check for more data once more after seeing the ring is
+		 * closed, in case the last block was pushed in between
+		 */
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+			return NULL;
+	*l = ring->length[tail % ring->count];
+	return ring->blocks + (tail % ring->count) * ring->size;
+}
+
+extern void ring_pop(RING ptr)
+{
+	ring_t *ring = (ring_t *)ptr;
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+	return;
+}
+
+extern void ring_close(RING ptr)
+{
+	ring_t *ring = (ring_t *)ptr;
+	__atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+	return;
+}
+
+extern bool ring_is_closed(RING ptr)
+{
+	ring_t *ring = (ring_t *)ptr;
+	return __atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE);
+}
+
+static void ring_wait(unsigned *w)
+{
+	/*
+	 * give the other thread a chance first, but don’t burn through CPU
+	 * time if it’s going to be a while (waiting on a slow disk, or for
+	 * the compression to catch up); sleep for longer each time as
+	 * there’s plenty of data queued in the ring to cover the delay
+	 */
+	if (++*w < RING_SPIN)
+		sched_yield();
+	else
+	{
+		unsigned n = *w - RING_SPIN < RING_DOZE ? *w - RING_SPIN : RING_DOZE;
+		struct timespec s = { 0, (RING_NAP << n) * THOUSAND };
+		nanosleep(&s, NULL);
+	}
+	return;
+}
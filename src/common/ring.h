@@ -0,0 +1,133 @@
+/*
+ * Common code for passing blocks of data between threads.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _COMMON_RING_H_
+#define _COMMON_RING_H_
+
+/*!
+ * \file    ring.h
+ * \author  albinoloverats ~ Software Development
+ * \date    2024
+ * \brief   Common ring buffer code shared between projects
+ *
+ * A bounded, lock-free ring buffer of fixed size blocks for passing
+ * data from exactly one producer thread to exactly one consumer thread.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "common.h"
+
+typedef void * RING; /*!< The user visible RING type */
+
+/*!
+ * \brief         Create a new ring buffer
+ * \param[in]  n  The number of blocks in the ring
+ * \param[in]  s  The size of each block
+ * \return        A new ring buffer
+ *
+ * Create a new ring buffer instance; all further operations are then
+ * performed against this handle. There must only ever be one thread
+ * putting data in to the ring and one taking data out of it.
+ */
+extern RING ring_init(size_t n, size_t s) __attribute__((malloc));
+
+/*!
+ * \brief         Destroy a ring buffer
+ * \param[in]  h  A ring buffer to destroy
+ *
+ * Destroy a ring buffer when it is no longer needed; neither thread
+ * should be using the ring at this point.
+ */
+extern void ring_deinit(RING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get the size of each block
+ * \param[in]  h  A ring buffer
+ * \return        The size of each block in the ring
+ *
+ * Get the maximum amount of data each block in the ring can hold.
+ */
+extern size_t ring_block_size(RING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get an empty block to fill
+ * \param[in]  h  A ring buffer
+ * \return        An empty block, or NULL if the ring has been closed
+ *
+ * For the producer: waits until there is an empty block in the ring
+ * and returns it. Once filled, the block is given to the consumer with
+ * ring_push().
+ */
+extern void *ring_claim(RING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Pass a filled block to the consumer
+ * \param[in]  h  A ring buffer
+ * \param[in]  l  The length of data in the block
+ *
+ * For the producer: hand the block last returned by ring_claim() over
+ * to the consumer.
+ */
+extern void ring_push(RING h, size_t l) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get the next filled block
+ * \param[in]  h  A ring buffer
+ * \param[out] l  The length of data in the block
+ * \return        The next block, or NULL if the ring is closed and empty
+ *
+ * For the consumer: waits until there is a filled block in the ring
+ * and returns it. The block remains valid until ring_pop() is called.
+ */
+extern void *ring_peek(RING h, size_t *l) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Give the current block back to the producer
+ * \param[in]  h  A ring buffer
+ *
+ * For the consumer: mark the block last returned by ring_peek() as
+ * empty so that it can be refilled.
+ */
+extern void ring_pop(RING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Close the ring
+ * \param[in]  h  A ring buffer
+ *
+ * Can be called by either thread. When closed by the producer it means
+ * there will be no more data; the consumer can still take any blocks
+ * which are already in the ring. When closed by the consumer, the
+ * producer is told (by ring_claim() returning NULL) that it should
+ * stop.
+ */
+extern void ring_close(RING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Check whether the ring is closed
+ * \param[in]  h  A ring buffer
+ * \return        Whether ring_close() has been called
+ *
+ * Returns true once either thread has closed the ring.
+ */
+extern bool ring_is_closed(RING h) __attribute__((nonnull(1)));
+
+#endif
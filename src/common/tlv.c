@@ -34,25 +34,68 @@
 #include "list.h"
 #include "error.h"
 
+#define TLV_HEADER (sizeof( uint8_t ) + sizeof( uint16_t )) /*!< Size of the tag and length before each value */
+#define TLV_ARENA  0x100                                     /*!< Initial size of the arena */
+
 /*
- * TODO this could be simplified to just a LIST
+ * the tags are kept exactly as they're exported, one after another in
+ * a single block of memory; the index (by tag) points into that
  */
 typedef struct
 {
-	LIST    tags;
-	byte_t *export;
+	byte_t  *arena;         /*!< The tags, lengths and values */
+	size_t   length;        /*!< Bytes used in the arena */
+	size_t   capacity;      /*!< Size of the arena; 0 if it belongs to someone else (imported) */
+	uint16_t count;         /*!< Number of tags */
+	uint8_t  order[0x100];  /*!< The tags in the order they were added */
+	bool     used[0x100];   /*!< Whether each tag is in use */
+	tlv_t    index[0x100];  /*!< Each tag, with its value in the arena */
+	byte_t  *export;        /*!< Exported copy, when lengths are in host byte order */
 }
 tlv_private_t;
 
-static int tlv_compare(const void *a, const void *b);
-static void tlv_free(void *tlv);
+typedef struct
+{
+	tlv_private_t *tlv;
+	uint16_t next;
+}
+tlv_iterator_t;
+
+static void tlv_reserve(tlv_private_t *, size_t);
 
 extern TLV tlv_init(void)
 {
 	tlv_private_t *t = calloc(sizeof( tlv_private_t ), sizeof( byte_t ));
 	if (!t)
 		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( tlv_private_t ));
-	t->tags = list_init(tlv_compare, false, false);
+	return t;
+}
+
+extern TLV tlv_import(const void *b, size_t l, uint16_t n)
+{
+	tlv_private_t *t = tlv_init();
+	t->arena = (byte_t *)b;
+	for (size_t off = 0; n && off + TLV_HEADER <= l; n--)
+	{
+		uint8_t tag = t->arena[off];
+		uint16_t length;
+		memcpy(&length, t->arena + off + sizeof tag, sizeof length);
+		length = ntohs(length);
+		if (off + TLV_HEADER + length > l)
+			break;
+		/*
+		 * like tlv_append(), only the first of any duplicate tags is
+		 * used
+		 */
+		if (!t->used[tag])
+		{
+			t->used[tag] = true;
+			t->index[tag] = (tlv_t){ tag, length, t->arena + off + TLV_HEADER };
+			t->order[t->count++] = tag;
+		}
+		off += TLV_HEADER + length;
+		t->length = off;
+	}
 	return t;
 }
 
@@ -63,7 +106,8 @@ extern void tlv_deinit(TLV ptr)
 		return;
 	if (tlv_ptr->export)
 		free(tlv_ptr->export);
-	list_deinit(tlv_ptr->tags, tlv_free);
+	if (tlv_ptr->capacity)
+		free(tlv_ptr->arena);
 	free(tlv_ptr);
 	return;
 }
@@ -73,34 +117,56 @@ extern bool tlv_append(TLV ptr, tlv_t tlv)
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return false;
-	tlv_t *t  = malloc(sizeof tlv);
-	if (!t)
-		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof tlv );
-	t->tag    = tlv.tag;
-	t->length = tlv.length;
-	if (!(t->value  = malloc(t->length)))
-		die(_("Out of memory @ %s:%d:%s [%du]"), __FILE__, __LINE__, __func__, t->length);
-	memcpy(t->value, tlv.value, t->length);
-	bool r = list_append(tlv_ptr->tags, t);
-	if (!r)
-	{
-		free(t->value);
-		free(t);
-	}
-	return r;
+	if (tlv_ptr->used[tlv.tag])
+		return false;
+	tlv_reserve(tlv_ptr, TLV_HEADER + tlv.length);
+	byte_t *b = tlv_ptr->arena + tlv_ptr->length;
+	uint16_t l = htons(tlv.length);
+	b[0] = tlv.tag;
+	memcpy(b + sizeof tlv.tag, &l, sizeof l);
+	if (tlv.length)
+		memcpy(b + TLV_HEADER, tlv.value, tlv.length);
+	tlv_ptr->length += TLV_HEADER + tlv.length;
+	tlv_ptr->used[tlv.tag] = true;
+	tlv_ptr->index[tlv.tag] = (tlv_t){ tlv.tag, tlv.length, b + TLV_HEADER };
+	tlv_ptr->order[tlv_ptr->count++] = tlv.tag;
+	return true;
 }
 
 extern const tlv_t *tlv_remove(TLV ptr, tlv_t tlv)
 {
-	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
-	if (!tlv_ptr)
-		return NULL;
-	return list_remove_item(tlv_ptr->tags, &tlv);
+	return tlv_remove_tag(ptr, tlv.tag);
 }
 
 extern const tlv_t *tlv_remove_tag(TLV ptr, uint8_t tag)
 {
-	return tlv_remove(ptr, (tlv_t){ tag, 0, NULL });
+	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
+	if (!tlv_ptr)
+		return NULL;
+	if (!tlv_ptr->used[tag])
+		return NULL;
+	tlv_reserve(tlv_ptr, 0);
+	/*
+	 * close the gap, moving everything after it along
+	 */
+	tlv_t *t = &tlv_ptr->index[tag];
+	byte_t *b = (byte_t *)t->value - TLV_HEADER;
+	size_t z = TLV_HEADER + t->length;
+	memmove(b, b + z, tlv_ptr->length - (b - tlv_ptr->arena) - z);
+	tlv_ptr->length -= z;
+	uint16_t j = 0;
+	for (uint16_t i = 0; i < tlv_ptr->count; i++)
+		if (tlv_ptr->order[i] != tag)
+		{
+			tlv_t *x = &tlv_ptr->index[tlv_ptr->order[i]];
+			if ((byte_t *)x->value > b)
+				x->value = (byte_t *)x->value - z;
+			tlv_ptr->order[j++] = tlv_ptr->order[i];
+		}
+	tlv_ptr->count = j;
+	tlv_ptr->used[tag] = false;
+	t->value = NULL;
+	return t;
 }
 
 extern const tlv_t *tlv_get(TLV ptr, uint8_t tag)
@@ -108,7 +174,7 @@ extern const tlv_t *tlv_get(TLV ptr, uint8_t tag)
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return NULL;
-	return list_contains(tlv_ptr->tags, &((tlv_t){ tag, 0, NULL }));
+	return tlv_ptr->used[tag] ? &tlv_ptr->index[tag] : NULL;
 }
 
 extern bool tlv_has_tag(TLV ptr, uint8_t tag)
@@ -118,18 +184,12 @@ extern bool tlv_has_tag(TLV ptr, uint8_t tag)
 
 extern byte_t *tlv_value_of_aux(TLV ptr, uint8_t tag, uint8_t *def)
 {
-	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
-	if (!tlv_ptr)
-		return NULL;
 	const tlv_t *t = tlv_get(ptr, tag);
 	return t ? t->value : def;
 }
 
 extern uint16_t tlv_length_of(TLV ptr, uint8_t tag)
 {
-	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
-	if (!tlv_ptr)
-		return 0;
 	const tlv_t *t = tlv_get(ptr, tag);
 	return t ? t->length : 0;
 }
@@ -139,30 +199,28 @@ extern byte_t *tlv_export_aux(TLV ptr, bool nbo)
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return NULL;
-	size_t size = tlv_length(tlv_ptr);
+	/*
+	 * the arena is already in (network byte order) export format
+	 */
+	if (nbo)
+		return tlv_ptr->arena;
 	if (tlv_ptr->export)
 		free(tlv_ptr->export);
-	if (!(tlv_ptr->export = malloc(size)))
-		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, size);
-	size_t off = 0;
-	ITER iter = list_iterator(tlv_ptr->tags);
-	while (list_has_next(iter))
+	if (!(tlv_ptr->export = malloc(tlv_ptr->length)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, tlv_ptr->length);
+	memcpy(tlv_ptr->export, tlv_ptr->arena, tlv_ptr->length);
+	for (uint16_t i = 0; i < tlv_ptr->count; i++)
 	{
-		const tlv_t *tlv = list_get_next(iter);
-		memcpy(tlv_ptr->export + off, &tlv->tag, sizeof tlv->tag);
-		off += sizeof tlv->tag;
-		uint16_t l = nbo ? htons(tlv->length) : tlv->length;
-		memcpy(tlv_ptr->export + off, &l, sizeof tlv->length);
-		off += sizeof tlv->length;
-		memcpy(tlv_ptr->export + off, tlv->value, tlv->length);
-		off += tlv->length;
+		const tlv_t *t = &tlv_ptr->index[tlv_ptr->order[i]];
+		size_t off = (byte_t *)t->value - tlv_ptr->arena;
+		memcpy(tlv_ptr->export + off - sizeof t->length, &t->length, sizeof t->length);
 	}
 	return tlv_ptr->export;
 }
 
 extern uint16_t tlv_size(TLV ptr)
 {
-	return list_size(((tlv_private_t *)ptr)->tags);
+	return ((tlv_private_t *)ptr)->count;
 }
 
 extern size_t tlv_length(TLV ptr)
@@ -170,11 +228,7 @@ extern size_t tlv_length(TLV ptr)
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return 0;
-	size_t size = 0;
-	ITER iter = list_iterator(tlv_ptr->tags);
-	while (list_has_next(iter))
-		size += sizeof( uint8_t ) + sizeof( uint16_t ) + ((tlv_t *)list_get_next(iter))->length;
-	return size;
+	return tlv_ptr->length;
 }
 
 extern ITER tlv_iterator(TLV ptr)
@@ -182,17 +236,26 @@ extern ITER tlv_iterator(TLV ptr)
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return NULL;
-	return list_iterator(tlv_ptr->tags);
+	tlv_iterator_t *iter = malloc(sizeof( tlv_iterator_t ));
+	if (!iter)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( tlv_iterator_t ));
+	iter->tlv = tlv_ptr;
+	iter->next = 0;
+	return iter;
 }
 
 extern const tlv_t *tlv_get_next(ITER ptr)
 {
-	return list_get_next(ptr);
+	tlv_iterator_t *iter = (tlv_iterator_t *)ptr;
+	if (!iter || iter->next >= iter->tlv->count)
+		return NULL;
+	return &iter->tlv->index[iter->tlv->order[iter->next++]];
 }
 
 extern bool tlv_has_next(ITER ptr)
 {
-	return list_has_next(ptr);
+	tlv_iterator_t *iter = (tlv_iterator_t *)ptr;
+	return iter && iter->next < iter->tlv->count;
 }
 
 extern void tlv_for_each(TLV ptr, void f(uint8_t , uint16_t, const void *))
@@ -200,33 +263,37 @@ extern void tlv_for_each(TLV ptr, void f(uint8_t , uint16_t, const void *))
 	tlv_private_t *tlv_ptr = (tlv_private_t *)ptr;
 	if (!tlv_ptr)
 		return;
-	if (!list_size(tlv_ptr->tags))
-		return;
-	ITER iter = list_iterator(tlv_ptr->tags);
-	do
+	for (uint16_t i = 0; i < tlv_ptr->count; i++)
 	{
-		const tlv_t *entry = (tlv_t *)list_get_next(iter);
+		const tlv_t *entry = &tlv_ptr->index[tlv_ptr->order[i]];
 		f(entry->tag, entry->length, entry->value);
 	}
-	while (list_has_next(iter));
-	free(iter);
 	return;
 }
 
-static int tlv_compare(const void *a, const void *b)
+static void tlv_reserve(tlv_private_t *tlv_ptr, size_t l)
 {
-	const tlv_t *x = a;
-	const tlv_t *y = b;
+	if (tlv_ptr->capacity && tlv_ptr->length + l <= tlv_ptr->capacity)
+		return;
 	/*
-	 * cast to int allows us to overlook that tags are uint8_t's and
-	 * get a negative result if applicable
+	 * an imported arena can’t be changed, so take a copy of it first
 	 */
-	return (int)x->tag - (int)y->tag;
-}
-
-static void tlv_free(void *tlv)
-{
-	free(((tlv_t *)tlv)->value);
-	free(tlv);
+	size_t z = tlv_ptr->capacity ? : TLV_ARENA;
+	while (z < tlv_ptr->length + l)
+		z *= 2;
+	byte_t *x = malloc(z);
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+	if (tlv_ptr->length)
+		memcpy(x, tlv_ptr->arena, tlv_ptr->length);
+	for (uint16_t i = 0; i < tlv_ptr->count; i++)
+	{
+		tlv_t *t = &tlv_ptr->index[tlv_ptr->order[i]];
+		t->value = x + ((byte_t *)t->value - tlv_ptr->arena);
+	}
+	if (tlv_ptr->capacity)
+		free(tlv_ptr->arena);
+	tlv_ptr->arena = x;
+	tlv_ptr->capacity = z;
 	return;
 }
@@ -28,7 +28,8 @@
  * \brief   Common TLV code shared between projects
  *
  * Common tag/length/value code, for creating, importing and exporting
- * TLV values.
+ * TLV values. The tags are kept in a single block of memory, exactly as
+ * they're exported, with an index by tag value.
  */
 
 #include <stdint.h> /*!< Necessary include as c99 standard integer types are referenced in this header */
@@ -61,6 +62,21 @@ tlv_t;
  */
 extern TLV tlv_init(void) __attribute__((malloc));
 
+/*!
+ * \brief         Create a TLV array from exported TLV data
+ * \param[in]  b  The exported TLV data
+ * \param[in]  l  The length of the data
+ * \param[in]  n  The number of TLV triples in the data
+ * \return        A new TLV array
+ *
+ * Create a new TLV array instance using the given data directly; the
+ * values aren't copied, so the data must remain valid (and unchanged)
+ * until the TLV array is destroyed. Only if the array is changed is a
+ * copy of the data taken. Parsing stops at the first triple that would
+ * overrun the data.
+ */
+extern TLV tlv_import(const void *b, size_t l, uint16_t n) __attribute__((malloc, nonnull(1)));
+
 /*!
  * \brief         Destroy a TLV array
  * \param[in]  h  A pointer to a TLV array to destroy
@@ -79,9 +95,9 @@ extern void tlv_deinit(TLV h) __attribute__((nonnull(1)));
  * \reutrn        True if the value was added
  *
  * Add a new TLV triple to the end of an existing TLV array. It takes a
- * copy of t (including the value pointer) so remember to free that
- * yourself. Duplicate tags are ignored. Will return true if the item
- * was added, false if it was a duplicate and ignored.
+ * copy of the value, so remember to free that yourself. Duplicate tags
+ * are ignored. Will return true if the item was added, false if it was
+ * a duplicate and ignored.
  */
 extern bool tlv_append(TLV h, tlv_t t) __attribute__((nonnull(1)));
 
@@ -90,7 +106,8 @@ extern bool tlv_append(TLV h, tlv_t t) __attribute__((nonnull(1)));
  * \param[in]  h  A pointer to the TLV
  * \param[in]  t  The TLV triple to remove
  *
- * Remove the given TLV triple from the TLV array.
+ * Remove the given TLV triple from the TLV array. The value of the
+ * returned triple is no longer available.
  */
 extern const tlv_t *tlv_remove(TLV h, tlv_t t) __attribute__((nonnull(1)));
 
@@ -99,7 +116,8 @@ extern const tlv_t *tlv_remove(TLV h, tlv_t t) __attribute__((nonnull(1)));
  * \param[in]  h  A pointer to the TLV
  * \param[in]  t  The tag to remove
  *
- * Remove the given tag from the TLV array.
+ * Remove the given tag from the TLV array. The value of the returned
+ * triple is no longer available.
  */
 extern const tlv_t * tlv_remove_tag(TLV h, uint8_t t) __attribute__((nonnull(1)));
 
@@ -109,8 +127,8 @@ extern const tlv_t * tlv_remove_tag(TLV h, uint8_t t) __attribute__((nonnull(1))
  * \param[in]  t  The tag value to look for
  * \return        The individual TLV structure
  *
- * Return the TLV structure for the given tag value. NB Do not free the
- * returned TLV pointer: bad things will happen.
+ * Return the TLV structure for the given tag value, in constant time.
+ * NB Do not free the returned TLV pointer: bad things will happen.
  */
 extern const tlv_t *tlv_get(TLV h, uint8_t t) __attribute__((nonnull(1)));
 
@@ -168,7 +186,8 @@ extern uint16_t tlv_length_of(TLV ptr, uint8_t t) __attribute__((nonnull(1)));
  *
  * Export the TLV array as an unsigned byte array. The optional boolean
  * (defaults to true) specifies wherther to use network byte order for
- * the length value.
+ * the length value; if it does, no copy is made. The array remains
+ * valid until the TLV is changed or destroyed.
  */
 extern byte_t *tlv_export_aux(TLV h, bool e) __attribute__((nonnull(1)));
 
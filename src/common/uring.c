@@ -0,0 +1,367 @@
+/*
+ * Common code for asynchronous writing of files.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined __linux__ && defined __has_include
+	#if __has_include(<linux/io_uring.h>)
+		#define HAVE_URING
+	#endif
+#endif
+
+#ifdef HAVE_URING
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <sys/syscall.h>
+	#include <sys/uio.h>
+	#include <linux/io_uring.h>
+#endif
+
+#include "common.h"
+#include "non-gnu.h"
+#include "uring.h"
+#include "error.h"
+
+#ifdef HAVE_URING
+
+#define URING_FSYNC UINT64_MAX /*!< Marks the completion of an fsync (rather than a write) */
+
+typedef struct
+{
+	int ring;                    /*!< The io_uring instance */
+	int file;                    /*!< The file being written */
+	uint8_t *sq;                 /*!< Submission queue */
+	size_t sq_size;
+	uint8_t *cq;                 /*!< Completion queue */
+	size_t cq_size;
+	struct io_uring_sqe *sqes;   /*!< Submission queue entries */
+	size_t sqes_size;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_array;
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	uint8_t *blocks;             /*!< The data; n blocks of s bytes */
+	struct iovec *vector;        /*!< Where each block is, and the length of data in it */
+	uint64_t *position;          /*!< Where in the file each block is being written to */
+	bool *busy;                  /*!< Whether each block is waiting to be written */
+	size_t count;                /*!< Number of blocks */
+	size_t size;                 /*!< Size of each block */
+	size_t current;              /*!< The block currently being filled */
+	size_t fill;                 /*!< Length of data in the current block */
+	uint64_t offset;             /*!< Where in the file the next block will go */
+	unsigned pending;            /*!< Number of requests in flight */
+	int error;                   /*!< The value of errno if a write failed */
+	uint64_t syscalls;           /*!< Number of system calls made */
+}
+uring_t;
+
+static void uring_unmap(uring_t *);
+static bool uring_submit(uring_t *, uint8_t, uint64_t);
+static void uring_reap(uring_t *, unsigned);
+static void uring_complete(uring_t *, uint64_t, int32_t);
+static bool uring_flush(uring_t *);
+
+extern URING uring_init(int f, size_t n, size_t s)
+{
+	/*
+	 * each write says where in the file it goes, so they can complete
+	 * in any order; that only works for a regular file, which isn’t
+	 * going to move everything to the end anyway
+	 */
+	struct stat st;
+	if (fstat(f, &st) || !S_ISREG(st.st_mode) || fcntl(f, F_GETFL) & O_APPEND)
+		return NULL;
+	off_t o = lseek(f, 0, SEEK_CUR);
+	if (o < 0)
+		return NULL;
+	struct io_uring_params p;
+	memset(&p, 0x00, sizeof p);
+	int r = syscall(__NR_io_uring_setup, n ? : 1, &p);
+	if (r < 0)
+		return NULL; /* too old, or not allowed */
+
+	uring_t *u = calloc(1, sizeof( uring_t ));
+	if (!u)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( uring_t ));
+	u->ring = r;
+	u->file = f;
+	u->offset = o;
+	u->sq_size = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	u->sqes_size = p.sq_entries * sizeof( struct io_uring_sqe );
+	u->sq = mmap(NULL, u->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r, IORING_OFF_SQ_RING);
+	u->cq = mmap(NULL, u->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r, IORING_OFF_CQ_RING);
+	u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r, IORING_OFF_SQES);
+	if (u->sq == MAP_FAILED || u->cq == MAP_FAILED || u->sqes == MAP_FAILED)
+	{
+		uring_unmap(u);
+		close(r);
+		free(u);
+		return NULL;
+	}
+	u->sq_tail  = (unsigned *)(u->sq + p.sq_off.tail);
+	u->sq_mask  = (unsigned *)(u->sq + p.sq_off.ring_mask);
+	u->sq_array = (unsigned *)(u->sq + p.sq_off.array);
+	u->cq_head  = (unsigned *)(u->cq + p.cq_off.head);
+	u->cq_tail  = (unsigned *)(u->cq + p.cq_off.tail);
+	u->cq_mask  = (unsigned *)(u->cq + p.cq_off.ring_mask);
+	u->cqes     = (struct io_uring_cqe *)(u->cq + p.cq_off.cqes);
+
+	/*
+	 * there can never be more writes in flight than there are entries
+	 * in the submission queue
+	 */
+	u->count = n < p.sq_entries ? (n ? : 1) : p.sq_entries;
+	u->size = s;
+	if (!(u->blocks = malloc(u->count * u->size)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, u->count * u->size);
+	if (!(u->vector = calloc(u->count, sizeof( struct iovec ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, u->count * sizeof( struct iovec ));
+	if (!(u->position = calloc(u->count, sizeof( uint64_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, u->count * sizeof( uint64_t ));
+	if (!(u->busy = calloc(u->count, sizeof( bool ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, u->count * sizeof( bool ));
+	return (URING)u;
+}
+
+extern void uring_deinit(URING ptr)
+{
+	uring_t *u = (uring_t *)ptr;
+	uring_sync(u, false);
+	/*
+	 * leave the file as it would have been had it been written to
+	 * directly
+	 */
+	lseek(u->file, u->offset, SEEK_SET);
+	uring_unmap(u);
+	close(u->ring);
+	/*
+	 * the blocks may well have been holding plaintext
+	 */
+	explicit_bzero(u->blocks, u->count * u->size);
+	free(u->blocks);
+	free(u->vector);
+	free(u->position);
+	free(u->busy);
+	free(u);
+	return;
+}
+
+extern ssize_t uring_write(URING ptr, const void *d, size_t l)
+{
+	uring_t *u = (uring_t *)ptr;
+	for (size_t i = 0; i < l; )
+	{
+		/*
+		 * wait for the next block to have been written, if it’s still
+		 * in flight
+		 */
+		while (u->busy[u->current] && !u->error)
+			uring_reap(u, 1);
+		if (u->error)
+			return errno = u->error , -1;
+		size_t n = l - i < u->size - u->fill ? l - i : u->size - u->fill;
+		memcpy(u->blocks + u->current * u->size + u->fill, (const uint8_t *)d + i, n);
+		i += n;
+		if ((u->fill += n) == u->size && !uring_flush(u))
+			return errno = u->error , -1;
+	}
+	/*
+	 * pick up anything that’s finished without waiting
+	 */
+	uring_reap(u, 0);
+	return l;
+}
+
+extern int uring_sync(URING ptr, bool y)
+{
+	uring_t *u = (uring_t *)ptr;
+	if (!u->error && u->fill)
+		uring_flush(u);
+	while (u->pending && !u->error)
+		uring_reap(u, u->pending);
+	if (y && !u->error && uring_submit(u, IORING_OP_FSYNC, URING_FSYNC))
+		while (u->pending && !u->error)
+			uring_reap(u, u->pending);
+	return u->error ? (errno = u->error , -1) : 0;
+}
+
+extern uint64_t uring_syscalls(URING ptr)
+{
+	return ((uring_t *)ptr)->syscalls;
+}
+
+static void uring_unmap(uring_t *u)
+{
+	if (u->sq && u->sq != MAP_FAILED)
+		munmap(u->sq, u->sq_size);
+	if (u->cq && u->cq != MAP_FAILED)
+		munmap(u->cq, u->cq_size);
+	if (u->sqes && (void *)u->sqes != MAP_FAILED)
+		munmap(u->sqes, u->sqes_size);
+	return;
+}
+
+static bool uring_flush(uring_t *u)
+{
+	size_t b = u->current;
+	u->vector[b].iov_base = u->blocks + b * u->size;
+	u->vector[b].iov_len = u->fill;
+	u->position[b] = u->offset;
+	u->offset += u->fill;
+	u->busy[b] = true;
+	u->current = (b + 1) % u->count;
+	u->fill = 0;
+	return uring_submit(u, IORING_OP_WRITEV, b);
+}
+
+static bool uring_submit(uring_t *u, uint8_t op, uint64_t b)
+{
+	unsigned tail = *u->sq_tail;
+	unsigned i = tail & *u->sq_mask;
+	struct io_uring_sqe *e = &u->sqes[i];
+	memset(e, 0x00, sizeof *e);
+	e->opcode = op;
+	e->fd = u->file;
+	if (b != URING_FSYNC)
+	{
+		e->addr = (uintptr_t)&u->vector[b];
+		e->len = 1;
+		e->off = u->position[b];
+	}
+	e->user_data = b;
+	u->sq_array[i] = i;
+	/*
+	 * the entry must be visible before the kernel sees the new tail
+	 */
+	__atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	u->pending++;
+	while (u->syscalls++ , syscall(__NR_io_uring_enter, u->ring, 1, 0, 0, NULL, 0) < 0)
+	{
+		if (errno == EINTR)
+			continue;
+		else if ((errno == EAGAIN || errno == EBUSY) && u->pending > 1)
+			uring_reap(u, 1); /* make room for it */
+		else
+			return u->error = errno , false;
+	}
+	return true;
+}
+
+static void uring_reap(uring_t *u, unsigned w)
+{
+	while (true)
+	{
+		unsigned head = *u->cq_head;
+		unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+		for (; head != tail; head++, w -= w ? 1 : 0)
+		{
+			struct io_uring_cqe *e = &u->cqes[head & *u->cq_mask];
+			uring_complete(u, e->user_data, e->res);
+		}
+		__atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+		if (!w || !u->pending)
+			return;
+		u->syscalls++;
+		if (syscall(__NR_io_uring_enter, u->ring, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+		{
+			u->error = errno;
+			return;
+		}
+	}
+}
+
+static void uring_complete(uring_t *u, uint64_t b, int32_t r)
+{
+	u->pending--;
+	if (r < 0)
+		u->error = u->error ? : -r;
+	if (b == URING_FSYNC)
+		return;
+	if (r >= 0 && (size_t)r < u->vector[b].iov_len)
+	{
+		/*
+		 * finish off a short write the old fashioned way
+		 */
+		const uint8_t *d = u->vector[b].iov_base;
+		for (size_t w = r; w < u->vector[b].iov_len && !u->error; u->syscalls++)
+		{
+			ssize_t e = pwrite(u->file, d + w, u->vector[b].iov_len - w, u->position[b] + w);
+			if (e < 0 && errno == EINTR)
+				continue;
+			else if (e <= 0)
+				u->error = e < 0 ? errno : EIO;
+			else
+				w += e;
+		}
+	}
+	u->busy[b] = false;
+	return;
+}
+
+#else
+
+extern URING uring_init(int f, size_t n, size_t s)
+{
+	(void)f;
+	(void)n;
+	(void)s;
+	return NULL;
+}
+
+extern void uring_deinit(URING ptr)
+{
+	(void)ptr;
+	return;
+}
+
+extern ssize_t uring_write(URING ptr, const void *d, size_t l)
+{
+	(void)ptr;
+	(void)d;
+	(void)l;
+	return errno = ENOTSUP , -1;
+}
+
+extern int uring_sync(URING ptr, bool y)
+{
+	(void)ptr;
+	(void)y;
+	return errno = ENOTSUP , -1;
+}
+
+extern uint64_t uring_syscalls(URING ptr)
+{
+	(void)ptr;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Common code for asynchronous writing of files.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _COMMON_URING_H_
+#define _COMMON_URING_H_
+
+/*!
+ * \file    uring.h
+ * \author  albinoloverats ~ Software Development
+ * \date    2024
+ * \brief   Common asynchronous write code shared between projects
+ *
+ * Writes to a regular file using io_uring (on Linux), so that several
+ * writes can be in flight at once without the caller ever waiting on
+ * the device. Data is collected into large blocks, each of which is
+ * written as a single request.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "common.h"
+
+typedef void * URING; /*!< The user visible URING type */
+
+/*!
+ * \brief         Start writing a file asynchronously
+ * \param[in]  f  The file descriptor to write to
+ * \param[in]  n  The number of writes which can be in flight at once
+ * \param[in]  s  The size of each write
+ * \return        A new instance, or NULL if it’s not possible
+ *
+ * Writing continues from the current position of the file. Returns
+ * NULL if io_uring isn’t available (or not permitted) or the file isn’t
+ * a regular file; the file should then be written to as normal.
+ */
+extern URING uring_init(int f, size_t n, size_t s);
+
+/*!
+ * \brief         Finish writing a file asynchronously
+ * \param[in]  h  The instance to finish with
+ *
+ * Waits for any writes still in flight, then leaves the file position
+ * at the end of the data that was written.
+ */
+extern void uring_deinit(URING h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Write data to the file
+ * \param[in]  h  An instance
+ * \param[in]  d  The data to write
+ * \param[in]  l  The length of the data
+ * \return        The length of the data, or -1 on error
+ *
+ * The data is copied, so the buffer can be reused as soon as this
+ * returns; only when a block is full is it written out. An error from
+ * an earlier write (which has since completed) is reported here.
+ */
+extern ssize_t uring_write(URING h, const void *d, size_t l) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Write everything out
+ * \param[in]  h  An instance
+ * \param[in]  y  Whether to also sync the file to disk
+ * \return        0 on success, -1 on error
+ *
+ * Writes whatever is left in the current block and waits for all the
+ * writes to complete; optionally followed by an fsync().
+ */
+extern int uring_sync(URING h, bool y) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Count the system calls made
+ * \param[in]  h  An instance
+ * \return        The number of system calls made so far
+ *
+ * Writes are submitted in batches (and may complete in any order), so
+ * the number of system calls can be far fewer than the number of writes.
+ */
+extern uint64_t uring_syscalls(URING h) __attribute__((nonnull(1)));
+
+#endif
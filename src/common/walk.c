@@ -0,0 +1,468 @@
+/*
+ * Common code for walking directory trees.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "common.h"
+#include "non-gnu.h"
+#include "walk.h"
+#include "dir.h"
+#include "error.h"
+
+#define WALK_THREADS 0x10  /*!< Most threads worth having waiting on the file system at once */
+#define WALK_STACK   0x40  /*!< Initial number of directories that can be waiting to be scanned */
+#define WALK_PATH    0x100 /*!< Initial space for paths */
+
+typedef struct node_t
+{
+	struct node_t *parent; /*!< The directory this entry is in */
+	struct node_t *child;  /*!< The first entry in this directory */
+	struct node_t *next;   /*!< The next entry in the same directory */
+	int fd;                /*!< This directory, while there are still directories in it to open */
+	unsigned users;        /*!< How many scans still need the directory to be open */
+	walk_type_e type;      /*!< What the entry is */
+	dev_t dev;             /*!< The device the entry is on */
+	ino_t inode;           /*!< The inode of the entry */
+	nlink_t links;         /*!< Number of hard links to the entry */
+	off_t size;            /*!< Size of the entry */
+	size_t length;         /*!< Length of the name */
+	char name[];           /*!< Name of the entry */
+}
+node_t;
+
+typedef struct
+{
+	node_t *root;           /*!< The top directory */
+	bool follow;            /*!< Whether to follow symlinks */
+	size_t count;           /*!< Number of entries found */
+	node_t **stack;         /*!< Directories waiting to be scanned */
+	size_t waiting;         /*!< Number of directories waiting */
+	size_t size;            /*!< Number of directories there’s space for */
+	size_t busy;            /*!< Number of directories being scanned */
+	pthread_mutex_t mutex;  /*!< Lock on the above */
+	pthread_cond_t cond;    /*!< Signalled when a directory is added or the scan is complete */
+	node_t *current;        /*!< The last entry given out */
+	bool finished;          /*!< Whether all entries have been given out */
+	char *path;             /*!< Path of the current entry */
+	size_t path_top;        /*!< Length of the path of the top directory */
+	size_t path_length;     /*!< Length of the path */
+	size_t path_size;       /*!< Space allocated for the path */
+	walk_entry_t entry;     /*!< The current entry */
+}
+walk_t;
+
+static void *walk_worker(void *);
+static size_t walk_scan(walk_t *, node_t *);
+static node_t *walk_node(node_t *, const char *);
+static void walk_release(node_t *);
+static void walk_path(walk_t *, size_t);
+
+extern WALK walk_init(const char *p, bool f, size_t t)
+{
+	walk_t *walk = calloc(1, sizeof( walk_t ));
+	if (!walk)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( walk_t ));
+	walk->follow = f;
+	/*
+	 * entries are named relative to the directory the top directory
+	 * is in; the top directory itself is still found using the full
+	 * path given
+	 */
+	size_t l = strlen(p);
+	while (l > 1 && p[l - 1] == DIR_SEPARATOR_CHAR)
+		l--;
+	const char *n = p + l;
+	while (n > p && *(n - 1) != DIR_SEPARATOR_CHAR)
+		n--;
+	node_t *root = walk_node(NULL, p);
+	root->type = WALK_DIRECTORY;
+	walk->root = root;
+	walk_path(walk, (p + l) - n);
+	memcpy(walk->path, n, (p + l) - n);
+	walk->path[walk->path_length = (p + l) - n] = '\0';
+	walk->path_top = walk->path_length;
+
+	if (!(walk->stack = malloc(WALK_STACK * sizeof( node_t * ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, WALK_STACK * sizeof( node_t * ));
+	walk->size = WALK_STACK;
+	walk->stack[walk->waiting++] = root;
+	pthread_mutex_init(&walk->mutex, NULL);
+	pthread_cond_init(&walk->cond, NULL);
+	/*
+	 * most of the time is spent waiting for the file system, so the
+	 * more directories being scanned at once the better (up to a
+	 * point); this thread does its share of the work too
+	 */
+	if (!t)
+		t = sysconf(_SC_NPROCESSORS_ONLN);
+	if (t > WALK_THREADS)
+		t = WALK_THREADS;
+	pthread_t *threads = NULL;
+	size_t s = 0;
+	if (t > 1 && (threads = calloc(t - 1, sizeof( pthread_t ))))
+		for (; s < t - 1 && !pthread_create(&threads[s], NULL, walk_worker, walk); s++)
+			;
+	walk_worker(walk);
+	for (size_t i = 0; i < s; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	free(walk->stack);
+	walk->stack = NULL;
+	return (WALK)walk;
+}
+
+extern void walk_deinit(WALK ptr)
+{
+	walk_t *walk = (walk_t *)ptr;
+	/*
+	 * free entries on the way back up, so that nothing is needed once
+	 * it’s been freed
+	 */
+	for (node_t *n = walk->root; n; )
+	{
+		node_t *x = n->child;
+		if (x)
+			n->child = NULL;
+		else
+		{
+			x = n->next ? : n->parent;
+			free(n);
+		}
+		n = x;
+	}
+	free(walk->path);
+	pthread_cond_destroy(&walk->cond);
+	pthread_mutex_destroy(&walk->mutex);
+	free(walk);
+	return;
+}
+
+extern size_t walk_count(WALK ptr)
+{
+	return ((walk_t *)ptr)->count;
+}
+
+extern const walk_entry_t *walk_next(WALK ptr)
+{
+	walk_t *walk = (walk_t *)ptr;
+	if (walk->finished)
+		return NULL;
+	node_t *n = walk->current ? : walk->root;
+	if (n->child)
+		n = n->child;
+	else
+	{
+		/*
+		 * go back up until there’s another entry in the same directory
+		 */
+		for (; n != walk->root && !n->next; n = n->parent)
+			walk->path_length -= n->length + 1;
+		if (n == walk->root)
+		{
+			walk->finished = true;
+			walk->path[walk->path_length] = '\0';
+			return NULL;
+		}
+		walk->path_length -= n->length + 1;
+		n = n->next;
+	}
+	walk_path(walk, walk->path_length + 1 + n->length);
+	walk->path[walk->path_length++] = DIR_SEPARATOR_CHAR;
+	memcpy(walk->path + walk->path_length, n->name, n->length + 1);
+	walk->path_length += n->length;
+	walk->current = n;
+
+	walk->entry.path  = walk->path;
+	walk->entry.type  = n->type;
+	walk->entry.dev   = n->dev;
+	walk->entry.inode = n->inode;
+	walk->entry.links = n->links;
+	walk->entry.size  = n->size;
+	return &walk->entry;
+}
+
+extern void walk_rewind(WALK ptr)
+{
+	walk_t *walk = (walk_t *)ptr;
+	walk->current = NULL;
+	walk->finished = false;
+	walk->path[walk->path_length = walk->path_top] = '\0';
+	return;
+}
+
+static void *walk_worker(void *ptr)
+{
+	walk_t *walk = (walk_t *)ptr;
+	pthread_mutex_lock(&walk->mutex);
+	while (true)
+	{
+		while (!walk->waiting && walk->busy)
+			pthread_cond_wait(&walk->cond, &walk->mutex);
+		/*
+		 * nothing left to scan, and nothing being scanned which might
+		 * find more: the whole tree has been found
+		 */
+		if (!walk->waiting)
+			break;
+		node_t *n = walk->stack[--walk->waiting];
+		walk->busy++;
+		pthread_mutex_unlock(&walk->mutex);
+
+		size_t e = walk_scan(walk, n);
+
+		pthread_mutex_lock(&walk->mutex);
+		walk->count += e;
+		if (!--walk->busy && !walk->waiting)
+			pthread_cond_broadcast(&walk->cond);
+	}
+	pthread_mutex_unlock(&walk->mutex);
+	return NULL;
+}
+
+static size_t walk_scan(walk_t *walk, node_t *n)
+{
+	n->fd = -1;
+#ifndef _WIN32
+	/*
+	 * open each directory relative to the one it’s in, so that the
+	 * path doesn’t need to be looked up (again) each time
+	 */
+	if (n->parent)
+	{
+		n->fd = openat(n->parent->fd, n->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | (walk->follow ? 0 : O_NOFOLLOW));
+		walk_release(n->parent);
+	}
+	else
+		n->fd = open(n->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (n->fd < 0)
+		return 0;
+	/*
+	 * a link to a directory above this one would go round forever, so
+	 * when following links anything already being scanned is left
+	 * empty
+	 */
+	if (walk->follow)
+	{
+		struct stat st;
+		if (fstat(n->fd, &st))
+		{
+			close(n->fd);
+			return 0;
+		}
+		n->dev   = st.st_dev;
+		n->inode = st.st_ino;
+		for (node_t *x = n->parent; x; x = x->parent)
+			if (x->dev == n->dev && x->inode == n->inode)
+			{
+				close(n->fd);
+				return 0;
+			}
+	}
+	/*
+	 * the directory needs to stay open until everything in it has
+	 * been looked at, including its subdirectories
+	 */
+	int d = dup(n->fd);
+	DIR *dir = d < 0 ? NULL : fdopendir(d);
+	if (!dir)
+	{
+		if (d >= 0)
+			close(d);
+		close(n->fd);
+		return 0;
+	}
+#else
+	char *path = NULL;
+	{
+		size_t l = 0;
+		for (node_t *x = n; x; x = x->parent)
+			l += x->length + 1;
+		if (!(path = malloc(l)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l);
+		path[--l] = '\0';
+		for (node_t *x = n; x; x = x->parent)
+		{
+			memcpy(path + (l -= x->length), x->name, x->length);
+			if (l)
+				path[--l] = DIR_SEPARATOR_CHAR;
+		}
+	}
+	DIR *dir = opendir(path);
+	if (!dir)
+	{
+		free(path);
+		return 0;
+	}
+#endif
+	size_t e = 0;
+	size_t s = 0;
+	node_t *last = NULL;
+	for (struct dirent *ep; (ep = readdir(dir)); )
+	{
+		if (!strcmp(".", ep->d_name) || !strcmp("..", ep->d_name))
+			continue;
+		node_t *x = NULL;
+#ifdef DT_UNKNOWN
+		/*
+		 * where the file system says what each entry is there’s no
+		 * need to look any further for directories (hard links don’t
+		 * matter), and anything which isn’t going to be kept can be
+		 * skipped straight away
+		 */
+		if (ep->d_type == DT_DIR)
+		{
+			x = walk_node(n, ep->d_name);
+			x->type = WALK_DIRECTORY;
+		}
+		else if (ep->d_type != DT_REG && ep->d_type != DT_LNK && ep->d_type != DT_UNKNOWN)
+			continue;
+		else
+#endif
+		{
+			struct stat st;
+#ifndef _WIN32
+			if (fstatat(n->fd, ep->d_name, &st, walk->follow ? 0 : AT_SYMLINK_NOFOLLOW))
+				continue;
+#else
+			char *filename = NULL;
+			if (asprintf(&filename, "%s%c%s", path, DIR_SEPARATOR_CHAR, ep->d_name) < 0)
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(path) + strlen(ep->d_name) + 2);
+			int r = stat(filename, &st);
+			free(filename);
+			if (r)
+				continue;
+#endif
+			walk_type_e t;
+			switch (st.st_mode & S_IFMT)
+			{
+				case S_IFDIR:
+					t = WALK_DIRECTORY;
+					break;
+				case S_IFREG:
+					t = WALK_REGULAR;
+					break;
+#ifndef _WIN32
+				case S_IFLNK:
+					t = WALK_SYMLINK;
+					break;
+#endif
+				default:
+					continue;
+			}
+			x = walk_node(n, ep->d_name);
+			x->type  = t;
+			x->dev   = st.st_dev;
+			x->inode = st.st_ino;
+			x->links = st.st_nlink;
+			x->size  = st.st_size;
+		}
+		if (last)
+			last->next = x;
+		else
+			n->child = x;
+		last = x;
+		e++;
+		if (x->type == WALK_DIRECTORY)
+			s++;
+	}
+	closedir(dir);
+#ifdef _WIN32
+	free(path);
+#endif
+	if (!s)
+	{
+#ifndef _WIN32
+		close(n->fd);
+#endif
+		return e;
+	}
+	/*
+	 * queue the subdirectories; they’re taken from the end, so the
+	 * tree is scanned (roughly) depth first, which keeps the number
+	 * of directories open at once down
+	 */
+	n->users = s;
+	pthread_mutex_lock(&walk->mutex);
+	if (walk->waiting + s > walk->size)
+	{
+		while (walk->waiting + s > walk->size)
+			walk->size *= 2;
+		node_t **x = realloc(walk->stack, walk->size * sizeof( node_t * ));
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, walk->size * sizeof( node_t * ));
+		walk->stack = x;
+	}
+	for (node_t *x = n->child; x; x = x->next)
+		if (x->type == WALK_DIRECTORY)
+			walk->stack[walk->waiting++] = x;
+	pthread_cond_broadcast(&walk->cond);
+	pthread_mutex_unlock(&walk->mutex);
+	return e;
+}
+
+static node_t *walk_node(node_t *p, const char *n)
+{
+	size_t l = strlen(n);
+	node_t *x = calloc(1, sizeof( node_t ) + l + 1);
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( node_t ) + l + 1);
+	x->parent = p;
+	x->fd = -1;
+	x->length = l;
+	memcpy(x->name, n, l + 1);
+	return x;
+}
+
+static void walk_release(node_t *n)
+{
+	/*
+	 * the last of the subdirectories to be opened closes the directory
+	 */
+	if (!__atomic_sub_fetch(&n->users, 1, __ATOMIC_ACQ_REL))
+	{
+		close(n->fd);
+		n->fd = -1;
+	}
+	return;
+}
+
+static void walk_path(walk_t *walk, size_t l)
+{
+	if (l < walk->path_size)
+		return;
+	size_t s = walk->path_size ? : WALK_PATH;
+	while (s <= l)
+		s *= 2;
+	char *x = realloc(walk->path, s);
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, s);
+	walk->path = x;
+	walk->path_size = s;
+	return;
+}
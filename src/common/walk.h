@@ -0,0 +1,115 @@
+/*
+ * Common code for walking directory trees.
+ * Copyright © 2024, albinoloverats ~ Software Development
+ * email: webmaster@albinoloverats.net
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef _COMMON_WALK_H_
+#define _COMMON_WALK_H_
+
+/*!
+ * \file    walk.h
+ * \author  albinoloverats ~ Software Development
+ * \date    2024
+ * \brief   Common directory tree walking code shared between projects
+ *
+ * Scans a whole directory tree once (using several threads, as most of
+ * the time is spent waiting on the file system) and keeps a manifest of
+ * everything that was found, which can then be counted and walked in
+ * order as often as needed without touching the file system again.
+ */
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "common.h"
+
+typedef void * WALK; /*!< The user visible WALK type */
+
+/*!
+ * \brief  Types of entry kept in the manifest
+ */
+typedef enum
+{
+	WALK_DIRECTORY, /*!< A directory; its entries follow it */
+	WALK_REGULAR,   /*!< A regular file */
+	WALK_SYMLINK    /*!< A symlink (only when links aren’t being followed) */
+}
+walk_type_e;
+
+/*!
+ * \brief  An entry in the manifest
+ */
+typedef struct
+{
+	const char *path;  /*!< Path of the entry, starting with the name of the top directory */
+	walk_type_e type;  /*!< What the entry is */
+	dev_t dev;         /*!< The device the entry is on (not for directories) */
+	ino_t inode;       /*!< The inode of the entry (not for directories) */
+	nlink_t links;     /*!< Number of hard links to the entry (not for directories) */
+	off_t size;        /*!< Size of the entry when it was found (not for directories) */
+}
+walk_entry_t;
+
+/*!
+ * \brief         Scan a directory tree
+ * \param[in]  p  The directory to scan
+ * \param[in]  f  Whether to follow symlinks (and store what they point to)
+ * \param[in]  t  The number of threads to use (0 for one per CPU)
+ * \return        A new instance
+ *
+ * Everything below the directory is found before this returns; only
+ * directories, regular files and (if they’re not followed) symlinks are
+ * kept. Paths are relative to the directory containing p, so they all
+ * start with its last component.
+ */
+extern WALK walk_init(const char *p, bool f, size_t t) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Finish with a directory tree
+ * \param[in]  h  The instance to finish with
+ */
+extern void walk_deinit(WALK h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Number of entries in the tree
+ * \param[in]  h  An instance
+ * \return        The number of entries (not including the top directory)
+ */
+extern size_t walk_count(WALK h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get the next entry in the tree
+ * \param[in]  h  An instance
+ * \return        The next entry, or NULL once there are no more
+ *
+ * Entries are returned in the order they were found in each directory,
+ * with the entries of a directory immediately after the directory
+ * itself. The entry (and its path) are only valid until the next call.
+ */
+extern const walk_entry_t *walk_next(WALK h) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Go back to the start of the tree
+ * \param[in]  h  An instance
+ *
+ * The next call to walk_next() returns the first entry again.
+ */
+extern void walk_rewind(WALK h) __attribute__((nonnull(1)));
+
+#endif
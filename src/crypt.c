@@ -70,7 +70,13 @@ static const char *STATUS_MESSAGE[] =
 	"Failed: An unknown error has occurred!",
 	/* warnings - decryption finished but with possible errors */
 	"Warning: Bad checksum! (Possible data corruption)",
-	"Warning: Could not extract all files! (Links are unsupported)"
+	"Warning: Could not extract all files! (Links are unsupported)",
+	/* later failures */
+	"Failed: No such file or directory in the archive!",
+	"Failed: Ranges can only be decrypted from version 2027.02 or later!",
+	"Failed: Ranges can’t be decrypted from a directory! (Use --extract instead)",
+	"Failed: Ranges can’t be decrypted from data encrypted from stdin or a pipe!",
+	"Failed: Ranges can only be decrypted from a file! (Not stdin or a pipe)"
 };
 
 typedef struct
@@ -95,7 +101,14 @@ static const version_t VERSIONS[] =
 	{ "2020.01", 0x323032302e30312ellu },
 	{ "2022.01", 0x323032312e30312ellu },
 	{ "2024.01", 0x2e4155524f52412ellu },
-	{ "CURRENT", 0x2e4155524f52412ellu }
+	{ "2027.01", 0x323032372e30312ellu },
+	{ "2027.02", 0x323032372e30322ellu },
+	{ "2027.03", 0x323032372e30332ellu },
+	{ "2027.04", 0x323032372e30342ellu },
+	{ "2027.05", 0x323032372e30352ellu },
+	{ "2027.06", 0x323032372e30362ellu },
+	{ "2027.07", 0x323032372e30372ellu },
+	{ "CURRENT", 0x323032372e30372ellu }
 };
 
 extern void execute(crypto_t *c)
@@ -119,6 +132,11 @@ extern const char *status(const crypto_t * const restrict c)
 	return STATUS_MESSAGE[c->status];
 }
 
+extern const char *status_message(crypto_status_e s)
+{
+	return STATUS_MESSAGE[s];
+}
+
 extern void deinit(crypto_t **c)
 {
 	crypto_t *z = *c;
@@ -133,6 +151,8 @@ extern void deinit(crypto_t **c)
 		gcry_free(z->path);
 	if (z->name)
 		gcry_free(z->name);
+	if (z->extract)
+		gcry_free(z->extract);
 	if (z->source)
 		io_close(z->source);
 	if (z->output)
@@ -141,6 +161,8 @@ extern void deinit(crypto_t **c)
 		gcry_free(z->key);
 	if (z->misc)
 		gcry_free(z->misc);
+	if (z->tree)
+		walk_deinit(z->tree);
 	gcry_free(z);
 	z = NULL;
 	*c = NULL;
@@ -161,6 +183,12 @@ extern void key_gcry_free(raw_key_t **key)
 
 extern version_e is_encrypted_aux(bool b, const char *n, char **c, char **h, char **m, char **a, uint64_t *k)
 {
+	/*
+	 * make sure the secure memory pool is set up before (potentially)
+	 * using it, otherwise libgcrypt will create a far smaller one
+	 */
+	init_crypto();
+
 	struct stat st;
 	stat(n, &st);
 	if (S_ISDIR(st.st_mode))
@@ -37,8 +37,9 @@
 #include <pthread.h>    /*!< Necessary include as pthread handle is referenced in this header */
 #include <gcrypt.h>     /*!< Necessary include as encryption modes are referenced in this header */
 
-#include "common/cli.h" /*!< Used for progress bar on command line */
-#include "crypt_io.h"   /*!< Necessary as IO_HANDLE type is referenced in this header */
+#include "common/cli.h"  /*!< Used for progress bar on command line */
+#include "common/walk.h" /*!< Necessary as WALK type is referenced in this header */
+#include "crypt_io.h"    /*!< Necessary as IO_HANDLE type is referenced in this header */
 
 #define ENCRYPT "encrypt"
 #define ENCRYPT_VERSION "2024.01" /*!< Current (display) version of encrypt application */
@@ -100,7 +101,13 @@ typedef enum
 	STATUS_FAILED_OTHER,                    /*!< Unknown error */
 	/* warnings - decryption finished but with possible errors */
 	STATUS_WARNING_CHECKSUM,                /*!< Data checksum was invalid, possible data corruption */
-	STATUS_WARNING_LINK                     /*!< Warning where links are unsupported by the system */
+	STATUS_WARNING_LINK,                    /*!< Warning where links are unsupported by the system */
+	/* later failures; added at the end so the values above never change */
+	STATUS_FAILED_NOT_FOUND,                /*!< The entry to extract isn’t in the directory */
+	STATUS_FAILED_RANGE_VERSION,            /*!< A range was asked for, but the version has no index of chunks */
+	STATUS_FAILED_RANGE_DIRECTORY,          /*!< A range was asked for, but a directory was encrypted */
+	STATUS_FAILED_RANGE_STREAM,             /*!< A range was asked for, but the data was encrypted from a stream */
+	STATUS_FAILED_RANGE_SOURCE              /*!< A range was asked for, but the encrypted data can’t be seeked through */
 }
 crypto_status_e;
 
@@ -141,7 +148,14 @@ typedef enum
 	VERSION_2020_01,     /*!< Version 2020.01 */
 	VERSION_2022_01,     /*!< Version 2022.01 */
 	VERSION_2024_01,     /*!< Version 2024.01 */
-	VERSION_CURRENT = VERSION_2024_01 /*!< Next release / current development version */
+	VERSION_2027_01,     /*!< Version 2027.01 */
+	VERSION_2027_02,     /*!< Version 2027.02 */
+	VERSION_2027_03,     /*!< Version 2027.03 */
+	VERSION_2027_04,     /*!< Version 2027.04 */
+	VERSION_2027_05,     /*!< Version 2027.05 */
+	VERSION_2027_06,     /*!< Version 2027.06 */
+	VERSION_2027_07,     /*!< Version 2027.07 */
+	VERSION_CURRENT = VERSION_2027_07 /*!< Next release / current development version */
 }
 version_e;
 
@@ -157,7 +171,8 @@ typedef enum
 	TAG_BLOCKED,    /*!< Data is split into blocks (of given size) */
 	TAG_COMPRESSED, /*!< Data is compressed */
 	TAG_DIRECTORY,  /*!< Data is a directory hierarchy */
-	TAG_FILENAME    /*!< Single file name */
+	TAG_FILENAME,   /*!< Single file name */
+	TAG_CODEC       /*!< Compression codec and level */
 	/*
 	 * TODO add tags for stat data (mode, atime, ctime, mtime)
 	 */
@@ -192,6 +207,7 @@ typedef struct
 
 	char *path;                    /*!< Path to en/decrypted directory */
 	char *name;                    /*!< Name of single encrypted file */
+	char *extract;                 /*!< Path of the only entry to decrypt from a directory (from 2027.03) */
 	enum gcry_cipher_algos cipher; /*!< The chosen cipher algorithm */
 	enum gcry_md_algos hash;       /*!< The chosen key hash algorithm */
 	enum gcry_cipher_modes mode;   /*!< The chosen encryption mode */
@@ -203,21 +219,34 @@ typedef struct
 	uint8_t *key;                  /*!< Key data */
 	size_t length;                 /*!< Key data length */
 	uint64_t kdf_iterations;       /*!< KDF iterations */
+	IO_MASTER master;              /*!< Master keys shared with other instances using the same key (from 2027.07; may be NULL) */
 
 	pthread_t *thread;             /*!< Execution thread */
 	void *(*process)(void *);      /*!< Main processing function; used by execute() */
 	crypto_status_e status;        /*!< Current status */
 	cli_progress_t current;        /*!< Progress of current file */
 	cli_progress_t total;          /*!< Overall progress (all files) */
+	io_stats_t stats;              /*!< Counters for each stage of the IO; complete once processing has succeeded */
 
 	void *misc;                    /*!< Miscellaneous data, specific to either encryption or decryption only */
+	WALK tree;                     /*!< Everything in the directory being encrypted */
 
 	version_e version;             /*!< Version of the encrypted file container */
 	uint64_t blocksize;            /*!< Whether data is split into blocks, and thus their size */
+	uint64_t threads;              /*!< Number of threads to use for en/decryption, where the mode allows (0 for one per CPU) */
+	io_codec_e codec;              /*!< Compression algorithm */
+	int compress_level;            /*!< Compression level (CODEC_LEVEL_DEFAULT for the codec default) */
+	uint64_t compress_threads;     /*!< Number of threads to use for compression (0 for one per CPU, 1 for the single threaded encoder) */
+	uint64_t compress_block;       /*!< Size of each block when compressing with multiple threads (0 for the default) */
+	uint64_t range_offset;         /*!< Where the data to decrypt starts (only when decrypting a range) */
+	uint64_t range_length;         /*!< How much data to decrypt (0 for everything after range_offset) */
 	bool compressed:1;             /*!< Whether data stream is compress */
 	bool directory:1;              /*!< Whether data stream is a directory hierarchy */
 	bool follow_links:1;           /*!< Whether encrypt should follow symlinks (true: store the file it points to; false: store the link itself */
 	bool raw:1;                    /*!< Whether the header should be skipped (not recommended but ideal in some situations) */
+	bool direct_io:1;              /*!< Whether files should be read/written without going through the page cache */
+	bool range:1;                  /*!< Whether only a range of the data should be decrypted (from 2027.02) */
+	bool list:1;                   /*!< Whether to only list what was encrypted (for directories, from 2027.04) */
 }
 crypto_t;
 
@@ -242,6 +271,16 @@ extern void execute(crypto_t *c) __attribute__((nonnull(1)));
  */
 extern const char *status(const crypto_t * const restrict c) __attribute__((nonnull(1)));
 
+/*!
+ * \brief         Get the message for a status
+ * \param[in]  s  A status
+ * \return        Status message
+ *
+ * The same message status() gives for an instance with that status;
+ * for when the instance itself is no longer around.
+ */
+extern const char *status_message(crypto_status_e s);
+
 /*!
  * \brief         Deinitialise a cryptographic instance
  * \param[in]  c  A pointer to the instance to release
@@ -26,6 +26,14 @@
 #include <fcntl.h>
 
 #include <pthread.h>
+#include <time.h>
+
+#ifndef _WIN32
+	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <netinet/in.h>
+	#include <signal.h>
+#endif
 
 #include <stdint.h>
 #include <stdbool.h>
@@ -33,12 +41,20 @@
 
 #include <gcrypt.h>
 #include <lzma.h>
+#ifdef HAVE_ZSTD
+	#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+	#include <lz4frame.h>
+#endif
 
 #include "common/common.h"
 #include "common/non-gnu.h"
 #include "common/error.h"
 #include "common/ccrypt.h"
 #include "common/ecc.h"
+#include "common/ring.h"
+#include "common/uring.h"
 
 #include "crypt_io.h"
 #include "crypt.h"
@@ -46,6 +62,37 @@
 #define IO_DUMMY_FD 0x42145c91
 #define OFFSET_SLOTS 3
 
+#define CIPHER_BUFFER_SIZE   (64 * KILOBYTE) /*!< Size of the buffer for bulk en/decryption (when on a single thread) */
+#define CIPHER_BUFFER_POOL   MEGABYTE        /*!< Most the buffer can grow to when en/decrypting in parallel; shared between the threads, however many there are */
+#define CIPHER_BUFFER_SLICE  (16 * KILOBYTE) /*!< Least each thread is given to en/decrypt at once */
+
+#define CODEC_BUFFER_SIZE (64 * KILOBYTE) /*!< Size of the buffer for compressed data */
+#define LZMA_THREADS_MAX  0x4000          /*!< Maximum number of threads liblzma will accept */
+
+#define MAP_READ_AHEAD (8 * MEGABYTE) /*!< How far ahead of a mapped file to ask the kernel to read */
+#define MAP_GUARDED    0x100          /*!< Most files which can be mapped at once (they’re read instead after that) */
+
+#define DIRECT_ALIGN       4096        /*!< Alignment of buffers (and their length) for direct IO */
+#define DIRECT_BUFFER_SIZE MEGABYTE    /*!< Size of the buffer for direct IO */
+
+#define MASTER_KEYS 0x10 /*!< Most master keys to keep; as many as there are likely to be different salts in use at once */
+
+#define URING_DEPTH 8                /*!< Number of writes which can be in flight at once */
+#define URING_BLOCK (512 * KILOBYTE) /*!< Size of each write */
+#define LZ4_CHUNK         (16 * KILOBYTE) /*!< Amount of data to give to LZ4 at once, so the output is bounded */
+
+#define ECC_FRAME  (ECC_CAPACITY + sizeof( uint8_t )) /*!< Size of an encoded ECC frame, including its length */
+#define ECC_FRAMES 256                                /*!< Number of ECC frames to read/write at once */
+
+#define PIPELINE_BLOCK (256 * KILOBYTE) /*!< Size of each block passed between pipeline stages */
+#define PIPELINE_DEPTH 8                /*!< Number of blocks which can be queued between pipeline stages */
+
+#define CHUNK_SIZE   MEGABYTE                                     /*!< Amount of data in each chunk (before compression) */
+#define CHUNK_NONCE  16                                           /*!< Minimum length of the nonce of each chunk */
+#define CHUNK_STREAM 8                                            /*!< How much of the nonce is used by stream ciphers */
+#define CHUNK_HEADER (sizeof( uint8_t ) + 2 * sizeof( uint32_t )) /*!< Flags, length of the data, length of what was stored */
+#define CHUNK_ENTRY  (2 * sizeof( uint64_t ))                     /*!< Size of each entry in the index */
+
 /*!
  * \brief  How to process the data
  *
@@ -55,7 +102,8 @@ typedef enum
 {
 	IO_DEFAULT, /*!< No processing will be done; only used when reading/writing the header */
 	IO_ENCRYPT, /*!< Data will be encrypted/decrypted */
-	IO_LZMA     /*!< Data will be compressed/decompressed prior to encryption/decryption */
+	IO_COMPRESS, /*!< Data will be compressed/decompressed prior to encryption/decryption */
+	IO_STORE     /*!< Data is only encrypted/decrypted while compression is paused */
 }
 io_e;
 
@@ -71,39 +119,279 @@ typedef struct
 {
 	uint8_t *stream;             /*!< Buffer data   */
 	size_t block;                /*!< Size of steam */
+	size_t count;                /*!< Number of blocks which fit in the stream */
 	size_t offset[OFFSET_SLOTS]; /*!< 0: length of data in buffer, yet to write; 1: available space in output buffer (stream); 2: offset of where to read new data to */
 }
 buffer_t;
 
+struct io_pool_s;
+
+/*!
+ * \brief  En/decryption worker thread
+ *
+ * Each worker has its own cipher handle (with the same key) so that it
+ * can be positioned at any block within the stream.
+ */
+typedef struct
+{
+	pthread_t thread;
+	gcry_cipher_hd_t cipher_handle;
+	struct io_pool_s *pool;
+	uint8_t *out;                /*!< Where to put the en/decrypted data */
+	const uint8_t *in;           /*!< Where to get the data from (NULL for in place) */
+	size_t length;               /*!< Length of data to process */
+	uint64_t index;              /*!< Number of the first block within the stream */
+}
+io_worker_t;
+
+/*!
+ * \brief  A master key, stretched from the key data
+ */
+typedef struct
+{
+	enum gcry_md_algos hash;     /*!< The hash used by the KDF */
+	uint64_t iterations;         /*!< Number of KDF iterations */
+	uint8_t *data;               /*!< The hash of the key data it was stretched from */
+	uint8_t *salt;               /*!< The salt it was stretched with */
+	uint8_t *key;                /*!< The master key */
+	size_t length;               /*!< Length of the hash (and of the master key) */
+	size_t salt_length;          /*!< Length of the salt */
+	bool ready;                  /*!< Whether the master key has been derived yet */
+}
+io_master_key_t;
+
+/*!
+ * \brief  Cache of master keys
+ */
+typedef struct
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;         /*!< Signalled when a master key has been derived */
+	io_master_key_t keys[MASTER_KEYS];
+	size_t count;                /*!< Number of keys in the cache */
+	size_t next;                 /*!< The key to replace when the cache is full */
+}
+io_master_t;
+
+/*!
+ * \brief  Pool of worker threads
+ *
+ * Used for modes where each block can be en/decrypted independently of
+ * the one before it; the counter (or tweak) for any block can be
+ * derived from the IV and the number of blocks that came before it.
+ */
+typedef struct io_pool_s
+{
+	pthread_mutex_t mutex;
+	pthread_cond_t start;
+	pthread_cond_t done;
+	io_worker_t *workers;
+	size_t count;                /*!< Number of worker threads */
+	size_t pending;              /*!< Number of workers yet to finish the current job */
+	uint64_t job;                /*!< Job number; incremented for each new job */
+	enum gcry_cipher_modes mode;
+	size_t block;                /*!< Cipher block length */
+	uint8_t *iv;                 /*!< The initial counter/tweak */
+	uint64_t index;              /*!< Number of blocks processed so far */
+	bool encrypt:1;
+	bool stop:1;
+}
+io_pool_t;
+
+/*!
+ * \brief  A pipeline stage
+ *
+ * A thread which does the actual reading (or writing) of the file,
+ * along with the error correction, connected to the rest of the IO
+ * processing by a ring buffer.
+ */
+typedef struct
+{
+	pthread_t thread;
+	RING ring;
+	uint8_t *block;              /*!< The block currently being filled/emptied by the calling thread */
+	size_t length;               /*!< Length of data in the current block */
+	size_t offset;               /*!< How much of the current block has been read */
+	int error;                   /*!< The value of errno if the stage failed */
+	bool write:1;                /*!< Whether the stage is writing data (or reading it) */
+	bool sync:1;                 /*!< Whether the stage should sync once everything is written */
+}
+io_stage_t;
+
+/*!
+ * \brief  Chunk flags
+ */
+typedef enum
+{
+	CHUNK_COMPRESSED = 0x01, /*!< The data was compressed before it was stored */
+	CHUNK_FINAL      = 0x02, /*!< The last chunk of data */
+	CHUNK_INDEX      = 0x04  /*!< The index, which follows the last chunk */
+}
+chunk_e;
+
+/*!
+ * \brief  An entry in the index of chunks
+ */
+typedef struct
+{
+	uint64_t plain;              /*!< Offset of the chunk within the plaintext */
+	uint64_t offset;             /*!< Offset of the chunk within the stream */
+}
+chunk_index_t;
+
+/*!
+ * \brief  A chunk of data
+ *
+ * From 2027.02 the data is split into chunks, each of which is encrypted
+ * (with its own nonce) and authenticated on its own, so any one of them
+ * can be read without reading the rest of the stream first.
+ */
+typedef struct
+{
+	gcry_mac_hd_t mac_handle;    /*!< For the tag of each chunk (with its own key) */
+	uint8_t *stream;             /*!< The stored (possibly compressed) data */
+	size_t size;                 /*!< Size of the stream buffer */
+	size_t length;               /*!< Length of the stored data */
+	size_t offset;               /*!< How much of the stored data has been used (when reading) */
+	uint8_t *plain;              /*!< The decompressed data (when reading) */
+	size_t plain_size;           /*!< Size of the decompressed data buffer */
+	const uint8_t *data;         /*!< The data of the chunk (when reading) */
+	size_t data_length;          /*!< Length of the data in the chunk */
+	size_t data_offset;          /*!< How much of the data has been read */
+	uint8_t *nonce;
+	size_t nonce_length;
+	uint8_t *tag;
+	size_t tag_length;
+	uint64_t number;             /*!< Number of the current chunk */
+	uint64_t start;              /*!< Offset of the current chunk within the plaintext */
+	chunk_index_t *index;        /*!< Where each chunk is (only loaded when reading a range) */
+	size_t count;                /*!< Number of entries in the index */
+	size_t slots;                /*!< Number of entries there is space for */
+	uint64_t bookmark;           /*!< An offset to store with the index */
+	bool write:1;
+	bool final:1;                /*!< The current chunk is the last */
+	bool mac_iv:1;               /*!< The MAC needs an IV */
+}
+io_chunk_t;
+
 typedef struct
 {
 	int64_t fd;
 
 	lzma_stream lzma_handle;
+	void *codec_handle;          /*!< The compression context, for codecs other than xz */
+	io_compress_t codec_options;
 
 	gcry_cipher_hd_t cipher_handle;
+	enum gcry_cipher_modes cipher_mode;
 	gcry_md_hd_t hash_handle;
 	gcry_mac_hd_t mac_handle;
 
 	buffer_t *buffer_crypt;
+	buffer_t *buffer_codec;
 	buffer_t *buffer_ecc;
+	buffer_t *buffer_frames;
+	buffer_t *buffer_direct;     /*!< Aligned buffer for reading/writing directly (bypassing the page cache) */
+
+	io_pool_t *pool;
+	io_stage_t *stage;
+	URING uring;                 /*!< For writing asynchronously, when possible */
+	io_chunk_t *chunk;           /*!< The current chunk (only for chunked streams) */
+
+	uint64_t position;           /*!< How much has been read/written (before error correction) */
+	uint64_t ecc_start;          /*!< Where error correction started */
+
+	uint8_t *map;                /*!< The file, when it’s been mapped into memory */
+	size_t map_length;
+	size_t map_offset;           /*!< How much of the mapped file has been used */
+	size_t map_advised;          /*!< How much of the mapped file has been read ahead */
+	volatile sig_atomic_t map_truncated; /*!< The file was truncated while it was mapped */
+
+	io_stats_t stats;            /*!< Counters for each stage */
+	io_stats_t *stats_total;     /*!< Where to add the counters once the file is closed */
 
 	eof_e eof:2;
 	io_e operation:2;
 
-	uint8_t byte;
-
-	bool lzma_init:1;
+	bool codec_init:1;
+	bool codec_compress:1;
 	bool cipher_init:1;
 	bool hash_init:1;
 	bool mac_init:1;
 	bool ecc_init:1;
+	bool direct_write:1;
 }
 io_private_t;
 
+/*!
+ * \brief  A compression codec
+ *
+ * The functions which implement a compression algorithm. Each codec
+ * collects its compressed output in (or decompresses its input from)
+ * the codec buffer; writing NULL finishes the compressed stream.
+ */
+typedef struct
+{
+	const char *name;
+	uint8_t level;                                         /*!< The default compression level */
+	uint8_t maximum;                                       /*!< The maximum compression level */
+	bool (*compress)(io_private_t *);                      /*!< Begin compressing; NULL if not available */
+	bool (*decompress)(io_private_t *);                    /*!< Begin decompressing; NULL if not available */
+	ssize_t (*write)(io_private_t *, const void *, size_t);
+	ssize_t (*read)(io_private_t *, void *, size_t);
+	void (*end)(io_private_t *);
+}
+io_codec_t;
+
+static bool lzma_compress(io_private_t *);
+static bool lzma_decompress(io_private_t *);
 static ssize_t lzma_write(io_private_t *, const void *, size_t);
 static ssize_t lzma_read(io_private_t *, void *, size_t);
-static int lzma_sync(io_private_t *);
+static void lzma_finish(io_private_t *);
+
+#ifdef HAVE_ZSTD
+static bool zstd_compress(io_private_t *);
+static bool zstd_decompress(io_private_t *);
+static ssize_t zstd_write(io_private_t *, const void *, size_t);
+static ssize_t zstd_read(io_private_t *, void *, size_t);
+static void zstd_finish(io_private_t *);
+#endif
+
+#ifdef HAVE_LZ4
+static bool lz4_compress(io_private_t *);
+static bool lz4_decompress(io_private_t *);
+static ssize_t lz4_write(io_private_t *, const void *, size_t);
+static ssize_t lz4_read(io_private_t *, void *, size_t);
+static void lz4_finish(io_private_t *);
+#endif
+
+static bool codec_init(io_private_t *, bool);
+static int codec_sync(io_private_t *);
+static void codec_buffer_init(io_private_t *, size_t);
+static uint32_t codec_threads(size_t);
+
+/*!
+ * \brief  Available compression codecs
+ *
+ * Indexed by io_codec_e; codecs which were not available when encrypt
+ * was built are still listed (so they can be named) but cannot be used.
+ */
+static const io_codec_t CODECS[] =
+{
+	{ "xz",   LZMA_PRESET_DEFAULT, 9,  lzma_compress, lzma_decompress, lzma_write, lzma_read, lzma_finish },
+#ifdef HAVE_ZSTD
+	{ "zstd", ZSTD_CLEVEL_DEFAULT, 22, zstd_compress, zstd_decompress, zstd_write, zstd_read, zstd_finish },
+#else
+	{ "zstd", 3,                   22, NULL,          NULL,            NULL,       NULL,      NULL        },
+#endif
+#ifdef HAVE_LZ4
+	{ "lz4",  0,                   12, lz4_compress,  lz4_decompress,  lz4_write,  lz4_read,  lz4_finish  },
+#else
+	{ "lz4",  0,                   12, NULL,          NULL,            NULL,       NULL,      NULL        },
+#endif
+};
+
+static ssize_t store_read(io_private_t *, void *, size_t);
 
 static ssize_t enc_write(io_private_t *, const void *, size_t);
 static ssize_t enc_read(io_private_t *, void *, size_t);
@@ -113,8 +401,79 @@ static ssize_t ecc_write(io_private_t *, const void *, size_t);
 static ssize_t ecc_read(io_private_t *, void *, size_t);
 static int ecc_sync(io_private_t *);
 
-static void io_do_compress(io_private_t *);
-static void io_do_decompress(io_private_t *);
+static void enc_crypt(io_private_t *, bool, uint8_t *, const uint8_t *, size_t);
+
+static io_chunk_t *chunk_init(enum gcry_mac_algos, enum gcry_md_algos, const uint8_t *, size_t, const uint8_t *, size_t);
+static void chunk_deinit(io_chunk_t *);
+static ssize_t chunk_write(io_private_t *, const void *, size_t);
+static ssize_t chunk_read(io_private_t *, void *, size_t);
+static int chunk_sync(io_private_t *);
+static int chunk_seal(io_private_t *, uint8_t);
+static int chunk_load(io_private_t *, size_t);
+static int chunk_index(io_private_t *);
+static void chunk_crypt(io_private_t *, bool, size_t);
+static bool chunk_tag(io_private_t *, const uint8_t *, size_t, bool);
+static void chunk_reserve(io_chunk_t *, size_t);
+static void chunk_record(io_chunk_t *, uint64_t, uint64_t);
+
+static int stream_seek(io_private_t *, uint64_t);
+static off_t stream_length(io_private_t *);
+
+static ssize_t raw_read(io_private_t *, void *, size_t);
+static ssize_t raw_write(io_private_t *, const void *, size_t);
+static int raw_sync(io_private_t *);
+
+static ssize_t direct_read(io_private_t *, void *, size_t);
+static ssize_t direct_write(io_private_t *, const void *, size_t);
+static int direct_flush(io_private_t *);
+static bool direct_off(io_private_t *);
+
+#ifndef _WIN32
+static bool map_guard(io_private_t *);
+static void map_unguard(io_private_t *);
+static void map_install(void);
+static void map_bus(int, siginfo_t *, void *);
+
+static io_private_t *MAP_GUARD[MAP_GUARDED];
+static struct sigaction map_previous;
+static pthread_mutex_t map_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t map_guarded; /*!< How many files are being read through a map; the SIGBUS handler is only installed while there are any */
+static uintptr_t map_page;
+#endif
+
+static ssize_t pipe_write(io_private_t *, const void *, size_t);
+static ssize_t pipe_read(io_private_t *, void *, size_t);
+static int pipe_sync(io_private_t *);
+static int pipe_finish(io_private_t *, bool);
+static void *pipe_writer(void *);
+static void *pipe_reader(void *);
+
+
+static void master_key(io_master_t *, enum gcry_md_algos, uint64_t, const uint8_t *, size_t, uint8_t *, size_t, bool, uint8_t *);
+
+static io_pool_t *pool_init(enum gcry_cipher_algos, enum gcry_cipher_modes, const uint8_t *, size_t, size_t);
+static void pool_deinit(io_pool_t *);
+static void *pool_worker(void *);
+
+static void crypt_blocks(gcry_cipher_hd_t, enum gcry_cipher_modes, bool, size_t, uint8_t *, const uint8_t *, size_t);
+static void crypt_position(gcry_cipher_hd_t, enum gcry_cipher_modes, const uint8_t *, size_t, uint64_t);
+static bool mode_supports_bulk(enum gcry_cipher_modes);
+static bool mode_supports_parallel(enum gcry_cipher_modes);
+
+static void plain_digest(io_private_t *, const void *, size_t);
+static uint64_t stat_clock(void);
+static void stat_count(io_private_t *, io_stat_e, uint64_t, uint64_t);
+
+static const char *STAT_NAMES[] =
+{
+	"read",
+	"hash",
+	"mac",
+	"compression",
+	"cipher",
+	"ecc",
+	"write"
+};
 
 extern IO_HANDLE io_open(const char *n, int f, mode_t m)
 {
@@ -155,26 +514,63 @@ extern void io_release(IO_HANDLE ptr)
 	io_private_t *io_ptr = ptr;
 	if (!io_ptr)
 		return (errno = EBADF , (void)NULL);
+	if (io_ptr->stage)
+		pipe_finish(io_ptr, false);
+	if (io_ptr->uring)
+		uring_deinit(io_ptr->uring);
+	if (io_ptr->stats_total)
+		io_stats_collect(io_ptr, io_ptr->stats_total);
+	if (io_ptr->buffer_direct)
+	{
+		if (io_ptr->direct_write)
+			direct_flush(io_ptr);
+		memset(io_ptr->buffer_direct->stream, 0x00, io_ptr->buffer_direct->block);
+		free(io_ptr->buffer_direct->stream);
+		free(io_ptr->buffer_direct);
+	}
 	if (io_ptr->buffer_crypt)
 	{
 		if (io_ptr->buffer_crypt->stream)
 			gcry_free(io_ptr->buffer_crypt->stream);
 		gcry_free(io_ptr->buffer_crypt);
 	}
+	if (io_ptr->buffer_codec)
+	{
+		if (io_ptr->buffer_codec->stream)
+			gcry_free(io_ptr->buffer_codec->stream);
+		gcry_free(io_ptr->buffer_codec);
+	}
 	if (io_ptr->buffer_ecc)
 	{
 		if (io_ptr->buffer_ecc->stream)
 			free(io_ptr->buffer_ecc->stream);
 		free(io_ptr->buffer_ecc);
 	}
+	if (io_ptr->buffer_frames)
+	{
+		if (io_ptr->buffer_frames->stream)
+			free(io_ptr->buffer_frames->stream);
+		free(io_ptr->buffer_frames);
+	}
+	if (io_ptr->pool)
+		pool_deinit(io_ptr->pool);
+	if (io_ptr->chunk)
+		chunk_deinit(io_ptr->chunk);
 	if (io_ptr->cipher_init)
 		gcry_cipher_close(io_ptr->cipher_handle);
 	if (io_ptr->hash_init)
 		gcry_md_close(io_ptr->hash_handle);
 	if (io_ptr->mac_init)
 		gcry_mac_close(io_ptr->mac_handle);
-	if (io_ptr->lzma_init)
-		lzma_end(&io_ptr->lzma_handle);
+	if (io_ptr->codec_init)
+		CODECS[io_ptr->codec_options.x_codec].end(io_ptr);
+#ifndef _WIN32
+	if (io_ptr->map)
+	{
+		map_unguard(io_ptr);
+		munmap(io_ptr->map, io_ptr->map_length);
+	}
+#endif
 	gcry_free(io_ptr);
 	io_ptr = NULL;
 	return;
@@ -222,6 +618,12 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 	if (!io_ptr || io_ptr->fd < 0)
 		return (errno = EBADF , false);
 	uint64_t key_iterations = itr;
+	/*
+	 * each chunk needs a tag of its own
+	 */
+	if (x.x_chunked && a == GCRY_MAC_NONE)
+		return (errno = EINVAL , false);
+	io_chunk_t *chunk = NULL;
 	/*
 	 * start setting up the encryption buffer
 	 */
@@ -231,6 +633,7 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 	gcry_md_open(&io_ptr->hash_handle, h, GCRY_MD_FLAG_SECURE);
 	if (gcry_cipher_open(&io_ptr->cipher_handle, c, m, GCRY_CIPHER_SECURE) != GPG_ERR_NO_ERROR)
 		return (errno = EINVAL , false);
+	io_ptr->cipher_mode = m;
 	if (a != GCRY_MAC_NONE)
 		gcry_mac_open(&io_ptr->mac_handle, a, GCRY_MAC_FLAG_SECURE, NULL);
 	/*
@@ -287,10 +690,28 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, key_length);
 	size_t salt_length = key_length;
 	uint8_t *salt = gcry_calloc_secure(salt_length, sizeof( byte_t ));
+	size_t mac_length = a != GCRY_MAC_NONE ? gcry_mac_get_algo_keylen(a) : 0;
+	uint8_t *keys = NULL;
 	if (key_iterations)
 	{
 		if (!salt)
 			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, salt_length);
+		uint8_t *master = NULL;
+		if (x.x_master)
+		{
+			/*
+			 * the passphrase is stretched with a salt of its own, which
+			 * is shared by every file encrypted with the same cache, so
+			 * the master key only needs deriving once for all of them
+			 */
+			if (!(master = gcry_malloc_secure(hash_length)))
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, hash_length);
+			if (!x.x_encrypt)
+				io_read(ptr, salt, salt_length);
+			master_key(x.x_keys, h, key_iterations, hash, hash_length, salt, salt_length, x.x_encrypt, master);
+			if (x.x_encrypt)
+				io_write(ptr, salt, salt_length);
+		}
 		if (x.x_encrypt)
 		{
 			gcry_create_nonce(salt, salt_length);
@@ -298,7 +719,28 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 		}
 		else
 			io_read(ptr, salt, salt_length);
-		gcry_kdf_derive(hash, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, key_iterations, key_length, key);
+		if (x.x_one_kdf)
+		{
+			/*
+			 * stretch the passphrase once (for a single hash length,
+			 * as each one costs all the iterations again), if that
+			 * wasn’t already done for the master key, and then expand
+			 * that into both keys
+			 */
+			if (!master)
+			{
+				if (!(master = gcry_malloc_secure(hash_length)))
+					die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, hash_length);
+				gcry_kdf_derive(hash, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, key_iterations, hash_length, master);
+			}
+			if (!(keys = gcry_malloc_secure(key_length + mac_length)))
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, key_length + mac_length);
+			gcry_kdf_derive(master, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, 1, key_length + mac_length, keys);
+			gcry_free(master);
+			memcpy(key, keys, key_length);
+		}
+		else
+			gcry_kdf_derive(hash, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, key_iterations, key_length, key);
 	}
 	else
 	{
@@ -310,6 +752,23 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 		memcpy(key, hash, key_length < hash_length ? key_length : hash_length);
 	}
 	gcry_cipher_setkey(io_ptr->cipher_handle, key, key_length);
+	/*
+	 * where each block can be en/decrypted independently of the others
+	 * share the work between a pool of threads
+	 */
+	size_t threads = x.x_threads;
+#ifdef _SC_NPROCESSORS_ONLN
+	if (!threads)
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	/*
+	 * the buffer comes from secure memory, which there isn’t much of,
+	 * so it stays the same size and each thread gets a slice of it
+	 */
+	if (threads > CIPHER_BUFFER_POOL / CIPHER_BUFFER_SLICE)
+		threads = CIPHER_BUFFER_POOL / CIPHER_BUFFER_SLICE;
+	if (threads > 1 && mode_supports_parallel(m))
+		io_ptr->pool = pool_init(c, m, key, key_length, threads);
 	gcry_free(key);
 
 	/*
@@ -318,13 +777,19 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 	 */
 	if (a != GCRY_MAC_NONE)
 	{
-		size_t mac_length = gcry_mac_get_algo_keylen(a);
 		uint8_t *mac = gcry_calloc_secure(mac_length, sizeof( byte_t ));
-		gcry_kdf_derive(hash, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, key_iterations, mac_length, mac);
+		if (keys)
+			memcpy(mac, keys + key_length, mac_length);
+		else
+			gcry_kdf_derive(hash, hash_length, GCRY_KDF_PBKDF2, h, salt, salt_length, key_iterations, mac_length, mac);
 		gcry_mac_setkey(io_ptr->mac_handle, mac, mac_length);
+		if (x.x_chunked && !(chunk = chunk_init(a, h, mac, mac_length, salt, salt_length)))
+			return gcry_free(mac) , gcry_free(keys) , gcry_free(salt) , gcry_free(hash) , (errno = EINVAL , false);
 		gcry_free(mac);
 		io_ptr->mac_init = true;
 	}
+	if (keys)
+		gcry_free(keys);
 	gcry_free(salt);
 
 	/*
@@ -370,6 +835,13 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 		gcry_cipher_setctr(io_ptr->cipher_handle, iv, io_ptr->buffer_crypt->block);
 	else
 		gcry_cipher_setiv(io_ptr->cipher_handle, iv, io_ptr->buffer_crypt->block);
+	if (io_ptr->pool)
+	{
+		io_ptr->pool->block = io_ptr->buffer_crypt->block;
+		if (!(io_ptr->pool->iv = gcry_malloc_secure(io_ptr->pool->block)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, io_ptr->pool->block);
+		memcpy(io_ptr->pool->iv, iv, io_ptr->pool->block);
+	}
 
 	if (io_ptr->mac_init)
 	{
@@ -381,21 +853,40 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 	}
 
 	/*
-	 * set the rest of the buffer
+	 * set the rest of the buffer; buffer many cipher blocks so they can
+	 * be processed together, and each thread gets as much as it would
+	 * have had on its own, until the buffer is as big as can be spared
 	 */
-	if (!(io_ptr->buffer_crypt->stream = gcry_malloc_secure(io_ptr->buffer_crypt->block)))
-		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, io_ptr->buffer_crypt->block);
+	size_t s = CIPHER_BUFFER_SIZE;
+	if (io_ptr->pool && (s *= io_ptr->pool->count + 1) > CIPHER_BUFFER_POOL)
+		s = CIPHER_BUFFER_POOL;
+	io_ptr->buffer_crypt->count = s / io_ptr->buffer_crypt->block ? : 1;
+	size_t stream_length = io_ptr->buffer_crypt->block * io_ptr->buffer_crypt->count;
+	if (!(io_ptr->buffer_crypt->stream = gcry_malloc_secure(stream_length)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, stream_length);
 	/*
 	 * when encrypting/writing data:
 	 *   0: length of data buffered so far (in stream)
 	 *   1: length of data processed (from d)
 	 * when decrypting/reading data:
 	 *   0: length of available data in input buffer (stream)
-	 *   1: available space in read buffer (d)
-	 *   2: next available memory location for data (from d)
+	 *   1: offset of available data in input buffer (stream)
+	 *   2: length of data copied to read buffer (d)
 	 */
 	for (unsigned i = 0; i < OFFSET_SLOTS; i++)
 		io_ptr->buffer_crypt->offset[i] = 0;
+	if (chunk)
+	{
+		/*
+		 * stream ciphers only use part of the nonce; the rest is for
+		 * the MAC (if it needs one)
+		 */
+		chunk->write = x.x_encrypt;
+		chunk->nonce_length = io_ptr->buffer_crypt->block > CHUNK_NONCE ? io_ptr->buffer_crypt->block : CHUNK_NONCE;
+		if (!(chunk->nonce = gcry_malloc_secure(chunk->nonce_length)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, chunk->nonce_length);
+		io_ptr->chunk = chunk;
+	}
 	io_ptr->cipher_init = true;
 	io_ptr->hash_init = true;
 	io_ptr->operation = IO_ENCRYPT;
@@ -403,6 +894,31 @@ extern bool io_encryption_init(IO_HANDLE ptr, enum gcry_cipher_algos c, enum gcr
 	return true;
 }
 
+extern IO_MASTER io_master_init(void)
+{
+	io_master_t *m = calloc(1, sizeof( io_master_t ));
+	if (!m)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( io_master_t ));
+	pthread_mutex_init(&m->mutex, NULL);
+	pthread_cond_init(&m->cond, NULL);
+	return m;
+}
+
+extern void io_master_deinit(IO_MASTER ptr)
+{
+	io_master_t *m = ptr;
+	for (size_t i = 0; i < m->count; i++)
+	{
+		gcry_free(m->keys[i].data);
+		gcry_free(m->keys[i].salt);
+		gcry_free(m->keys[i].key);
+	}
+	pthread_cond_destroy(&m->cond);
+	pthread_mutex_destroy(&m->mutex);
+	free(m);
+	return;
+}
+
 extern void io_encryption_checksum_init(IO_HANDLE ptr, enum gcry_md_algos h)
 {
 	io_private_t *io_ptr = ptr;
@@ -451,27 +967,237 @@ extern void io_encryption_mac(IO_HANDLE ptr, uint8_t **b, size_t *l)
 	return;
 }
 
-extern void io_compression_init(IO_HANDLE ptr)
+extern void io_compression_init(IO_HANDLE ptr, io_compress_t x)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , (void)NULL;
+	/*
+	 * nothing before this point is compressed, so it’s in a chunk of
+	 * its own
+	 */
+	if (io_ptr->chunk && io_ptr->chunk->write && io_ptr->chunk->data_length)
+		chunk_seal(io_ptr, 0);
+	io_ptr->codec_options = x;
+	io_ptr->operation = IO_COMPRESS;
+	io_ptr->codec_init = false;
+	return;
+}
+
+extern bool io_compression_pause(IO_HANDLE ptr)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , false;
+	if (io_ptr->operation != IO_COMPRESS)
+		return true;
+	bool r = true;
+	if (io_ptr->chunk)
+	{
+		/*
+		 * a chunk is either compressed or it isn’t, so whatever has
+		 * been written so far is sealed in a chunk of its own; when
+		 * reading, the chunks end in the same place anyway
+		 */
+		if (io_ptr->chunk->write && io_ptr->chunk->data_length)
+			r = !chunk_seal(io_ptr, 0);
+	}
+	else if (io_ptr->codec_init)
+	{
+		/*
+		 * end the compressed stream; when reading, anything read past
+		 * its end stays in the buffer until it’s needed
+		 */
+		const io_codec_t *z = &CODECS[io_ptr->codec_options.x_codec];
+		if (io_ptr->codec_compress)
+			r = z->write(io_ptr, NULL, 0) >= 0;
+		else
+			r = !z->read(io_ptr, NULL, 0);
+		z->end(io_ptr);
+		io_ptr->codec_init = false;
+	}
+	io_ptr->operation = IO_STORE;
+	return r;
+}
+
+extern void io_compression_resume(IO_HANDLE ptr)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , (void)NULL;
+	if (io_ptr->operation != IO_STORE)
+		return;
+	/*
+	 * a new compressed stream (or chunk) starts with the next
+	 * read/write
+	 */
+	if (io_ptr->chunk && io_ptr->chunk->write && io_ptr->chunk->data_length)
+		chunk_seal(io_ptr, 0);
+	io_ptr->operation = IO_COMPRESS;
+	io_ptr->eof = EOF_NO;
+	return;
+}
+
+extern io_codec_e io_codec_from_name(const char *n)
+{
+	for (io_codec_e c = CODEC_XZ; c < CODEC_UNKNOWN; c++)
+		if (!strcasecmp(n, CODECS[c].name))
+			return c;
+	return CODEC_UNKNOWN;
+}
+
+extern const char *io_codec_name(io_codec_e c)
+{
+	return c < CODEC_UNKNOWN ? CODECS[c].name : NULL;
+}
+
+extern bool io_codec_available(io_codec_e c)
+{
+	return c < CODEC_UNKNOWN && CODECS[c].compress;
+}
+
+extern uint8_t io_codec_level(io_codec_e c, int l)
+{
+	if (c >= CODEC_UNKNOWN)
+		return 0;
+	if (l < 0)
+		return CODECS[c].level;
+	return l > CODECS[c].maximum ? CODECS[c].maximum : l;
+}
+
+extern bool io_direct_init(IO_HANDLE ptr)
 {
 	io_private_t *io_ptr = ptr;
 	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , false;
+	if (io_ptr->buffer_direct)
+		return true;
+#if defined O_DIRECT
+	/*
+	 * only regular files, and only before anything else has been set
+	 * up to use the file; direct IO has to start at an aligned offset
+	 * too (usually the beginning)
+	 */
+	struct stat s;
+	if (io_ptr->stage || io_ptr->uring || io_ptr->map || fstat(io_ptr->fd, &s) || !S_ISREG(s.st_mode) || lseek(io_ptr->fd, 0, SEEK_CUR) % DIRECT_ALIGN)
+		return errno = ENOTSUP , false;
+	int f = fcntl(io_ptr->fd, F_GETFL);
+	if (f < 0 || fcntl(io_ptr->fd, F_SETFL, f | O_DIRECT) < 0)
+		return false; /* not supported by the file system */
+	io_ptr->direct_write = (f & O_ACCMODE) != O_RDONLY;
+	if (!(io_ptr->buffer_direct = calloc(1, sizeof( buffer_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( buffer_t ));
+	io_ptr->buffer_direct->block = DIRECT_BUFFER_SIZE;
+	io_ptr->buffer_direct->count = 1;
+	if (posix_memalign((void **)&io_ptr->buffer_direct->stream, DIRECT_ALIGN, io_ptr->buffer_direct->block))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, io_ptr->buffer_direct->block);
+	return true;
+#elif defined F_NOCACHE
+	/*
+	 * there’s no need for any alignment, the page cache just isn’t
+	 * used for this file
+	 */
+	return fcntl(io_ptr->fd, F_NOCACHE, 1) != -1;
+#else
+	return errno = ENOTSUP , false;
+#endif
+}
+
+extern void io_stats_init(IO_HANDLE ptr, io_stats_t *s)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr)
 		return errno = EBADF , (void)NULL;
-	io_ptr->operation = IO_LZMA;
-	io_ptr->lzma_init = false;
+	io_ptr->stats_total = s;
+	return;
+}
+
+extern void io_stats_collect(IO_HANDLE ptr, io_stats_t *s)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr)
+		return;
+	io_stats_add(s, &io_ptr->stats);
+	memset(&io_ptr->stats, 0x00, sizeof io_ptr->stats);
+	return;
+}
+
+extern void io_stats_add(io_stats_t *s, const io_stats_t *x)
+{
+	for (io_stat_e i = IO_STAT_READ; i < IO_STATS; i++)
+	{
+		s->stage[i].bytes    += x->stage[i].bytes;
+		s->stage[i].calls    += x->stage[i].calls;
+		s->stage[i].time     += x->stage[i].time;
+		s->stage[i].syscalls += x->stage[i].syscalls;
+	}
 	return;
 }
 
+extern const char *io_stat_name(io_stat_e s)
+{
+	return s < IO_STATS ? STAT_NAMES[s] : NULL;
+}
+
 extern void io_correction_init(IO_HANDLE ptr)
 {
 	io_private_t *io_ptr = ptr;
 	if (!io_ptr || io_ptr->fd < 0)
 		return errno = EBADF , (void)NULL;
 	io_ptr->ecc_init = true;
-	io_ptr->buffer_ecc = malloc(sizeof( buffer_t ));
+	io_ptr->ecc_start = io_ptr->position;
+	if (!(io_ptr->buffer_ecc = malloc(sizeof( buffer_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( buffer_t ));
 	io_ptr->buffer_ecc->block = ECC_PAYLOAD;
-	io_ptr->buffer_ecc->stream = calloc(ECC_CAPACITY, sizeof( uint8_t ));
+	io_ptr->buffer_ecc->count = 1;
+	if (!(io_ptr->buffer_ecc->stream = calloc(ECC_CAPACITY, sizeof( uint8_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, ECC_CAPACITY * sizeof( uint8_t ));
 	for (unsigned i = 0; i < OFFSET_SLOTS; i++)
 		io_ptr->buffer_ecc->offset[i] = 0;
+	/*
+	 * encoded frames (each is a length byte followed by the encoded
+	 * data) are read/written many at a time
+	 *   0: length of data in the buffer
+	 *   1: offset of the next frame to decode (when reading)
+	 */
+	if (!(io_ptr->buffer_frames = malloc(sizeof( buffer_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( buffer_t ));
+	io_ptr->buffer_frames->block = ECC_FRAME;
+	io_ptr->buffer_frames->count = ECC_FRAMES;
+	if (!(io_ptr->buffer_frames->stream = calloc(ECC_FRAMES, ECC_FRAME)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, ECC_FRAMES * ECC_FRAME);
+	for (unsigned i = 0; i < OFFSET_SLOTS; i++)
+		io_ptr->buffer_frames->offset[i] = 0;
+	return;
+}
+
+extern void io_pipeline_init(IO_HANDLE ptr, bool w)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , (void)NULL;
+	if (io_ptr->stage)
+		return;
+	if (!(io_ptr->stage = calloc(1, sizeof( io_stage_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( io_stage_t ));
+	io_ptr->stage->ring = ring_init(PIPELINE_DEPTH, PIPELINE_BLOCK);
+	io_ptr->stage->write = w;
+	/*
+	 * several writes can then be in flight at once, rather than the
+	 * stage waiting on each one in turn
+	 */
+	if (w && !io_ptr->buffer_direct)
+		io_ptr->uring = uring_init(io_ptr->fd, URING_DEPTH, URING_BLOCK);
+	if (pthread_create(&io_ptr->stage->thread, NULL, w ? pipe_writer : pipe_reader, io_ptr))
+	{
+		/*
+		 * carry on without it; everything will just happen on the
+		 * calling thread, as it would have done anyway
+		 */
+		ring_deinit(io_ptr->stage->ring);
+		free(io_ptr->stage);
+		io_ptr->stage = NULL;
+	}
 	return;
 }
 
@@ -481,21 +1207,21 @@ extern ssize_t io_write(IO_HANDLE f, const void *d, size_t l)
 	if (!io_ptr || io_ptr->fd < 0)
 		return errno = EBADF , -1;
 
-	if (io_ptr->hash_init)
-		gcry_md_write(io_ptr->hash_handle, d, l);
-	if (io_ptr->mac_init)
-		gcry_mac_write(io_ptr->mac_handle, d, l);
+	plain_digest(io_ptr, d, l);
 
+	if (io_ptr->chunk)
+		return chunk_write(io_ptr, d, l);
 	switch (io_ptr->operation)
 	{
-		case IO_LZMA:
-			if (!io_ptr->lzma_init)
-				io_do_compress(io_ptr);
-			return lzma_write(io_ptr, d, l);
+		case IO_COMPRESS:
+			if (!io_ptr->codec_init && !codec_init(io_ptr, true))
+				return -1;
+			return CODECS[io_ptr->codec_options.x_codec].write(io_ptr, d, l);
+		case IO_STORE:
 		case IO_ENCRYPT:
 			return enc_write(io_ptr, d, l);
 		case IO_DEFAULT:
-			return ecc_write(io_ptr, d, l);
+			return pipe_write(io_ptr, d, l);
 	}
 	errno = EINVAL;
 	return -1;
@@ -508,28 +1234,32 @@ extern ssize_t io_read(IO_HANDLE f, void *d, size_t l)
 		return errno = EBADF , -1;
 
 	ssize_t r = 0;
-	switch (io_ptr->operation)
+	if (io_ptr->chunk)
+		r = chunk_read(io_ptr, d, l);
+	else switch (io_ptr->operation)
 	{
-		case IO_LZMA:
-			if (!io_ptr->lzma_init)
-				io_do_decompress(io_ptr);
-			r = lzma_read(io_ptr, d, l);
+		case IO_COMPRESS:
+			if (!io_ptr->codec_init && !codec_init(io_ptr, false))
+				r = -1;
+			else
+				r = CODECS[io_ptr->codec_options.x_codec].read(io_ptr, d, l);
+			break;
+		case IO_STORE:
+			r = store_read(io_ptr, d, l);
 			break;
 		case IO_ENCRYPT:
 			r = enc_read(io_ptr, d, l);
 			break;
 		case IO_DEFAULT:
-			r = ecc_read(io_ptr, d, l);
+			r = pipe_read(io_ptr, d, l);
 			break;
 		default:
 			errno = EINVAL;
 			r = -1;
 			break;
 	}
-	if (r >= 0 && io_ptr->hash_init)
-		gcry_md_write(io_ptr->hash_handle, d, r);
-	if (r >= 0 && io_ptr->mac_init)
-		gcry_mac_write(io_ptr->mac_handle, d, r);
+	if (r >= 0)
+		plain_digest(io_ptr, d, r);
 	return r;
 }
 
@@ -539,58 +1269,241 @@ extern int io_sync(IO_HANDLE ptr)
 	if (!io_ptr || io_ptr->fd < 0)
 		return errno = EBADF , -1;
 
+	if (io_ptr->chunk)
+		return chunk_sync(io_ptr);
 	switch (io_ptr->operation)
 	{
-		case IO_LZMA:
-			return lzma_sync(io_ptr);
+		case IO_COMPRESS:
+			return codec_sync(io_ptr);
+		case IO_STORE:
 		case IO_ENCRYPT:
 			return enc_sync(io_ptr);
 		case IO_DEFAULT:
-			return ecc_sync(io_ptr);
+			return pipe_sync(io_ptr);
 	}
 	return errno = EINVAL , -1;
 }
 
-extern off_t io_seek(IO_HANDLE ptr, off_t o, int w)
+extern ssize_t io_map(IO_HANDLE ptr, const void **d, size_t l)
 {
 	io_private_t *io_ptr = ptr;
 	if (!io_ptr || io_ptr->fd < 0)
 		return errno = EBADF , -1;
-	return lseek(io_ptr->fd, o, w);
-}
-
-static ssize_t lzma_write(io_private_t *c, const void *d, size_t l)
+#ifndef _WIN32
+	if (!io_ptr->map)
+	{
+		struct stat s;
+		if (io_ptr->stage || io_ptr->buffer_direct || io_ptr->operation != IO_DEFAULT || fstat(io_ptr->fd, &s) || !S_ISREG(s.st_mode))
+			return errno = ENOTSUP , -1;
+		off_t o = lseek(io_ptr->fd, 0, SEEK_CUR);
+		if (o < 0 || o >= s.st_size)
+			return 0;
+		void *m = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, io_ptr->fd, 0);
+		if (m == MAP_FAILED)
+			return errno = ENOTSUP , -1;
+		io_ptr->map = m;
+		io_ptr->map_length = s.st_size;
+		if (!map_guard(io_ptr))
+		{
+			munmap(m, s.st_size);
+			io_ptr->map = NULL;
+			return errno = ENOTSUP , -1;
+		}
+		/*
+		 * the file is only going to be read the once, from start to
+		 * finish, so the kernel can read ahead further than usual and
+		 * drop the pages that have already been used
+		 */
+		posix_madvise(m, s.st_size, POSIX_MADV_SEQUENTIAL);
+		io_ptr->map_offset = o;
+		io_ptr->map_advised = o;
+	}
+	/*
+	 * anything read since the file was truncated is just zeros (see
+	 * map_bus() below); either way, once the caller comes back for
+	 * more than there is it’s done with the map, and so the SIGBUS
+	 * handler isn’t needed for this file any more
+	 */
+	if (io_ptr->map_truncated)
+		return map_unguard(io_ptr) , errno = EIO , -1;
+	if (io_ptr->map_offset >= io_ptr->map_length)
+		return map_unguard(io_ptr) , 0;
+	if (l > io_ptr->map_length - io_ptr->map_offset)
+		l = io_ptr->map_length - io_ptr->map_offset;
+	if (io_ptr->map_offset + l > io_ptr->map_advised)
+	{
+		/*
+		 * keep the read ahead well ahead of where we are, so that the
+		 * pages are there by the time they’re needed
+		 */
+		size_t a = io_ptr->map_offset + l + MAP_READ_AHEAD - io_ptr->map_advised;
+		if (a > io_ptr->map_length - io_ptr->map_advised)
+			a = io_ptr->map_length - io_ptr->map_advised;
+		size_t p = io_ptr->map_advised % sysconf(_SC_PAGESIZE);
+		posix_madvise(io_ptr->map + io_ptr->map_advised - p, a + p, POSIX_MADV_WILLNEED);
+		io_ptr->map_advised += a;
+	}
+	*d = io_ptr->map + io_ptr->map_offset;
+	io_ptr->map_offset += l;
+	io_ptr->stats.stage[IO_STAT_READ].bytes += l;
+	io_ptr->stats.stage[IO_STAT_READ].calls++;
+	return l;
+#else
+	(void)d;
+	(void)l;
+	return errno = ENOTSUP , -1;
+#endif
+}
+
+extern off_t io_seek(IO_HANDLE ptr, off_t o, int w)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , -1;
+	if (io_ptr->stage)
+		return errno = ESPIPE , -1;
+	if (io_ptr->buffer_direct)
+	{
+		/*
+		 * whatever is in the buffer is either written out first, or
+		 * (when reading) thrown away
+		 */
+		buffer_t *b = io_ptr->buffer_direct;
+		if (io_ptr->direct_write)
+			direct_flush(io_ptr);
+		else if (w == SEEK_CUR)
+			o -= b->offset[0] - b->offset[1];
+		b->offset[0] = 0;
+		b->offset[1] = 0;
+	}
+	return lseek(io_ptr->fd, o, w);
+}
+
+extern ssize_t io_chunk_read(IO_HANDLE ptr, void *d, size_t l, uint64_t o)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , -1;
+	io_chunk_t *c = io_ptr->chunk;
+	if (!c || c->write)
+		return errno = ENOTSUP , -1;
+	if (io_ptr->stage)
+		return errno = ESPIPE , -1;
+	if (!c->index && chunk_index(io_ptr) < 0)
+		return -1;
+	size_t r = 0;
+	while (r < l)
+	{
+		uint64_t p = o + r;
+		if (p < c->start || p >= c->start + c->data_length)
+		{
+			/*
+			 * find the chunk with the data in it; the last entry in
+			 * the index is where the data ends
+			 */
+			size_t lo = 0;
+			size_t hi = c->count - 1;
+			if (p >= c->index[hi].plain)
+				break;
+			while (hi - lo > 1)
+			{
+				size_t m = lo + (hi - lo) / 2;
+				if (c->index[m].plain <= p)
+					lo = m;
+				else
+					hi = m;
+			}
+			if (stream_seek(io_ptr, c->index[lo].offset) < 0)
+				return -1;
+			c->number = lo;
+			c->start = c->index[lo].plain;
+			int x = chunk_load(io_ptr, CHUNK_SIZE);
+			if (x < 0)
+				return -1;
+			if ((x & CHUNK_INDEX) || c->start + c->data_length != c->index[lo + 1].plain)
+				return errno = EIO , -1;
+		}
+		size_t n = c->start + c->data_length - p;
+		if (n > l - r)
+			n = l - r;
+		memcpy((uint8_t *)d + r, c->data + (p - c->start), n);
+		r += n;
+	}
+	return r;
+}
+
+extern uint64_t io_chunk_position(IO_HANDLE ptr)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , 0;
+	io_chunk_t *c = io_ptr->chunk;
+	if (!c)
+		return 0;
+	return c->start + (c->write ? c->data_length : c->data_offset);
+}
+
+extern void io_chunk_bookmark_set(IO_HANDLE ptr, uint64_t o)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , (void)NULL;
+	if (io_ptr->chunk && io_ptr->chunk->write)
+		io_ptr->chunk->bookmark = o;
+	return;
+}
+
+extern uint64_t io_chunk_bookmark(IO_HANDLE ptr)
+{
+	io_private_t *io_ptr = ptr;
+	if (!io_ptr || io_ptr->fd < 0)
+		return errno = EBADF , 0;
+	io_chunk_t *c = io_ptr->chunk;
+	if (!c || c->write)
+		return 0;
+	if (io_ptr->stage)
+		return errno = ESPIPE , 0;
+	if (!c->index && chunk_index(io_ptr) < 0)
+		return 0;
+	return c->bookmark;
+}
+
+static ssize_t lzma_write(io_private_t *c, const void *d, size_t l)
 {
 	lzma_action x = LZMA_RUN;
 	if (!d && !l)
 		x = LZMA_FINISH;
 	c->lzma_handle.next_in = d;
 	c->lzma_handle.avail_in = l;
-
-	uint8_t stream = 0x00;
-	c->lzma_handle.next_out = &stream;
-	c->lzma_handle.avail_out = sizeof stream;
+	/*
+	 * compressed data is collected in the buffer and only handed on to
+	 * be encrypted once the buffer is full (or there is no more)
+	 */
+	buffer_t *b = c->buffer_codec;
 	do
 	{
-		bool lzf = false;
-		lzma_ret lr;
-		switch ((lr = lzma_code(&c->lzma_handle, x)))
+		uint64_t t = stat_clock();
+		size_t n = c->lzma_handle.avail_in;
+		lzma_ret lr = lzma_code(&c->lzma_handle, x);
+		stat_count(c, IO_STAT_CODEC, t, n - c->lzma_handle.avail_in);
+		switch (lr)
 		{
 			case LZMA_STREAM_END:
-				lzf = true;
 			case LZMA_OK:
 				break;
 			default:
 				return -1;
 		}
-		if (c->lzma_handle.avail_out == 0)
+		if (c->lzma_handle.avail_out == 0 || lr == LZMA_STREAM_END)
 		{
-			enc_write(c, &stream, sizeof stream);
-			c->lzma_handle.next_out = &stream;
-			c->lzma_handle.avail_out = sizeof stream;
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_write(c, b->stream, b->block - c->lzma_handle.avail_out)) < 0)
+				return e;
+			c->lzma_handle.next_out = b->stream;
+			c->lzma_handle.avail_out = b->block;
 		}
-		if (lzf && c->lzma_handle.avail_in == 0 && c->lzma_handle.avail_out == sizeof stream)
-			return l;
+		if (lr == LZMA_STREAM_END)
+			break;
 	}
 	while (x == LZMA_FINISH || c->lzma_handle.avail_in > 0);
 
@@ -600,6 +1513,17 @@ static ssize_t lzma_write(io_private_t *c, const void *d, size_t l)
 static ssize_t lzma_read(io_private_t *c, void *d, size_t l)
 {
 	lzma_action a = LZMA_RUN;
+	/*
+	 * reading nothing (NULL) is done to find the end of the stream,
+	 * after which there shouldn’t be any data left
+	 */
+	uint8_t x;
+	bool skip = !d;
+	if (skip)
+	{
+		d = &x;
+		l = sizeof x;
+	}
 
 	c->lzma_handle.next_out = d;
 	c->lzma_handle.avail_out = l;
@@ -607,275 +1531,1889 @@ static ssize_t lzma_read(io_private_t *c, void *d, size_t l)
 	if (c->eof == EOF_YES)
 		return 0;
 	else if (c->eof == EOF_MAYBE)
-	{
 		a = LZMA_FINISH;
-		goto proc_remain;
-	}
 
+	buffer_t *b = c->buffer_codec;
 	while (true)
 	{
-		if (c->lzma_handle.avail_in == 0)
+		if (c->lzma_handle.avail_in == 0 && a == LZMA_RUN)
 		{
-			c->lzma_handle.next_in = &c->byte;
-			switch (enc_read(c, &c->byte, sizeof c->byte))
+			/*
+			 * read (and decrypt) as much as will fit in the buffer; any
+			 * left over after the end of the compressed stream is just
+			 * the padding of the final cipher block
+			 */
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_read(c, b->stream, b->block)) < 0)
+				return -1;
+			else if (!e)
 			{
-				case 0:
-					a = LZMA_FINISH;
-					break;
-				case 1:
-					c->lzma_handle.avail_in = 1;
-					break;
-				default:
-					return -1;
+				a = LZMA_FINISH;
+				c->eof = EOF_MAYBE;
 			}
+			c->lzma_handle.next_in = b->stream;
+			c->lzma_handle.avail_in = e;
 		}
-proc_remain:;
-		lzma_ret lr;
-		switch ((lr = lzma_code(&c->lzma_handle, a)))
+		uint64_t t = stat_clock();
+		size_t n = c->lzma_handle.avail_out;
+		lzma_ret lr = lzma_code(&c->lzma_handle, a);
+		stat_count(c, IO_STAT_CODEC, t, n - c->lzma_handle.avail_out);
+		switch (lr)
 		{
 			case LZMA_STREAM_END:
-				c->eof = EOF_MAYBE;
+				c->eof = EOF_YES;
+				/*
+				 * keep track of whatever’s left, in case compression
+				 * is paused and the data after the stream is needed
+				 */
+				b->offset[0] = c->lzma_handle.next_in - b->stream;
+				b->offset[1] = b->offset[0] + c->lzma_handle.avail_in;
+				if (skip)
+					return c->lzma_handle.avail_out ? 0 : (errno = EIO , -1);
+				return l - c->lzma_handle.avail_out;
 			case LZMA_OK:
 				break;
 			default:
 				return (ssize_t)-lr;
 		}
 
-		if (c->lzma_handle.avail_out == 0 || c->eof != EOF_NO)
-			return l - c->lzma_handle.avail_out;
+		if (c->lzma_handle.avail_out == 0)
+			return skip ? (errno = EIO , -1) : (ssize_t)l;
 	}
 }
 
-static int lzma_sync(io_private_t *c)
+static void lzma_finish(io_private_t *c)
 {
-	lzma_write(c, NULL, 0);
-	return enc_sync(c);
+	lzma_end(&c->lzma_handle);
+	return;
 }
 
-static ssize_t enc_write(io_private_t *f, const void *d, size_t l)
+#ifdef HAVE_ZSTD
+static ssize_t zstd_write(io_private_t *c, const void *d, size_t l)
 {
-	size_t remainder[2] = { l, f->buffer_crypt->block - f->buffer_crypt->offset[0] }; /* 0: length of data yet to buffer (from d); 1: available space in output buffer (stream) */
+	ZSTD_EndDirective x = ZSTD_e_continue;
 	if (!d && !l)
+		x = ZSTD_e_end;
+	ZSTD_inBuffer in = { d, l, 0 };
+	/*
+	 * as with xz, compressed data is only handed on to be encrypted
+	 * once the buffer is full (or there is no more)
+	 */
+	buffer_t *b = c->buffer_codec;
+	while (true)
 	{
-#if defined __DEBUG__ && !defined __DEBUG_WITH_ENCRYPTION__
-		memset(f->buffer_crypt->stream + f->buffer_crypt->offset[0], 0x00, remainder[1]);
-#else
-		gcry_create_nonce(f->buffer_crypt->stream + f->buffer_crypt->offset[0], remainder[1]);
-		gcry_cipher_final(f->cipher_handle);
-		gcry_cipher_encrypt(f->cipher_handle, f->buffer_crypt->stream, f->buffer_crypt->block, NULL, 0);
-#endif
-		ssize_t e = ecc_write(f, f->buffer_crypt->stream, f->buffer_crypt->block);
-		ecc_sync(f);
-		f->buffer_crypt->block = 0;
-		gcry_free(f->buffer_crypt->stream);
-		f->buffer_crypt->stream = NULL;
-		memset(f->buffer_crypt->offset, 0x00, sizeof f->buffer_crypt->offset);
-		return e;
+		ZSTD_outBuffer out = { b->stream, b->block, b->offset[0] };
+		uint64_t t = stat_clock();
+		size_t n = in.pos;
+		size_t r = ZSTD_compressStream2(c->codec_handle, &out, &in, x);
+		stat_count(c, IO_STAT_CODEC, t, in.pos - n);
+		if (ZSTD_isError(r))
+			return errno = EIO , -1;
+		b->offset[0] = out.pos;
+		bool done = x == ZSTD_e_end ? !r : in.pos == in.size;
+		if (out.pos == out.size || (done && x == ZSTD_e_end))
+		{
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_write(c, b->stream, out.pos)) < 0)
+				return e;
+			b->offset[0] = 0;
+		}
+		if (done)
+			break;
 	}
+	return l;
+}
 
-	f->buffer_crypt->offset[1] = 0;
-	while (remainder[0])
+static ssize_t zstd_read(io_private_t *c, void *d, size_t l)
+{
+	if (c->eof == EOF_YES)
+		return 0;
+
+	/*
+	 * as with xz, reading nothing finds the end of the frame
+	 */
+	uint8_t x;
+	bool skip = !d;
+	buffer_t *b = c->buffer_codec;
+	ZSTD_outBuffer out = { skip ? &x : d, skip ? sizeof x : l, 0 };
+	while (out.pos < out.size)
 	{
-		if (remainder[0] < remainder[1])
+		if (b->offset[0] == b->offset[1])
 		{
-			memcpy(f->buffer_crypt->stream + f->buffer_crypt->offset[0], (uint8_t *)d + f->buffer_crypt->offset[1], remainder[0]);
-			f->buffer_crypt->offset[0] += remainder[0];
-			return l;
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_read(c, b->stream, b->block)) < 0)
+				return -1;
+			else if (!e)
+				return c->eof = EOF_YES , errno = EIO , -1;
+			b->offset[0] = 0;
+			b->offset[1] = e;
+		}
+		ZSTD_inBuffer in = { b->stream, b->offset[1], b->offset[0] };
+		uint64_t t = stat_clock();
+		size_t n = out.pos;
+		size_t r = ZSTD_decompressStream(c->codec_handle, &out, &in);
+		stat_count(c, IO_STAT_CODEC, t, out.pos - n);
+		if (ZSTD_isError(r))
+			return errno = EIO , -1;
+		b->offset[0] = in.pos;
+		if (!r)
+		{
+			/*
+			 * the end of the frame; anything left is just the padding
+			 * of the final cipher block
+			 */
+			c->eof = EOF_YES;
+			break;
 		}
-		memcpy(f->buffer_crypt->stream + f->buffer_crypt->offset[0], (uint8_t *)d + f->buffer_crypt->offset[1], remainder[1]);
-#if !defined __DEBUG__ || defined __DEBUG_WITH_ENCRYPTION__
-		gcry_cipher_encrypt(f->cipher_handle, f->buffer_crypt->stream, f->buffer_crypt->block, NULL, 0);
-#endif
-		ssize_t e = EXIT_SUCCESS;
-		if ((e = ecc_write(f, f->buffer_crypt->stream, f->buffer_crypt->block)) < 0)
-			return e;
-		f->buffer_crypt->offset[0] = 0;
-		memset(f->buffer_crypt->stream, 0x00, f->buffer_crypt->block);
-		f->buffer_crypt->offset[1] += remainder[1];
-		remainder[0] -= remainder[1];
-		remainder[1] = f->buffer_crypt->block - f->buffer_crypt->offset[0];
 	}
-	return l;
+	if (skip && out.pos)
+		return errno = EIO , -1;
+	return out.pos;
 }
 
-static ssize_t enc_read(io_private_t *f, void *d, size_t l)
+static void zstd_finish(io_private_t *c)
 {
-	f->buffer_crypt->offset[1] = l;
-	f->buffer_crypt->offset[2] = 0;
-	while (true)
+	if (c->codec_compress)
+		ZSTD_freeCCtx(c->codec_handle);
+	else
+		ZSTD_freeDCtx(c->codec_handle);
+	c->codec_handle = NULL;
+	return;
+}
+#endif
+
+#ifdef HAVE_LZ4
+static ssize_t lz4_write(io_private_t *c, const void *d, size_t l)
+{
+	buffer_t *b = c->buffer_codec;
+	bool x = !d && !l;
+	/*
+	 * LZ4 needs to know there’s enough space for the worst case before
+	 * it’s given any data, so hand it small chunks and pass on what’s
+	 * in the buffer whenever the next chunk might not fit
+	 */
+	for (size_t o = 0; o < l || x; )
 	{
-		if (f->buffer_crypt->offset[0] >= f->buffer_crypt->offset[1])
+		size_t n = l - o > LZ4_CHUNK ? LZ4_CHUNK : l - o;
+		if (b->block - b->offset[0] < LZ4F_compressBound(n, NULL))
+		{
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_write(c, b->stream, b->offset[0])) < 0)
+				return e;
+			b->offset[0] = 0;
+		}
+		size_t r;
+		uint64_t t = stat_clock();
+		if (x)
+			r = LZ4F_compressEnd(c->codec_handle, b->stream + b->offset[0], b->block - b->offset[0], NULL);
+		else
+			r = LZ4F_compressUpdate(c->codec_handle, b->stream + b->offset[0], b->block - b->offset[0], (const uint8_t *)d + o, n, NULL);
+		stat_count(c, IO_STAT_CODEC, t, n);
+		if (LZ4F_isError(r))
+			return errno = EIO , -1;
+		b->offset[0] += r;
+		o += n;
+		if (x)
 		{
-			memcpy((uint8_t *)d + f->buffer_crypt->offset[2], f->buffer_crypt->stream, f->buffer_crypt->offset[1]);
-			f->buffer_crypt->offset[0] -= f->buffer_crypt->offset[1];
-			uint8_t *x = gcry_calloc_secure(f->buffer_crypt->block, sizeof( uint8_t ));
-			if (!x)
-				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, f->buffer_crypt->block * sizeof( uint8_t ));
-			memcpy(x, f->buffer_crypt->stream + f->buffer_crypt->offset[1], f->buffer_crypt->offset[0]);
-			memset(f->buffer_crypt->stream, 0x00, f->buffer_crypt->block);
-			memcpy(f->buffer_crypt->stream, x, f->buffer_crypt->offset[0]);
-			gcry_free(x);
-			return l;
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_write(c, b->stream, b->offset[0])) < 0)
+				return e;
+			b->offset[0] = 0;
+			break;
 		}
+	}
+	return l;
+}
 
-		memcpy((uint8_t *)d + f->buffer_crypt->offset[2], f->buffer_crypt->stream, f->buffer_crypt->offset[0]);
-		f->buffer_crypt->offset[2] += f->buffer_crypt->offset[0];
-		f->buffer_crypt->offset[1] -= f->buffer_crypt->offset[0];
-		f->buffer_crypt->offset[0] = 0;
+static ssize_t lz4_read(io_private_t *c, void *d, size_t l)
+{
+	if (c->eof == EOF_YES)
+		return 0;
 
-		ssize_t e = EXIT_SUCCESS;
-		if ((e = ecc_read(f, f->buffer_crypt->stream, f->buffer_crypt->block)) < 0)
-			return e;
-#if !defined __DEBUG__ || defined __DEBUG_WITH_ENCRYPTION__
-		gcry_cipher_decrypt(f->cipher_handle, f->buffer_crypt->stream, f->buffer_crypt->block, NULL, 0);
-#endif
-		f->buffer_crypt->offset[0] = f->buffer_crypt->block;
+	uint8_t x;
+	bool skip = !d;
+	if (skip)
+	{
+		d = &x;
+		l = sizeof x;
+	}
+	buffer_t *b = c->buffer_codec;
+	size_t o = 0;
+	while (o < l)
+	{
+		if (b->offset[0] == b->offset[1])
+		{
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = enc_read(c, b->stream, b->block)) < 0)
+				return -1;
+			else if (!e)
+				return c->eof = EOF_YES , errno = EIO , -1;
+			b->offset[0] = 0;
+			b->offset[1] = e;
+		}
+		size_t dn = l - o;
+		size_t sn = b->offset[1] - b->offset[0];
+		uint64_t t = stat_clock();
+		size_t r = LZ4F_decompress(c->codec_handle, (uint8_t *)d + o, &dn, b->stream + b->offset[0], &sn, NULL);
+		stat_count(c, IO_STAT_CODEC, t, dn);
+		if (LZ4F_isError(r))
+			return errno = EIO , -1;
+		o += dn;
+		b->offset[0] += sn;
+		if (!r)
+		{
+			c->eof = EOF_YES;
+			break;
+		}
 	}
+	if (skip && o)
+		return errno = EIO , -1;
+	return o;
 }
 
-static int enc_sync(io_private_t *f)
+static void lz4_finish(io_private_t *c)
 {
-	enc_write(f, NULL, 0);
-	return 0;
+	if (c->codec_compress)
+		LZ4F_freeCompressionContext(c->codec_handle);
+	else
+		LZ4F_freeDecompressionContext(c->codec_handle);
+	c->codec_handle = NULL;
+	return;
 }
+#endif
 
-static ssize_t ecc_write(io_private_t *f, const void *d, size_t l)
+static int codec_sync(io_private_t *c)
 {
-	if (!f->ecc_init)
+	if (c->codec_init)
+		CODECS[c->codec_options.x_codec].write(c, NULL, 0);
+	return enc_sync(c);
+}
+
+static ssize_t store_read(io_private_t *f, void *d, size_t l)
+{
+	/*
+	 * start with anything that was read after the end of the last
+	 * compressed stream
+	 */
+	buffer_t *b = f->buffer_codec;
+	size_t o = 0;
+	if (b && b->offset[0] < b->offset[1])
 	{
-		if (!d && !l)
-			return fsync(f->fd) , 0;
-		else
-			return write(f->fd, d, l);
+		o = b->offset[1] - b->offset[0] < l ? b->offset[1] - b->offset[0] : l;
+		memcpy(d, b->stream + b->offset[0], o);
+		b->offset[0] += o;
 	}
+	if (o == l)
+		return o;
+	ssize_t e = enc_read(f, (uint8_t *)d + o, l - o);
+	if (e < 0)
+		return -1;
+	return o + e;
+}
 
-	size_t remainder[2] = { l, f->buffer_ecc->block - f->buffer_ecc->offset[0] }; /* 0: length of data yet to buffer (from d); 1: available space in output buffer (stream) */
+static ssize_t enc_write(io_private_t *f, const void *d, size_t l)
+{
+	if (f->chunk)
+	{
+		/*
+		 * a chunk is only encrypted once it’s complete, until then
+		 * its (possibly compressed) data is just collected
+		 */
+		io_chunk_t *c = f->chunk;
+		chunk_reserve(c, c->length + l);
+		memcpy(c->stream + c->length, d, l);
+		c->length += l;
+		return l;
+	}
+	buffer_t *b = f->buffer_crypt;
+	size_t size = b->block * b->count;
 	if (!d && !l)
 	{
-		uint8_t tmp[ECC_CAPACITY] = { 0x0 };
-		ecc_encode(f->buffer_ecc->stream, tmp);
-		memcpy(f->buffer_ecc->stream, tmp, sizeof tmp);
-
-		uint8_t z = (uint8_t)f->buffer_ecc->offset[0];
-		write(f->fd, &z, sizeof z);
-		write(f->fd, f->buffer_ecc->stream, ECC_OFFSET);
-		ssize_t e = write(f->fd, f->buffer_ecc->stream + ECC_OFFSET, ECC_PAYLOAD);
-
-		fsync(f->fd);
-		f->buffer_ecc->block = 0;
-		free(f->buffer_ecc->stream);
-		f->buffer_ecc->stream = NULL;
-		memset(f->buffer_ecc->offset, 0x00, sizeof f->buffer_ecc->offset);
+		/*
+		 * pad the final (partial) block; any whole blocks still in the
+		 * buffer are encrypted first, just as they would have been had
+		 * they been written out one at a time
+		 */
+		size_t whole = b->offset[0] - b->offset[0] % b->block;
+		size_t pad = b->block - b->offset[0] % b->block;
+#if defined __DEBUG__ && !defined __DEBUG_WITH_ENCRYPTION__
+		memset(b->stream + b->offset[0], 0x00, pad);
+#else
+		gcry_create_nonce(b->stream + b->offset[0], pad);
+		if (whole)
+			enc_crypt(f, true, b->stream, NULL, whole);
+		uint64_t t = stat_clock();
+		gcry_cipher_final(f->cipher_handle);
+		gcry_cipher_encrypt(f->cipher_handle, b->stream + whole, b->block, NULL, 0);
+		stat_count(f, IO_STAT_CIPHER, t, b->block);
+#endif
+		ssize_t e = pipe_write(f, b->stream, whole + b->block);
+		pipe_sync(f);
+		b->block = 0;
+		b->count = 0;
+		gcry_free(b->stream);
+		b->stream = NULL;
+		memset(b->offset, 0x00, sizeof b->offset);
 		return e;
 	}
 
-	f->buffer_ecc->offset[1] = 0;
-	while (remainder[0])
+	for (b->offset[1] = 0; b->offset[1] < l; )
 	{
-		if (remainder[0] < remainder[1])
+		const uint8_t *in = (const uint8_t *)d + b->offset[1];
+		size_t r = l - b->offset[1];
+		size_t n = (r < size ? r : size) / b->block * b->block;
+		if (!b->offset[0] && n)
 		{
-			memcpy(f->buffer_ecc->stream + f->buffer_ecc->offset[0], (uint8_t *)d + f->buffer_ecc->offset[1], remainder[0]);
-			f->buffer_ecc->offset[0] += remainder[0];
-			return l;
+			/*
+			 * nothing is buffered so encrypt as many whole blocks as
+			 * possible straight from the given data
+			 */
+			enc_crypt(f, true, b->stream, in, n);
+			b->offset[1] += n;
+		}
+		else
+		{
+			if ((n = size - b->offset[0]) > r)
+				n = r;
+			memcpy(b->stream + b->offset[0], in, n);
+			b->offset[1] += n;
+			if ((b->offset[0] += n) < size)
+				continue;
+			enc_crypt(f, true, b->stream, NULL, size);
+			b->offset[0] = 0;
+			n = size;
 		}
-		memcpy(f->buffer_ecc->stream + f->buffer_ecc->offset[0], (uint8_t *)d + f->buffer_ecc->offset[1], remainder[1]);
-
-		uint8_t tmp[ECC_CAPACITY] = { 0x0 };
-		ecc_encode(f->buffer_ecc->stream, tmp);
-		memcpy(f->buffer_ecc->stream, tmp, sizeof tmp);
-
-		uint8_t z = ECC_PAYLOAD;
-		write(f->fd, &z, sizeof z);
 		ssize_t e = EXIT_SUCCESS;
-		if ((e = write(f->fd, f->buffer_ecc->stream, ECC_CAPACITY)) < 0)
+		if ((e = pipe_write(f, b->stream, n)) < 0)
 			return e;
-
-		f->buffer_ecc->offset[0] = 0;
-		memset(f->buffer_ecc->stream, 0x00, f->buffer_ecc->block);
-		f->buffer_ecc->offset[1] += remainder[1];
-		remainder[0] -= remainder[1];
-		remainder[1] = f->buffer_ecc->block - f->buffer_ecc->offset[0];
 	}
 	return l;
 }
 
-static ssize_t ecc_read(io_private_t *f, void *d, size_t l)
+static ssize_t enc_read(io_private_t *f, void *d, size_t l)
 {
-	if (!f->ecc_init)
-		return read(f->fd, d, l);
-
-	f->buffer_ecc->offset[1] = l;
-	f->buffer_ecc->offset[2] = 0;
-	while (true)
+	if (f->chunk)
 	{
-		if (f->buffer_ecc->offset[0] >= f->buffer_ecc->offset[1])
+		/*
+		 * only the (already decrypted) data of the current chunk
+		 */
+		io_chunk_t *c = f->chunk;
+		size_t n = l < c->length - c->offset ? l : c->length - c->offset;
+		memcpy(d, c->stream + c->offset, n);
+		c->offset += n;
+		return n;
+	}
+	buffer_t *b = f->buffer_crypt;
+	for (b->offset[2] = 0; b->offset[2] < l; )
+	{
+		if (!b->offset[0])
 		{
-			memcpy((uint8_t *)d + f->buffer_ecc->offset[2], f->buffer_ecc->stream, f->buffer_ecc->offset[1]);
-			f->buffer_ecc->offset[0] -= f->buffer_ecc->offset[1];
-			uint8_t *x = calloc(f->buffer_ecc->block, sizeof( uint8_t ));
-			if (!x)
-				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, f->buffer_ecc->block * sizeof( uint8_t ));
-			memcpy(x, f->buffer_ecc->stream + f->buffer_ecc->offset[1], f->buffer_ecc->offset[0]);
-			memset(f->buffer_ecc->stream, 0x00, f->buffer_ecc->block);
-			memcpy(f->buffer_ecc->stream, x, f->buffer_ecc->offset[0]);
-			free(x);
-			return l;
+			/*
+			 * refill the buffer; only whole blocks can be decrypted
+			 */
+			ssize_t e = EXIT_SUCCESS;
+			if ((e = pipe_read(f, b->stream, b->block * b->count)) < 0)
+				return e;
+			size_t n = e - e % b->block;
+			if (!n)
+				break;
+			enc_crypt(f, false, b->stream, NULL, n);
+			b->offset[0] = n;
+			b->offset[1] = 0;
 		}
-
-		memcpy((uint8_t *)d + f->buffer_ecc->offset[2], f->buffer_ecc->stream, f->buffer_ecc->offset[0]);
-		f->buffer_ecc->offset[2] += f->buffer_ecc->offset[0];
-		f->buffer_ecc->offset[1] -= f->buffer_ecc->offset[0];
-		f->buffer_ecc->offset[0] = 0;
-		memset(f->buffer_ecc->stream, 0x00, ECC_CAPACITY);
-
-		ssize_t e = EXIT_SUCCESS;
-		uint8_t z;
-		read(f->fd, &z, sizeof z);
-		if ((e = read(f->fd, f->buffer_ecc->stream, ECC_CAPACITY)) <= 0)
-			return e;
-
-		uint8_t tmp[ECC_CAPACITY] = { 0x0 };
-		int bo;
-		ecc_decode(f->buffer_ecc->stream, tmp, &bo);
-		if (bo >= 4)
-			return errno = EIO , -1;
-		memcpy(f->buffer_ecc->stream, tmp, z);
-
-		f->buffer_ecc->offset[0] = z;
+		size_t n = l - b->offset[2] < b->offset[0] ? l - b->offset[2] : b->offset[0];
+		memcpy((uint8_t *)d + b->offset[2], b->stream + b->offset[1], n);
+		b->offset[0] -= n;
+		b->offset[1] += n;
+		b->offset[2] += n;
 	}
+	return b->offset[2];
 }
 
-static int ecc_sync(io_private_t *f)
+static int enc_sync(io_private_t *f)
 {
-	ecc_write(f, NULL, 0);
+	enc_write(f, NULL, 0);
 	return 0;
 }
 
-static void io_do_compress(io_private_t *io_ptr)
+static void enc_crypt(io_private_t *f, bool e, uint8_t *out, const uint8_t *in, size_t l)
 {
-	lzma_stream l = LZMA_STREAM_INIT;
-	io_ptr->lzma_handle = l;
-
-	lzma_filter lzf[2];
-	lzma_options_lzma lzo;
-	lzma_lzma_preset(&lzo, LZMA_PRESET_DEFAULT);
-	lzf[0].id = LZMA_FILTER_LZMA2;
-	lzf[0].options = &lzo;
-	lzf[1].id = LZMA_VLI_UNKNOWN;
-	if (lzma_stream_encoder(&io_ptr->lzma_handle, lzf, LZMA_CHECK_NONE) != LZMA_OK)
+#if defined __DEBUG__ && !defined __DEBUG_WITH_ENCRYPTION__
+	if (in)
+		memmove(out, in, l);
+	(void)f;
+	(void)e;
+#else
+	/*
+	 * en/decrypt whole blocks, either on this thread or (if there is
+	 * enough data to make it worthwhile) split between the workers
+	 */
+	uint64_t t = stat_clock();
+	io_pool_t *p = f->pool;
+	if (!p || l < CIPHER_BUFFER_SIZE)
+	{
+		crypt_blocks(f->cipher_handle, f->cipher_mode, e, f->buffer_crypt->block, out, in, l);
+		if (p)
+			p->index += l / p->block;
+		stat_count(f, IO_STAT_CIPHER, t, l);
 		return;
-	io_ptr->lzma_init = true;
+	}
+	size_t blocks = l / p->block;
+	size_t share = (blocks / (p->count + 1) + (blocks % (p->count + 1) ? 1 : 0)) * p->block;
+
+	pthread_mutex_lock(&p->mutex);
+	for (size_t i = 0, o = share; i < p->count; i++, o += share)
+	{
+		io_worker_t *w = &p->workers[i];
+		w->out = out + o;
+		w->in = in ? in + o : NULL;
+		w->length = o < l ? (l - o < share ? l - o : share) : 0;
+		w->index = p->index + o / p->block;
+	}
+	p->encrypt = e;
+	p->pending = p->count;
+	p->job++;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->mutex);
+	/*
+	 * this thread takes the first share
+	 */
+	crypt_position(f->cipher_handle, p->mode, p->iv, p->block, p->index);
+	crypt_blocks(f->cipher_handle, p->mode, e, p->block, out, in, share);
+
+	pthread_mutex_lock(&p->mutex);
+	while (p->pending)
+		pthread_cond_wait(&p->done, &p->mutex);
+	pthread_mutex_unlock(&p->mutex);
+	/*
+	 * move the main handle on past everything the workers did
+	 */
+	p->index += blocks;
+	crypt_position(f->cipher_handle, p->mode, p->iv, p->block, p->index);
+	stat_count(f, IO_STAT_CIPHER, t, l);
+#endif
 	return;
 }
 
-static void io_do_decompress(io_private_t *io_ptr)
+static io_chunk_t *chunk_init(enum gcry_mac_algos a, enum gcry_md_algos h, const uint8_t *k, size_t l, const uint8_t *s, size_t n)
 {
-	lzma_stream l = LZMA_STREAM_INIT;
-	io_ptr->lzma_handle = l;
+	io_chunk_t *c = gcry_calloc_secure(1, sizeof( io_chunk_t ));
+	if (!c)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( io_chunk_t ));
+	if (gcry_mac_open(&c->mac_handle, a, GCRY_MAC_FLAG_SECURE, NULL) != GPG_ERR_NO_ERROR)
+		return gcry_free(c) , NULL;
+	/*
+	 * the tags have a key of their own, derived from the key of the MAC
+	 * for the whole stream
+	 */
+	size_t z = gcry_mac_get_algo_keylen(a);
+	uint8_t *key = gcry_malloc_secure(z);
+	if (!key)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+	gcry_kdf_derive(k, l, GCRY_KDF_PBKDF2, h, s, n, 1, z, key);
+	gcry_mac_setkey(c->mac_handle, key, z);
+	gcry_free(key);
+	const char *m = mac_name_from_id(a);
+	c->mac_iv = !strncmp("GMAC", m, strlen("GMAC")) || !strncmp("POLY1305", m, strlen("POLY1305"));
+	c->tag_length = gcry_mac_get_algo_maclen(a);
+	if (!(c->tag = gcry_malloc_secure(c->tag_length)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, c->tag_length);
+	return c;
+}
 
-	if (lzma_stream_decoder(&io_ptr->lzma_handle, UINT64_MAX, 0/*LZMA_CONCATENATED*/) != LZMA_OK)
-		return;
+static void chunk_deinit(io_chunk_t *c)
+{
+	gcry_mac_close(c->mac_handle);
+	if (c->stream)
+		gcry_free(c->stream);
+	if (c->plain)
+		gcry_free(c->plain);
+	if (c->nonce)
+		gcry_free(c->nonce);
+	gcry_free(c->tag);
+	free(c->index);
+	gcry_free(c);
+	return;
+}
 
-	io_ptr->lzma_init = true;
+static ssize_t chunk_write(io_private_t *f, const void *d, size_t l)
+{
+	io_chunk_t *c = f->chunk;
+	for (size_t i = 0; i < l; )
+	{
+		/*
+		 * a full chunk is only sealed once there’s more to write, so
+		 * the last chunk is never empty (unless everything is)
+		 */
+		if (c->data_length == CHUNK_SIZE && chunk_seal(f, 0) < 0)
+			return -1;
+		size_t n = l - i < CHUNK_SIZE - c->data_length ? l - i : CHUNK_SIZE - c->data_length;
+		ssize_t e = EXIT_SUCCESS;
+		if (f->operation != IO_COMPRESS)
+			e = enc_write(f, (const uint8_t *)d + i, n);
+		else if (!f->codec_init && !codec_init(f, true))
+			return -1;
+		else
+			e = CODECS[f->codec_options.x_codec].write(f, (const uint8_t *)d + i, n);
+		if (e < 0)
+			return e;
+		c->data_length += n;
+		i += n;
+	}
+	return l;
+}
+
+static ssize_t chunk_read(io_private_t *f, void *d, size_t l)
+{
+	io_chunk_t *c = f->chunk;
+	size_t r = 0;
+	while (r < l)
+	{
+		if (c->data_offset == c->data_length)
+		{
+			if (c->final)
+				break;
+			/*
+			 * the next chunk follows on from this one; the stream
+			 * can’t end before the final chunk
+			 */
+			c->start += c->data_length;
+			c->data_length = 0;
+			c->data_offset = 0;
+			int x = chunk_load(f, CHUNK_SIZE);
+			if (x < 0)
+				return -1;
+			if (x & CHUNK_INDEX)
+				return errno = EIO , -1;
+			continue;
+		}
+		size_t n = l - r < c->data_length - c->data_offset ? l - r : c->data_length - c->data_offset;
+		memcpy((uint8_t *)d + r, c->data + c->data_offset, n);
+		c->data_offset += n;
+		r += n;
+	}
+	return r;
+}
+
+static int chunk_sync(io_private_t *f)
+{
+	io_chunk_t *c = f->chunk;
+	if (chunk_seal(f, CHUNK_FINAL) < 0)
+		return -1;
+	/*
+	 * the index is where each chunk starts (in the plaintext and in the
+	 * stream); its last entry is where the plaintext ends and where the
+	 * index itself is; it’s followed by the bookmark (if there is one)
+	 */
+	uint64_t o = f->position;
+	uint64_t n = c->count;
+	chunk_record(c, c->start, o);
+	chunk_reserve(c, c->count * CHUNK_ENTRY + sizeof c->bookmark);
+	for (size_t i = 0; i < c->count; i++)
+	{
+		uint64_t x[2] = { htonll(c->index[i].plain), htonll(c->index[i].offset) };
+		memcpy(c->stream + i * CHUNK_ENTRY, x, sizeof x);
+	}
+	c->length = c->count * CHUNK_ENTRY;
+	if (c->bookmark)
+	{
+		uint64_t x = htonll(c->bookmark);
+		memcpy(c->stream + c->length, &x, sizeof x);
+		c->length += sizeof x;
+	}
+	c->data_length = c->length;
+	if (chunk_seal(f, CHUNK_INDEX) < 0)
+		return -1;
+	/*
+	 * and finally (in the clear) where to find the index
+	 */
+	uint64_t x[2] = { htonll(o), htonll(n) };
+	if (pipe_write(f, x, sizeof x) < 0)
+		return -1;
+	return pipe_sync(f);
+}
+
+static int chunk_seal(io_private_t *f, uint8_t x)
+{
+	io_chunk_t *c = f->chunk;
+	if (f->codec_init)
+	{
+		const io_codec_t *z = &CODECS[f->codec_options.x_codec];
+		ssize_t e = z->write(f, NULL, 0);
+		z->end(f);
+		f->codec_init = false;
+		if (e < 0)
+			return -1;
+		x |= CHUNK_COMPRESSED;
+	}
+	/*
+	 * pad the data to a whole number of cipher blocks
+	 */
+	size_t b = f->buffer_crypt->block;
+	size_t l = (c->length + b - 1) / b * b;
+	chunk_reserve(c, l);
+#if defined __DEBUG__ && !defined __DEBUG_WITH_ENCRYPTION__
+	memset(c->stream + c->length, 0x00, l - c->length);
+#else
+	gcry_create_nonce(c->stream + c->length, l - c->length);
+#endif
+	gcry_create_nonce(c->nonce, c->nonce_length);
+	uint8_t h[CHUNK_HEADER] = { x };
+	uint32_t n = htonl(c->data_length);
+	memcpy(h + sizeof( uint8_t ), &n, sizeof n);
+	n = htonl(c->length);
+	memcpy(h + sizeof( uint8_t ) + sizeof n, &n, sizeof n);
+	chunk_crypt(f, true, l);
+	chunk_tag(f, h, l, true);
+	if (!(x & CHUNK_INDEX))
+		chunk_record(c, c->start, f->position);
+	if (pipe_write(f, h, sizeof h) < 0 || pipe_write(f, c->nonce, c->nonce_length) < 0 || pipe_write(f, c->stream, l) < 0 || pipe_write(f, c->tag, c->tag_length) < 0)
+		return -1;
+	c->number++;
+	c->start += c->data_length;
+	c->data_length = 0;
+	c->length = 0;
+	return 0;
+}
+
+static int chunk_load(io_private_t *f, size_t m)
+{
+	io_chunk_t *c = f->chunk;
+	uint8_t h[CHUNK_HEADER];
+	ssize_t e = pipe_read(f, h, sizeof h);
+	if (e < 0)
+		return -1;
+	if ((size_t)e < sizeof h)
+		return errno = EIO , -1;
+	uint32_t x;
+	memcpy(&x, h + sizeof( uint8_t ), sizeof x);
+	size_t n = ntohl(x);
+	memcpy(&x, h + sizeof( uint8_t ) + sizeof x, sizeof x);
+	size_t z = ntohl(x);
+	/*
+	 * the lengths can’t be trusted until the tag has been checked, but
+	 * they can at least be sane
+	 */
+	if (n > m || (h[0] & CHUNK_COMPRESSED ? z > n + n / 2 + KILOBYTE : z != n))
+		return errno = EIO , -1;
+	size_t b = f->buffer_crypt->block;
+	size_t l = (z + b - 1) / b * b;
+	chunk_reserve(c, l);
+	if (pipe_read(f, c->nonce, c->nonce_length) != (ssize_t)c->nonce_length
+			|| pipe_read(f, c->stream, l) != (ssize_t)l
+			|| pipe_read(f, c->tag, c->tag_length) != (ssize_t)c->tag_length)
+		return errno = EIO , -1;
+	/*
+	 * only use the chunk if it’s exactly what was written (and where it
+	 * was written)
+	 */
+	if (!chunk_tag(f, h, l, false))
+		return errno = EBADMSG , -1;
+	chunk_crypt(f, false, l);
+	c->number++;
+	c->length = z;
+	c->offset = 0;
+	c->data = c->stream;
+	c->data_length = n;
+	c->data_offset = 0;
+	c->final = h[0] & CHUNK_FINAL;
+	if (!(h[0] & CHUNK_COMPRESSED))
+		return h[0];
+
+	if (f->operation == IO_ENCRYPT)
+		return errno = EINVAL , -1;
+	if (c->plain_size < n)
+	{
+		if (c->plain)
+			gcry_free(c->plain);
+		if (!(c->plain = gcry_malloc_secure(n)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, n);
+		c->plain_size = n;
+	}
+	/*
+	 * each compressed chunk is a compressed stream of its own
+	 */
+	if (f->buffer_codec)
+		memset(f->buffer_codec->offset, 0x00, sizeof f->buffer_codec->offset);
+	f->eof = EOF_NO;
+	if (!codec_init(f, false))
+		return -1;
+	const io_codec_t *k = &CODECS[f->codec_options.x_codec];
+	bool r = k->read(f, c->plain, n) == (ssize_t)n && !k->read(f, NULL, 0);
+	k->end(f);
+	f->codec_init = false;
+	f->eof = EOF_NO;
+	if (!r)
+		return errno = EIO , -1;
+	c->data = c->plain;
+	return h[0];
+}
+
+static int chunk_index(io_private_t *f)
+{
+	io_chunk_t *c = f->chunk;
+	off_t z = stream_length(f);
+	if (z < 0)
+		return -1;
+	uint64_t x[2];
+	if ((uint64_t)z < sizeof x || stream_seek(f, z - sizeof x) < 0)
+		return errno = EIO , -1;
+	if (pipe_read(f, x, sizeof x) != sizeof x)
+		return errno = EIO , -1;
+	uint64_t o = ntohll(x[0]);
+	uint64_t n = ntohll(x[1]);
+	if (o >= z - sizeof x || n > (z - sizeof x) / CHUNK_HEADER || stream_seek(f, o) < 0)
+		return errno = EIO , -1;
+	c->number = n;
+	int e = chunk_load(f, (n + 1) * CHUNK_ENTRY + sizeof c->bookmark);
+	if (e < 0)
+		return -1;
+	if (!(e & CHUNK_INDEX) || (c->data_length != (n + 1) * CHUNK_ENTRY && c->data_length != (n + 1) * CHUNK_ENTRY + sizeof c->bookmark))
+		return errno = EIO , -1;
+	for (size_t i = 0; i <= n; i++)
+	{
+		memcpy(x, c->data + i * CHUNK_ENTRY, sizeof x);
+		chunk_record(c, ntohll(x[0]), ntohll(x[1]));
+	}
+	if (c->data_length > (n + 1) * CHUNK_ENTRY)
+	{
+		memcpy(x, c->data + (n + 1) * CHUNK_ENTRY, sizeof c->bookmark);
+		c->bookmark = ntohll(x[0]);
+	}
+	/*
+	 * nothing is loaded now
+	 */
+	c->data_length = 0;
+	c->data_offset = 0;
+	return 0;
+}
+
+static void chunk_crypt(io_private_t *f, bool e, size_t l)
+{
+	if (!l)
+		return;
+	/*
+	 * every chunk starts again with its own nonce
+	 */
+	io_chunk_t *c = f->chunk;
+	size_t b = f->buffer_crypt->block;
+	if (f->cipher_mode == GCRY_CIPHER_MODE_CTR)
+		gcry_cipher_setctr(f->cipher_handle, c->nonce, b);
+	else
+		gcry_cipher_setiv(f->cipher_handle, c->nonce, f->cipher_mode == GCRY_CIPHER_MODE_STREAM ? CHUNK_STREAM : b);
+	if (f->pool)
+	{
+		memcpy(f->pool->iv, c->nonce, f->pool->block);
+		f->pool->index = 0;
+	}
+	if (!e)
+		return enc_crypt(f, false, c->stream, NULL, l);
+	/*
+	 * as with the end of a stream, the last block is encrypted on its
+	 * own
+	 */
+	if (l > b)
+		enc_crypt(f, true, c->stream, NULL, l - b);
+	gcry_cipher_final(f->cipher_handle);
+	enc_crypt(f, true, c->stream + l - b, NULL, b);
+	return;
+}
+
+static bool chunk_tag(io_private_t *f, const uint8_t *h, size_t l, bool w)
+{
+	/*
+	 * the tag covers the number of the chunk, along with everything
+	 * that was stored, so chunks can’t be moved, dropped or altered
+	 */
+	io_chunk_t *c = f->chunk;
+	uint64_t t = stat_clock();
+	gcry_mac_reset(c->mac_handle);
+	if (c->mac_iv)
+		gcry_mac_setiv(c->mac_handle, c->nonce, c->nonce_length);
+	uint64_t n = htonll(c->number);
+	gcry_mac_write(c->mac_handle, &n, sizeof n);
+	gcry_mac_write(c->mac_handle, h, CHUNK_HEADER);
+	gcry_mac_write(c->mac_handle, c->nonce, c->nonce_length);
+	gcry_mac_write(c->mac_handle, c->stream, l);
+	bool r = true;
+	size_t z = c->tag_length;
+	if (!w)
+		r = gcry_mac_verify(c->mac_handle, c->tag, c->tag_length) == GPG_ERR_NO_ERROR;
+	else
+		gcry_mac_read(c->mac_handle, c->tag, &z);
+	stat_count(f, IO_STAT_MAC, t, sizeof n + CHUNK_HEADER + c->nonce_length + l);
+	return r;
+}
+
+static void chunk_reserve(io_chunk_t *c, size_t l)
+{
+	if (l <= c->size)
+		return;
+	/*
+	 * usually there’s only a little more than a chunk’s worth (once
+	 * compressed or padded), but the index can be any size
+	 */
+	size_t z = l + KILOBYTE;
+	if (z < CHUNK_SIZE + KILOBYTE)
+		z = CHUNK_SIZE + KILOBYTE;
+	uint8_t *x = c->stream ? gcry_realloc(c->stream, z) : gcry_malloc_secure(z);
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+	c->stream = x;
+	c->size = z;
+	return;
+}
+
+static void chunk_record(io_chunk_t *c, uint64_t p, uint64_t o)
+{
+	if (c->count == c->slots)
+	{
+		size_t z = c->slots ? c->slots * 2 : KILOBYTE;
+		chunk_index_t *x = realloc(c->index, z * sizeof( chunk_index_t ));
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z * sizeof( chunk_index_t ));
+		c->index = x;
+		c->slots = z;
+	}
+	c->index[c->count].plain = p;
+	c->index[c->count].offset = o;
+	c->count++;
+	return;
+}
+
+static int stream_seek(io_private_t *f, uint64_t o)
+{
+	/*
+	 * with error correction, every frame (but the last) holds a full
+	 * payload, so it’s easy to find the frame any offset is in
+	 */
+	off_t x = o;
+	size_t s = 0;
+	if (f->ecc_init)
+	{
+		memset(f->buffer_ecc->offset, 0x00, sizeof f->buffer_ecc->offset);
+		memset(f->buffer_frames->offset, 0x00, sizeof f->buffer_frames->offset);
+		if (o > f->ecc_start)
+		{
+			x = f->ecc_start + (o - f->ecc_start) / ECC_PAYLOAD * ECC_FRAME;
+			s = (o - f->ecc_start) % ECC_PAYLOAD;
+		}
+	}
+	if (io_seek(f, x, SEEK_SET) < 0)
+		return -1;
+	if (s)
+	{
+		uint8_t b[ECC_PAYLOAD];
+		if (ecc_read(f, b, s) != (ssize_t)s)
+			return errno = EIO , -1;
+	}
+	f->position = o;
+	return 0;
+}
+
+static off_t stream_length(io_private_t *f)
+{
+	off_t z = io_seek(f, 0, SEEK_END);
+	if (z < 0 || !f->ecc_init || (uint64_t)z <= f->ecc_start)
+		return z;
+	/*
+	 * the length of the data is the length of the last frame on top of
+	 * all the full frames before it
+	 */
+	uint64_t n = (z - f->ecc_start) / ECC_FRAME;
+	if (!n)
+		return f->ecc_start;
+	uint8_t l = 0;
+	if (io_seek(f, f->ecc_start + (n - 1) * ECC_FRAME, SEEK_SET) < 0 || raw_read(f, &l, sizeof l) != sizeof l || l > ECC_PAYLOAD)
+		return errno = EIO , -1;
+	return f->ecc_start + (n - 1) * ECC_PAYLOAD + l;
+}
+
+static ssize_t ecc_write(io_private_t *f, const void *d, size_t l)
+{
+	if (!f->ecc_init)
+	{
+		if (!d && !l)
+			return raw_sync(f) , 0;
+		else
+			return raw_write(f, d, l);
+	}
+
+	buffer_t *b = f->buffer_ecc;
+	buffer_t *w = f->buffer_frames;
+	if (!d && !l)
+	{
+		/*
+		 * the final frame holds whatever is left (which may be nothing)
+		 */
+		memset(b->stream + b->offset[0], 0x00, b->block - b->offset[0]);
+		w->stream[w->offset[0]] = (uint8_t)b->offset[0];
+		uint64_t t = stat_clock();
+		ecc_encode(b->stream, w->stream + w->offset[0] + sizeof( uint8_t ));
+		stat_count(f, IO_STAT_ECC, t, b->offset[0]);
+		ssize_t e = raw_write(f, w->stream, w->offset[0] + w->block);
+
+		raw_sync(f);
+		b->block = 0;
+		free(b->stream);
+		b->stream = NULL;
+		memset(b->offset, 0x00, sizeof b->offset);
+		memset(w->offset, 0x00, sizeof w->offset);
+		return e;
+	}
+
+	for (b->offset[1] = 0; b->offset[1] < l; )
+	{
+		size_t n = l - b->offset[1] < b->block - b->offset[0] ? l - b->offset[1] : b->block - b->offset[0];
+		memcpy(b->stream + b->offset[0], (const uint8_t *)d + b->offset[1], n);
+		b->offset[1] += n;
+		if ((b->offset[0] += n) < b->block)
+			continue;
+		/*
+		 * encode the frame straight into the output buffer; it’s only
+		 * written out once there are plenty of frames to write
+		 */
+		w->stream[w->offset[0]] = ECC_PAYLOAD;
+		uint64_t t = stat_clock();
+		ecc_encode(b->stream, w->stream + w->offset[0] + sizeof( uint8_t ));
+		stat_count(f, IO_STAT_ECC, t, ECC_PAYLOAD);
+		b->offset[0] = 0;
+		if ((w->offset[0] += w->block) < w->block * w->count)
+			continue;
+		ssize_t e = EXIT_SUCCESS;
+		if ((e = raw_write(f, w->stream, w->offset[0])) < 0)
+			return e;
+		w->offset[0] = 0;
+	}
+	return l;
+}
+
+static ssize_t ecc_read(io_private_t *f, void *d, size_t l)
+{
+	if (!f->ecc_init)
+		return raw_read(f, d, l);
+
+	buffer_t *b = f->buffer_ecc;
+	buffer_t *r = f->buffer_frames;
+	for (b->offset[2] = 0; b->offset[2] < l; )
+	{
+		if (!b->offset[0])
+		{
+			if (r->offset[0] - r->offset[1] < r->block)
+			{
+				/*
+				 * read as many frames as will fit in one go, keeping
+				 * hold of any (partial) frame that’s left over
+				 */
+				size_t x = r->offset[0] - r->offset[1];
+				memmove(r->stream, r->stream + r->offset[1], x);
+				ssize_t e = EXIT_SUCCESS;
+				if ((e = raw_read(f, r->stream + x, r->block * r->count - x)) < 0)
+					return e;
+				r->offset[0] = x + e;
+				r->offset[1] = 0;
+			}
+			size_t x = r->offset[0] - r->offset[1];
+			if (x <= sizeof( uint8_t ))
+				break; /* return whatever we did get */
+			uint8_t *frame = r->stream + r->offset[1];
+			if (x < r->block)
+				memset(frame + x, 0x00, r->block - x);
+			r->offset[1] += x < r->block ? x : r->block;
+
+			uint8_t tmp[ECC_CAPACITY] = { 0x0 };
+			int bo;
+			uint64_t t = stat_clock();
+			ecc_decode(frame + sizeof( uint8_t ), tmp, &bo);
+			stat_count(f, IO_STAT_ECC, t, *frame);
+			if (bo >= 4)
+				return errno = EIO , -1;
+			memcpy(b->stream, tmp, *frame);
+			b->offset[0] = *frame;
+			b->offset[1] = 0;
+		}
+		size_t n = l - b->offset[2] < b->offset[0] ? l - b->offset[2] : b->offset[0];
+		memcpy((uint8_t *)d + b->offset[2], b->stream + b->offset[1], n);
+		b->offset[0] -= n;
+		b->offset[1] += n;
+		b->offset[2] += n;
+	}
+	return b->offset[2];
+}
+
+static int ecc_sync(io_private_t *f)
+{
+	ecc_write(f, NULL, 0);
+	return 0;
+}
+
+static ssize_t raw_read(io_private_t *f, void *d, size_t l)
+{
+	uint64_t t = stat_clock();
+	if (f->buffer_direct)
+	{
+		ssize_t e = direct_read(f, d, l);
+		if (e >= 0)
+			stat_count(f, IO_STAT_READ, t, e);
+		return e;
+	}
+	/*
+	 * keep reading until there’s as much as was asked for, or there’s
+	 * nothing left; pipes especially are prone to giving short reads
+	 */
+	size_t r = 0;
+	while (r < l)
+	{
+		ssize_t e = read(f->fd, (uint8_t *)d + r, l - r);
+		f->stats.stage[IO_STAT_READ].syscalls++;
+		if (e < 0 && errno == EINTR)
+			continue;
+		else if (e < 0)
+			return e;
+		else if (!e)
+			break;
+		r += e;
+	}
+	stat_count(f, IO_STAT_READ, t, r);
+	return r;
+}
+
+static ssize_t pipe_write(io_private_t *f, const void *d, size_t l)
+{
+	io_stage_t *s = f->stage;
+	f->position += l;
+	if (!s)
+		return ecc_write(f, d, l);
+	/*
+	 * fill blocks in the ring; they’re only handed over to the writer
+	 * once they’re full (or when syncing)
+	 */
+	size_t z = ring_block_size(s->ring);
+	for (size_t i = 0; i < l; )
+	{
+		if (!s->block && !(s->block = ring_claim(s->ring)))
+			return errno = s->error ? : EPIPE , -1;
+		size_t n = l - i < z - s->length ? l - i : z - s->length;
+		memcpy(s->block + s->length, (const uint8_t *)d + i, n);
+		i += n;
+		if ((s->length += n) < z)
+			continue;
+		ring_push(s->ring, s->length);
+		s->block = NULL;
+		s->length = 0;
+	}
+	return l;
+}
+
+static ssize_t pipe_read(io_private_t *f, void *d, size_t l)
+{
+	io_stage_t *s = f->stage;
+	if (!s)
+	{
+		ssize_t e = ecc_read(f, d, l);
+		if (e > 0)
+			f->position += e;
+		return e;
+	}
+	size_t r = 0;
+	while (r < l)
+	{
+		if (!s->block)
+		{
+			if (!(s->block = ring_peek(s->ring, &s->length)))
+				break;
+			s->offset = 0;
+		}
+		size_t n = l - r < s->length - s->offset ? l - r : s->length - s->offset;
+		memcpy((uint8_t *)d + r, s->block + s->offset, n);
+		r += n;
+		if ((s->offset += n) < s->length)
+			continue;
+		ring_pop(s->ring);
+		s->block = NULL;
+	}
+	/*
+	 * the reader only stops early because of an error or the end of
+	 * the file; either way it’s up to us to say which
+	 */
+	if (r < l && s->error)
+		return errno = s->error , -1;
+	f->position += r;
+	return r;
+}
+
+static int pipe_sync(io_private_t *f)
+{
+	if (!f->stage)
+		return ecc_sync(f);
+	return pipe_finish(f, true);
+}
+
+static int pipe_finish(io_private_t *f, bool y)
+{
+	io_stage_t *s = f->stage;
+	if (s->write && s->block)
+		ring_push(s->ring, s->length);
+	s->sync = y;
+	/*
+	 * closing the ring tells the writer there’s nothing else to come,
+	 * or the reader that nothing else is needed
+	 */
+	ring_close(s->ring);
+	pthread_join(s->thread, NULL);
+	ring_deinit(s->ring);
+	int e = s->error;
+	free(s);
+	f->stage = NULL;
+	return e ? (errno = e , -1) : 0;
+}
+
+static void *pipe_writer(void *ptr)
+{
+	io_private_t *f = ptr;
+	io_stage_t *s = f->stage;
+	uint8_t *b = NULL;
+	size_t l = 0;
+	while ((b = ring_peek(s->ring, &l)))
+	{
+		errno = EXIT_SUCCESS;
+		if (ecc_write(f, b, l) < 0)
+		{
+			s->error = errno ? : EIO;
+			ring_close(s->ring);
+			break;
+		}
+		ring_pop(s->ring);
+	}
+	if (!s->error && s->sync)
+		ecc_sync(f);
+	return NULL;
+}
+
+static void *pipe_reader(void *ptr)
+{
+	io_private_t *f = ptr;
+	io_stage_t *s = f->stage;
+	size_t z = ring_block_size(s->ring);
+	uint8_t *b = NULL;
+	while ((b = ring_claim(s->ring)))
+	{
+		errno = EXIT_SUCCESS;
+		ssize_t e = ecc_read(f, b, z);
+		if (e < 0)
+		{
+			s->error = errno ? : EIO;
+			break;
+		}
+		if (e)
+			ring_push(s->ring, e);
+		if ((size_t)e < z)
+			break;
+	}
+	ring_close(s->ring);
+	return NULL;
+}
+
+static ssize_t raw_write(io_private_t *f, const void *d, size_t l)
+{
+	uint64_t t = stat_clock();
+	ssize_t w = 0;
+	if (f->buffer_direct)
+		w = direct_write(f, d, l);
+	else if (f->uring)
+	{
+		uint64_t n = uring_syscalls(f->uring);
+		w = uring_write(f->uring, d, l);
+		f->stats.stage[IO_STAT_WRITE].syscalls += uring_syscalls(f->uring) - n;
+	}
+	else while ((size_t)w < l)
+	{
+		/*
+		 * as with reading, pipes might not take everything in one go
+		 */
+		ssize_t e = write(f->fd, (const uint8_t *)d + w, l - w);
+		f->stats.stage[IO_STAT_WRITE].syscalls++;
+		if (e < 0 && errno == EINTR)
+			continue;
+		else if (e < 0)
+			return e;
+		w += e;
+	}
+	if (w >= 0)
+		stat_count(f, IO_STAT_WRITE, t, w);
+	return w;
+}
+
+static int raw_sync(io_private_t *f)
+{
+	uint64_t t = stat_clock();
+	int r = 0;
+	if (f->buffer_direct)
+		direct_flush(f);
+	if (f->uring)
+	{
+		uint64_t n = uring_syscalls(f->uring);
+		r = uring_sync(f->uring, true);
+		f->stats.stage[IO_STAT_WRITE].syscalls += uring_syscalls(f->uring) - n;
+	}
+	else
+	{
+		r = fsync(f->fd);
+		f->stats.stage[IO_STAT_WRITE].syscalls++;
+	}
+	stat_count(f, IO_STAT_WRITE, t, 0);
+	return r;
+}
+
+static ssize_t direct_read(io_private_t *f, void *d, size_t l)
+{
+	/*
+	 * read whole (aligned) blocks in to the buffer, and then pass the
+	 * data on from there
+	 */
+	buffer_t *b = f->buffer_direct;
+	size_t r = 0;
+	while (r < l)
+	{
+		if (b->offset[1] == b->offset[0])
+		{
+			ssize_t e = read(f->fd, b->stream, b->block);
+			f->stats.stage[IO_STAT_READ].syscalls++;
+			if (e < 0 && errno == EINTR)
+				continue;
+			else if (e < 0 && errno == EINVAL && direct_off(f))
+				continue;
+			else if (e < 0)
+				return e;
+			else if (!e)
+				break;
+			b->offset[0] = e;
+			b->offset[1] = 0;
+		}
+		size_t n = l - r < b->offset[0] - b->offset[1] ? l - r : b->offset[0] - b->offset[1];
+		memcpy((uint8_t *)d + r, b->stream + b->offset[1], n);
+		r += n;
+		b->offset[1] += n;
+	}
+	return r;
+}
+
+static ssize_t direct_write(io_private_t *f, const void *d, size_t l)
+{
+	buffer_t *b = f->buffer_direct;
+	for (size_t i = 0; i < l; )
+	{
+		size_t n = l - i < b->block - b->offset[0] ? l - i : b->block - b->offset[0];
+		memcpy(b->stream + b->offset[0], (const uint8_t *)d + i, n);
+		i += n;
+		if ((b->offset[0] += n) < b->block)
+			continue;
+		if (direct_flush(f) < 0)
+			return -1;
+	}
+	return l;
+}
+
+static int direct_flush(io_private_t *f)
+{
+	buffer_t *b = f->buffer_direct;
+	/*
+	 * only whole blocks can be written directly, so whatever is left
+	 * at the end has to go through the page cache as normal
+	 */
+	if (b->offset[0] % DIRECT_ALIGN)
+		direct_off(f);
+	for (size_t w = 0; w < b->offset[0]; )
+	{
+		ssize_t e = write(f->fd, b->stream + w, b->offset[0] - w);
+		f->stats.stage[IO_STAT_WRITE].syscalls++;
+		if (e < 0 && errno == EINTR)
+			continue;
+		else if (e < 0 && errno == EINVAL && direct_off(f))
+			continue; /* the device must need bigger blocks */
+		else if (e < 0)
+			return -1;
+		w += e;
+	}
+	b->offset[0] = 0;
+	return 0;
+}
+
+static bool direct_off(io_private_t *f)
+{
+#ifdef O_DIRECT
+	int x = fcntl(f->fd, F_GETFL);
+	if (x < 0 || !(x & O_DIRECT))
+		return false;
+	return fcntl(f->fd, F_SETFL, x & ~O_DIRECT) != -1;
+#else
+	(void)f;
+	return false;
+#endif
+}
+
+#ifndef _WIN32
+static bool map_guard(io_private_t *f)
+{
+	bool r = false;
+	pthread_mutex_lock(&map_mutex);
+	for (size_t i = 0; i < MAP_GUARDED; i++)
+	{
+		io_private_t *e = NULL;
+		if (__atomic_compare_exchange_n(&MAP_GUARD[i], &e, f, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			/*
+			 * the first file to be mapped installs the handler
+			 */
+			if (!map_guarded++)
+				map_install();
+			r = true;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&map_mutex);
+	return r;
+}
+
+static void map_unguard(io_private_t *f)
+{
+	pthread_mutex_lock(&map_mutex);
+	for (size_t i = 0; i < MAP_GUARDED; i++)
+	{
+		io_private_t *e = f;
+		if (__atomic_compare_exchange_n(&MAP_GUARD[i], &e, NULL, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+		{
+			/*
+			 * and the last one to finish puts back whatever was
+			 * there before
+			 */
+			if (!--map_guarded)
+				sigaction(SIGBUS, &map_previous, NULL);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&map_mutex);
+	return;
+}
+
+static void map_install(void)
+{
+	if (!map_page)
+		map_page = sysconf(_SC_PAGESIZE);
+	struct sigaction a;
+	memset(&a, 0x00, sizeof a);
+	a.sa_sigaction = map_bus;
+	a.sa_flags = SA_SIGINFO;
+	sigemptyset(&a.sa_mask);
+	sigaction(SIGBUS, &a, &map_previous);
+	return;
+}
+
+static void map_bus(int s, siginfo_t *i, void *u)
+{
+	(void)u;
+	uintptr_t a = (uintptr_t)i->si_addr;
+	for (size_t j = 0; j < MAP_GUARDED; j++)
+	{
+		io_private_t *f = __atomic_load_n(&MAP_GUARD[j], __ATOMIC_ACQUIRE);
+		if (!f || a < (uintptr_t)f->map || a >= (uintptr_t)f->map + f->map_length)
+			continue;
+		/*
+		 * the file was truncated while it was mapped, and whichever
+		 * thread was reading from it went past the end; put a page of
+		 * zeros there instead so it can carry on, and then io_map()
+		 * will report the error
+		 */
+		if (mmap((void *)(a - a % map_page), map_page, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) == MAP_FAILED)
+			break;
+		f->map_truncated = true;
+		return;
+	}
+	/*
+	 * not one of ours; put back whatever was handling it before and
+	 * let the fault happen again
+	 */
+	sigaction(s, &map_previous, NULL);
+	return;
+}
+#endif
+
+static bool codec_init(io_private_t *io_ptr, bool w)
+{
+	const io_codec_t *z = io_codec_available(io_ptr->codec_options.x_codec) ? &CODECS[io_ptr->codec_options.x_codec] : NULL;
+	if (!z)
+		return errno = ENOTSUP , false;
+	io_ptr->codec_compress = w;
+	return io_ptr->codec_init = w ? z->compress(io_ptr) : z->decompress(io_ptr);
+}
+
+static bool lzma_compress(io_private_t *io_ptr)
+{
+	lzma_stream l = LZMA_STREAM_INIT;
+	io_ptr->lzma_handle = l;
+
+	lzma_filter lzf[2];
+	lzma_options_lzma lzo;
+	if (lzma_lzma_preset(&lzo, io_codec_level(CODEC_XZ, io_ptr->codec_options.x_level)))
+		return false;
+	lzf[0].id = LZMA_FILTER_LZMA2;
+	lzf[0].options = &lzo;
+	lzf[1].id = LZMA_VLI_UNKNOWN;
+	lzma_ret lr;
+#if LZMA_VERSION >= 50020002
+	uint32_t t = codec_threads(io_ptr->codec_options.x_threads);
+	if (t > 1)
+	{
+		/*
+		 * the block encoder splits the data into blocks which are then
+		 * compressed in parallel; the block sizes are recorded in the
+		 * block headers so they can also be decompressed in parallel
+		 */
+		lzma_mt mt = { .flags = 0, .threads = t, .block_size = io_ptr->codec_options.x_block, .timeout = 0, .filters = lzf, .check = LZMA_CHECK_NONE };
+		lr = lzma_stream_encoder_mt(&io_ptr->lzma_handle, &mt);
+	}
+	else
+#endif
+		lr = lzma_stream_encoder(&io_ptr->lzma_handle, lzf, LZMA_CHECK_NONE);
+	if (lr != LZMA_OK)
+		return false;
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE);
+	io_ptr->lzma_handle.next_out = io_ptr->buffer_codec->stream;
+	io_ptr->lzma_handle.avail_out = io_ptr->buffer_codec->block;
+	return true;
+}
+
+static bool lzma_decompress(io_private_t *io_ptr)
+{
+	lzma_stream l = LZMA_STREAM_INIT;
+	io_ptr->lzma_handle = l;
+
+	lzma_ret lr;
+#if LZMA_VERSION >= 50040002
+	uint32_t t = codec_threads(io_ptr->codec_options.x_threads);
+	if (t > 1)
+	{
+		/*
+		 * only streams made up of multiple blocks (with their sizes
+		 * stored) are decompressed in parallel; anything else is just
+		 * decompressed as before, on a single thread
+		 */
+		uint64_t m = lzma_physmem() / 4;
+		lzma_mt mt = { .flags = 0/*LZMA_CONCATENATED*/, .threads = t, .timeout = 0, .memlimit_threading = m ? : UINT64_MAX, .memlimit_stop = UINT64_MAX };
+		lr = lzma_stream_decoder_mt(&io_ptr->lzma_handle, &mt);
+	}
+	else
+#endif
+		lr = lzma_stream_decoder(&io_ptr->lzma_handle, UINT64_MAX, 0/*LZMA_CONCATENATED*/);
+	if (lr != LZMA_OK)
+		return false;
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE);
+	/*
+	 * carry on from where the last stream ended (if there was one)
+	 */
+	io_ptr->lzma_handle.next_in = io_ptr->buffer_codec->stream + io_ptr->buffer_codec->offset[0];
+	io_ptr->lzma_handle.avail_in = io_ptr->buffer_codec->offset[1] - io_ptr->buffer_codec->offset[0];
+	return true;
+}
+
+#ifdef HAVE_ZSTD
+static bool zstd_compress(io_private_t *io_ptr)
+{
+	ZSTD_CCtx *z = ZSTD_createCCtx();
+	if (!z)
+		return false;
+	ZSTD_CCtx_setParameter(z, ZSTD_c_compressionLevel, io_codec_level(CODEC_ZSTD, io_ptr->codec_options.x_level));
+	if (io_ptr->codec_options.x_threads != 1)
+	{
+		/*
+		 * only possible if libzstd was built with support for threads;
+		 * otherwise the upper bound is 0 and it’s all done on this one
+		 */
+		ZSTD_bounds b = ZSTD_cParam_getBounds(ZSTD_c_nbWorkers);
+		int t = codec_threads(io_ptr->codec_options.x_threads);
+		if (!ZSTD_isError(b.error))
+			ZSTD_CCtx_setParameter(z, ZSTD_c_nbWorkers, t > b.upperBound ? b.upperBound : t);
+		if (io_ptr->codec_options.x_block)
+			ZSTD_CCtx_setParameter(z, ZSTD_c_jobSize, io_ptr->codec_options.x_block);
+	}
+	io_ptr->codec_handle = z;
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE);
+	return true;
+}
+
+static bool zstd_decompress(io_private_t *io_ptr)
+{
+	if (!(io_ptr->codec_handle = ZSTD_createDCtx()))
+		return false;
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE);
+	return true;
+}
+#endif
+
+#ifdef HAVE_LZ4
+static bool lz4_compress(io_private_t *io_ptr)
+{
+	LZ4F_cctx *z = NULL;
+	if (LZ4F_isError(LZ4F_createCompressionContext(&z, LZ4F_VERSION)))
+		return false;
+	io_ptr->codec_handle = z;
+	/*
+	 * the buffer needs to be big enough for the worst case of a chunk of
+	 * data along with whatever LZ4 might already be holding on to
+	 */
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE + LZ4F_compressBound(LZ4_CHUNK, NULL));
+	LZ4F_preferences_t p = { .compressionLevel = io_codec_level(CODEC_LZ4, io_ptr->codec_options.x_level) };
+	size_t r = LZ4F_compressBegin(z, io_ptr->buffer_codec->stream, io_ptr->buffer_codec->block, &p);
+	if (LZ4F_isError(r))
+		return LZ4F_freeCompressionContext(z) , io_ptr->codec_handle = NULL , false;
+	io_ptr->buffer_codec->offset[0] = r;
+	return true;
+}
+
+static bool lz4_decompress(io_private_t *io_ptr)
+{
+	LZ4F_dctx *z = NULL;
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&z, LZ4F_VERSION)))
+		return false;
+	io_ptr->codec_handle = z;
+	codec_buffer_init(io_ptr, CODEC_BUFFER_SIZE);
+	return true;
+}
+#endif
+
+static uint32_t codec_threads(size_t t)
+{
+	if (!t)
+		t = lzma_cputhreads() ? : 1;
+	return t > LZMA_THREADS_MAX ? LZMA_THREADS_MAX : (uint32_t)t;
+}
+
+static void codec_buffer_init(io_private_t *io_ptr, size_t s)
+{
+	if (io_ptr->buffer_codec)
+		return;
+	if (!(io_ptr->buffer_codec = gcry_calloc_secure(1, sizeof( buffer_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( buffer_t ));
+	io_ptr->buffer_codec->block = s;
+	io_ptr->buffer_codec->count = 1;
+	if (!(io_ptr->buffer_codec->stream = gcry_malloc_secure(io_ptr->buffer_codec->block)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, io_ptr->buffer_codec->block);
+	return;
+}
+
+static void master_key(io_master_t *m, enum gcry_md_algos h, uint64_t i, const uint8_t *k, size_t l, uint8_t *s, size_t n, bool e, uint8_t *d)
+{
+	if (!m)
+	{
+		if (e)
+			gcry_create_nonce(s, n);
+		gcry_kdf_derive(k, l, GCRY_KDF_PBKDF2, h, s, n, i, l, d);
+		return;
+	}
+	/*
+	 * when encrypting, any master key stretched from the same key data
+	 * will do (and its salt is used); when decrypting the salt has to
+	 * match as well
+	 */
+	pthread_mutex_lock(&m->mutex);
+	for (size_t j = 0; j < m->count; j++)
+	{
+		io_master_key_t *x = &m->keys[j];
+		if (x->hash != h || x->iterations != i || x->length != l || x->salt_length != n || memcmp(x->data, k, l))
+			continue;
+		if (!e && memcmp(x->salt, s, n))
+			continue;
+		if (!x->ready)
+		{
+			/*
+			 * it’s still being derived; wait for it, and then look
+			 * again, as the cache may have changed in the meantime
+			 */
+			pthread_cond_wait(&m->cond, &m->mutex);
+			j = (size_t)-1;
+			continue;
+		}
+		if (e)
+			memcpy(s, x->salt, n);
+		memcpy(d, x->key, l);
+		pthread_mutex_unlock(&m->mutex);
+		return;
+	}
+	/*
+	 * record what’s about to be derived, so anything else after the
+	 * same key waits for it rather than deriving it again; the cache
+	 * isn’t locked while it’s derived, so keys with different salts can
+	 * be derived at the same time
+	 */
+	if (e)
+		gcry_create_nonce(s, n);
+	io_master_key_t *x = NULL;
+	if (m->count < MASTER_KEYS)
+	{
+		x = &m->keys[m->count++];
+		if (!(x->data = gcry_malloc_secure(l)) || !(x->key = gcry_malloc_secure(l)) || !(x->salt = gcry_malloc_secure(n)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l + l + n);
+	}
+	else
+	{
+		/*
+		 * replace the oldest key, skipping any still being derived;
+		 * if they all are then this one just isn’t kept
+		 */
+		for (size_t j = 0; j < MASTER_KEYS && !x; j++, m->next = (m->next + 1) % MASTER_KEYS)
+			if (m->keys[m->next].ready)
+				x = &m->keys[m->next];
+		if (x && (x->length != l || x->salt_length != n))
+		{
+			gcry_free(x->data);
+			gcry_free(x->key);
+			gcry_free(x->salt);
+			if (!(x->data = gcry_malloc_secure(l)) || !(x->key = gcry_malloc_secure(l)) || !(x->salt = gcry_malloc_secure(n)))
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l + l + n);
+		}
+	}
+	if (x)
+	{
+		x->hash = h;
+		x->iterations = i;
+		x->length = l;
+		x->salt_length = n;
+		x->ready = false;
+		memcpy(x->data, k, l);
+		memcpy(x->salt, s, n);
+	}
+	pthread_mutex_unlock(&m->mutex);
+
+	gcry_kdf_derive(k, l, GCRY_KDF_PBKDF2, h, s, n, i, l, d);
+
+	if (!x)
+		return;
+	pthread_mutex_lock(&m->mutex);
+	memcpy(x->key, d, l);
+	x->ready = true;
+	pthread_cond_broadcast(&m->cond);
+	pthread_mutex_unlock(&m->mutex);
+	return;
+}
+
+static io_pool_t *pool_init(enum gcry_cipher_algos c, enum gcry_cipher_modes m, const uint8_t *k, size_t l, size_t t)
+{
+	io_pool_t *p = calloc(1, sizeof( io_pool_t ));
+	if (!p)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( io_pool_t ));
+	/*
+	 * the calling thread does its share too
+	 */
+	p->count = t - 1;
+	if (!(p->workers = calloc(p->count, sizeof( io_worker_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, p->count * sizeof( io_worker_t ));
+	p->mode = m;
+	pthread_mutex_init(&p->mutex, NULL);
+	pthread_cond_init(&p->start, NULL);
+	pthread_cond_init(&p->done, NULL);
+	for (size_t i = 0; i < p->count; i++)
+	{
+		io_worker_t *w = &p->workers[i];
+		w->pool = p;
+		if (gcry_cipher_open(&w->cipher_handle, c, m, GCRY_CIPHER_SECURE) != GPG_ERR_NO_ERROR || gcry_cipher_setkey(w->cipher_handle, k, l) != GPG_ERR_NO_ERROR)
+		{
+			/*
+			 * carry on with however many workers we have
+			 */
+			if (w->cipher_handle)
+				gcry_cipher_close(w->cipher_handle);
+			p->count = i;
+			break;
+		}
+		if (pthread_create(&w->thread, NULL, pool_worker, w))
+		{
+			gcry_cipher_close(w->cipher_handle);
+			p->count = i;
+			break;
+		}
+	}
+	if (!p->count)
+		return pool_deinit(p) , NULL;
+	return p;
+}
+
+static void pool_deinit(io_pool_t *p)
+{
+	pthread_mutex_lock(&p->mutex);
+	p->stop = true;
+	pthread_cond_broadcast(&p->start);
+	pthread_mutex_unlock(&p->mutex);
+	for (size_t i = 0; i < p->count; i++)
+	{
+		pthread_join(p->workers[i].thread, NULL);
+		gcry_cipher_close(p->workers[i].cipher_handle);
+	}
+	pthread_cond_destroy(&p->done);
+	pthread_cond_destroy(&p->start);
+	pthread_mutex_destroy(&p->mutex);
+	if (p->iv)
+		gcry_free(p->iv);
+	free(p->workers);
+	free(p);
+	return;
+}
+
+static void *pool_worker(void *ptr)
+{
+	io_worker_t *w = ptr;
+	io_pool_t *p = w->pool;
+	uint64_t job = 0;
+
+	pthread_mutex_lock(&p->mutex);
+	while (true)
+	{
+		while (!p->stop && p->job == job)
+			pthread_cond_wait(&p->start, &p->mutex);
+		if (p->stop)
+			break;
+		job = p->job;
+		bool e = p->encrypt;
+		pthread_mutex_unlock(&p->mutex);
+
+		if (w->length)
+		{
+			crypt_position(w->cipher_handle, p->mode, p->iv, p->block, w->index);
+			crypt_blocks(w->cipher_handle, p->mode, e, p->block, w->out, w->in, w->length);
+		}
+
+		pthread_mutex_lock(&p->mutex);
+		if (!--p->pending)
+			pthread_cond_signal(&p->done);
+	}
+	pthread_mutex_unlock(&p->mutex);
+	return NULL;
+}
+
+static void crypt_blocks(gcry_cipher_hd_t h, enum gcry_cipher_modes m, bool e, size_t b, uint8_t *out, const uint8_t *in, size_t l)
+{
+	/*
+	 * where the mode allows, do everything in one go, otherwise it’s a
+	 * block at a time (in is NULL when working in place)
+	 */
+	size_t s = mode_supports_bulk(m) ? l : b;
+	for (size_t i = 0; i < l; i += s)
+		if (e)
+			gcry_cipher_encrypt(h, out + i, s, in ? in + i : NULL, in ? s : 0);
+		else
+			gcry_cipher_decrypt(h, out + i, s, in ? in + i : NULL, in ? s : 0);
+	return;
+}
+
+static void crypt_position(gcry_cipher_hd_t h, enum gcry_cipher_modes m, const uint8_t *iv, size_t b, uint64_t n)
+{
+	/*
+	 * set the counter/tweak to be n blocks on from the IV; CTR uses a
+	 * big-endian counter, whereas the XTS tweak is little-endian
+	 */
+	uint8_t x[b];
+	memcpy(x, iv, b);
+	switch (m)
+	{
+		case GCRY_CIPHER_MODE_CTR:
+			for (size_t i = b; i-- && n; )
+			{
+				unsigned s = x[i] + (n & 0xFF);
+				x[i] = (uint8_t)s;
+				n = (n >> 8) + (s >> 8);
+			}
+			gcry_cipher_setctr(h, x, b);
+			break;
+		case 13: // GCRY_CIPHER_MODE_XTS:
+			for (size_t i = 0; i < b && n; i++)
+			{
+				unsigned s = x[i] + (n & 0xFF);
+				x[i] = (uint8_t)s;
+				n = (n >> 8) + (s >> 8);
+			}
+			gcry_cipher_setiv(h, x, b);
+			break;
+		default:
+			/* ECB doesn’t have one */
+			break;
+	}
+	return;
+}
+
+static bool mode_supports_bulk(enum gcry_cipher_modes m)
+{
+	/*
+	 * only modes whose output doesn’t depend on how the data is split
+	 * between calls; XTS treats each call as a separate data unit and
+	 * the SIV modes expect the whole message at once
+	 */
+	switch (m)
+	{
+		case GCRY_CIPHER_MODE_ECB:
+		case GCRY_CIPHER_MODE_CFB:
+		case GCRY_CIPHER_MODE_CFB8:
+		case GCRY_CIPHER_MODE_CBC:
+		case GCRY_CIPHER_MODE_OFB:
+		case GCRY_CIPHER_MODE_CTR:
+		case GCRY_CIPHER_MODE_STREAM:
+		case GCRY_CIPHER_MODE_GCM:
+		case GCRY_CIPHER_MODE_POLY1305:
+		case 14: // GCRY_CIPHER_MODE_EAX:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static bool mode_supports_parallel(enum gcry_cipher_modes m)
+{
+	/*
+	 * modes where any block can be en/decrypted without knowing
+	 * anything about the ones before it
+	 */
+	switch (m)
+	{
+		case GCRY_CIPHER_MODE_ECB:
+		case GCRY_CIPHER_MODE_CTR:
+		case 13: // GCRY_CIPHER_MODE_XTS:
+			return true;
+		default:
+			return false;
+	}
+}
+
+static void plain_digest(io_private_t *f, const void *d, size_t l)
+{
+	if (f->hash_init)
+	{
+		uint64_t t = stat_clock();
+		gcry_md_write(f->hash_handle, d, l);
+		stat_count(f, IO_STAT_HASH, t, l);
+	}
+	if (f->mac_init)
+	{
+		uint64_t t = stat_clock();
+		gcry_mac_write(f->mac_handle, d, l);
+		stat_count(f, IO_STAT_MAC, t, l);
+	}
+	return;
+}
+
+static uint64_t stat_clock(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t)t.tv_sec * THOUSAND_MILLION + t.tv_nsec;
+}
+
+static void stat_count(io_private_t *f, io_stat_e s, uint64_t t, uint64_t l)
+{
+	/*
+	 * each stage is only ever run on one thread at a time, so there’s
+	 * no need for any locking
+	 */
+	io_stat_t *x = &f->stats.stage[s];
+	x->time += stat_clock() - t;
+	x->bytes += l;
+	x->calls++;
 	return;
 }
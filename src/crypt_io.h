@@ -39,6 +39,7 @@
 #define IO_UNINITIALISED io_dummy_handle() /*!< Macro wrapper for io_dummy_handle() */
 
 typedef void * IO_HANDLE; /*<! Handle type for IO functions */
+typedef void * IO_MASTER; /*<! Handle type for a cache of master keys */
 
 #if defined _WIN32 && !defined _MODE_T_
 #define _MODE_T_
@@ -70,11 +71,96 @@ x_iv_e;
  */
 typedef struct
 {
-	x_iv_e x_iv;    /*!< Whether to use the older (less correct) IV generation */
-	bool x_encrypt; /*!< Encrypt (or decrypt) */
+	x_iv_e x_iv;      /*!< Whether to use the older (less correct) IV generation */
+	bool x_encrypt;   /*!< Encrypt (or decrypt) */
+	size_t x_threads; /*!< Number of threads to share en/decryption between (CTR, XTS and ECB only); 0 for one per CPU */
+	bool x_chunked;   /*!< Split the data into chunks which are each encrypted and authenticated on their own (from 2027.02) */
+	bool x_one_kdf;   /*!< Run the KDF once for both the key and the MAC key (from 2027.06) */
+	bool x_master;    /*!< Run the KDF with a salt of its own, which can be shared between files, and derive each file’s keys from that (from 2027.07) */
+	IO_MASTER x_keys; /*!< Master keys already derived from the same key data (may be NULL) */
 }
 io_extra_t;
 
+/*!
+ * \brief  Compression codecs
+ *
+ * The compression algorithms which can be used. The value is stored in
+ * the encrypted data stream, so these must not be reordered.
+ */
+typedef enum
+{
+	CODEC_XZ,     /*!< xz (LZMA2); the default, and the only codec before 2027.01 */
+	CODEC_ZSTD,   /*!< Zstandard */
+	CODEC_LZ4,    /*!< LZ4 (frame format) */
+	CODEC_UNKNOWN /*!< Unknown (or unsupported) codec */
+} __attribute__((packed))
+io_codec_e;
+
+#define CODEC_LEVEL_DEFAULT -1 /*!< Use the default compression level of the codec */
+
+/*!
+ * \brief  Options passed to IO compression init
+ *
+ * A structure for the options which control how data is compressed
+ * (or decompressed). The defaults (single threaded) produce output
+ * identical to previous versions.
+ */
+typedef struct
+{
+	io_codec_e x_codec; /*!< Which compression algorithm to use */
+	int x_level;        /*!< Compression level; CODEC_LEVEL_DEFAULT for the codec default */
+	size_t x_threads;   /*!< Number of threads to compress/decompress with; 0 for one per CPU, 1 for the (original) single threaded encoder */
+	size_t x_block;     /*!< Size of each block compressed independently when using multiple threads; 0 for the codec default */
+}
+io_compress_t;
+
+/*!
+ * \brief  Stages of the IO
+ *
+ * Each of the things which can happen to the data on its way to (or
+ * from) the file; see io_stats_t.
+ */
+typedef enum
+{
+	IO_STAT_READ,   /*!< Reading the file (or mapping it into memory) */
+	IO_STAT_HASH,   /*!< Hashing the plaintext, for the checksum */
+	IO_STAT_MAC,    /*!< Authenticating the data */
+	IO_STAT_CODEC,  /*!< Compression/decompression */
+	IO_STAT_CIPHER, /*!< Encryption/decryption */
+	IO_STAT_ECC,    /*!< Error correction */
+	IO_STAT_WRITE,  /*!< Writing (and syncing) the file */
+	IO_STATS        /*!< Number of stages */
+}
+io_stat_e;
+
+/*!
+ * \brief  Counters for a stage of the IO
+ */
+typedef struct
+{
+	uint64_t bytes;    /*!< Amount of data which went through the stage (the plaintext, for compression) */
+	uint64_t calls;    /*!< Number of times the stage was run */
+	uint64_t time;     /*!< Time spent in the stage, in nanoseconds */
+	uint64_t syscalls; /*!< Number of system calls made (only when reading or writing) */
+}
+io_stat_t;
+
+/*!
+ * \brief  Counters for each stage of the IO
+ *
+ * The time for each stage only includes that stage (not any which it
+ * passes the data on to); stages which run on a separate thread (see
+ * io_pipeline_init()) overlap with the rest, so the times can add up
+ * to more than the time taken overall. Data read from a file which is
+ * mapped into memory is only really read when it’s first used, which
+ * is counted as part of whichever stage that is.
+ */
+typedef struct
+{
+	io_stat_t stage[IO_STATS]; /*!< The counters for each stage */
+}
+io_stats_t;
+
 /*!
  * \brief         Open a file
  * \param[in]  n  The file name
@@ -190,6 +276,22 @@ extern ssize_t io_write(IO_HANDLE f, const void *d, size_t l) __attribute__((non
  */
 extern ssize_t io_read(IO_HANDLE f, void *d, size_t l) __attribute__((nonnull(1, 2)));
 
+/*!
+ * \brief         Read data without copying it
+ * \param[in]  f  An IO instance
+ * \param[out] d  Where the data is
+ * \param[in]  l  The maximum amount of data wanted
+ * \return        The amount of data available, or -1 on error
+ *
+ * Regular files are mapped into memory, so the data can be used (for
+ * instance, given straight to io_write()) from the page cache without
+ * first being copied. The data remains valid until the handle is
+ * closed. Other streams (pipes, stdin, etc) can’t be mapped, in which
+ * case errno is ENOTSUP and io_read() should be used instead. If the
+ * file is truncated while it’s mapped, errno is EIO.
+ */
+extern ssize_t io_map(IO_HANDLE f, const void **d, size_t l) __attribute__((nonnull(1, 2)));
+
 /*!
  * \brief         Sync data waiting to be written
  * \param[in]  f  An IO instance
@@ -228,14 +330,143 @@ extern off_t io_seek(IO_HANDLE f, off_t o, int w) __attribute__((nonnull(1)));
  */
 extern bool io_encryption_init(IO_HANDLE f, enum gcry_cipher_algos c, enum gcry_md_algos h, enum gcry_cipher_modes m, enum gcry_mac_algos a, uint64_t i, const uint8_t *k, size_t l, io_extra_t x) __attribute__((nonnull(1, 7)));
 
+/*!
+ * \brief         Create a cache of master keys
+ * \return        A new (empty) cache
+ *
+ * From 2027.07 the key data is stretched (which is where nearly all the
+ * time goes) into a master key, with a salt of its own, and the keys for
+ * each file are derived from that. Passing the same cache to each file
+ * encrypted (or decrypted) with the same key data means the master key
+ * is only derived once for all of them; it’s kept in secure memory and
+ * can be shared between threads.
+ */
+extern IO_MASTER io_master_init(void) __attribute__((malloc));
+
+/*!
+ * \brief         Finish with a cache of master keys
+ * \param[in]  m  The cache; every key in it is wiped
+ */
+extern void io_master_deinit(IO_MASTER m) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Read data from anywhere in a chunked stream
+ * \param[in]  f  An IO instance
+ * \param[out] d  The data read
+ * \param[in]  l  The length of data to read (size of d)
+ * \param[in]  o  The offset of the data within the plaintext
+ * \return        The number of bytes read, or -1 on error
+ *
+ * Only the chunks which hold the data are read, decrypted and checked,
+ * using the index at the end of the stream to find them; so the stream
+ * must be a file which can be seeked, and not being read on a pipeline.
+ * Once used, the stream can only be read this way. Offsets are those of
+ * the plaintext since encryption started (see io_chunk_position()).
+ */
+extern ssize_t io_chunk_read(IO_HANDLE f, void *d, size_t l, uint64_t o) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Get the position within a chunked stream
+ * \param[in]  f  An IO instance
+ * \return        The offset within the plaintext
+ *
+ * How much plaintext has been read/written since encryption started;
+ * for later use with io_chunk_read().
+ */
+extern uint64_t io_chunk_position(IO_HANDLE f) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Bookmark a position within a chunked stream
+ * \param[in]  f  An IO instance
+ * \param[in]  o  The offset within the plaintext
+ *
+ * The offset is stored with the index of chunks (when the stream is
+ * synced) so that it can be found again without reading the stream.
+ */
+extern void io_chunk_bookmark_set(IO_HANDLE f, uint64_t o) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get the bookmarked position of a chunked stream
+ * \param[in]  f  An IO instance
+ * \return        The offset within the plaintext; 0 if there isn’t one
+ *
+ * As with io_chunk_read(), the stream can only be read that way once
+ * this has been used.
+ */
+extern uint64_t io_chunk_bookmark(IO_HANDLE f) __attribute__((nonnull(1)));
+
 /*!
  * \brief         Compression initialisation
  * \param[in]  f  An IO instance
+ * \param[in]  x  Compression options
  *
  * Turn on compression/decompression for the rest of the life of this
- * handle.
+ * handle. Using more than one thread splits the data into blocks which
+ * are compressed independently; the result is still a standard xz
+ * stream which older versions can still decompress.
+ */
+extern void io_compression_init(IO_HANDLE f, io_compress_t x) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Pause compression
+ * \param[in]  f  An IO instance
+ * \return        Whether the compressed stream ended cleanly
+ *
+ * Finish the current compressed stream so that whatever comes next is
+ * only encrypted (or decrypted); for data which won’t compress any
+ * further. When reading, the compressed stream must have been read up
+ * to its end, as it would have been written.
+ */
+extern bool io_compression_pause(IO_HANDLE f) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Resume compression
+ * \param[in]  f  An IO instance
+ *
+ * Start a new compressed stream after io_compression_pause(); it will
+ * be initialised with the next read/write.
+ */
+extern void io_compression_resume(IO_HANDLE f) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get a compression codec by name
+ * \param[in]  n  The name of the codec (eg xz)
+ * \return        The codec, or CODEC_UNKNOWN
+ *
+ * Find the compression codec with the given name; the codec may not be
+ * available (see io_codec_available()).
+ */
+extern io_codec_e io_codec_from_name(const char *n) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Get the name of a compression codec
+ * \param[in]  c  The codec
+ * \return        The name of the codec, or NULL if it is unknown
+ *
+ * Get the name of the compression codec, as used on the command line.
+ */
+extern const char *io_codec_name(io_codec_e c);
+
+/*!
+ * \brief         Check a compression codec can be used
+ * \param[in]  c  The codec
+ * \return        Whether the codec is available
+ *
+ * Only xz is always available; others depend on which libraries were
+ * present when encrypt was built.
  */
-extern void io_compression_init(IO_HANDLE f) __attribute__((nonnull(1)));
+extern bool io_codec_available(io_codec_e c);
+
+/*!
+ * \brief         Get the compression level which will be used
+ * \param[in]  c  The codec
+ * \param[in]  l  The requested level; CODEC_LEVEL_DEFAULT for the default
+ * \return        The compression level
+ *
+ * Get the level a codec will actually compress at, given what was
+ * requested.
+ */
+extern uint8_t io_codec_level(io_codec_e c, int l);
 
 /*!
  * \brief         Read/Write data checksum initialisation
@@ -275,4 +506,64 @@ extern void io_encryption_mac(IO_HANDLE f, uint8_t **b, size_t *l) __attribute__
  */
 extern void io_correction_init(IO_HANDLE f) __attribute__((nonnull(1)));
 
+/*!
+ * \brief         Enable pipelining
+ * \param[in]  f  An IO instance
+ * \param[in]  w  Whether data is being written (or read)
+ *
+ * Move the actual reading/writing of the file, along with any error
+ * correction, on to a separate thread so that it can happen while the
+ * next (or previous) data is being processed. Should be enabled once
+ * any seeking is done, and after any other initialisation.
+ */
+extern void io_pipeline_init(IO_HANDLE f, bool w) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Enable direct IO
+ * \param[in]  f  An IO instance
+ * \return        Whether the page cache is now bypassed
+ *
+ * Read/write the file without going through the page cache, so that
+ * very large files don’t push everything else out of memory. Data is
+ * read/written in whole aligned blocks; anything left at the end is
+ * written as normal. Only for regular files, and must be enabled
+ * before anything has been read/written.
+ */
+extern bool io_direct_init(IO_HANDLE f) __attribute__((nonnull(1)));
+
+/*!
+ * \brief         Keep the counters once a file is closed
+ * \param[in]  f  An IO instance
+ * \param[in]  s  Where to add the counters
+ *
+ * Whatever has been counted (see io_stats_collect()) is added to s when
+ * the file is closed (or released), once anything still being written
+ * has been; s must remain valid until then.
+ */
+extern void io_stats_init(IO_HANDLE f, io_stats_t *s) __attribute__((nonnull(2)));
+
+/*!
+ * \brief         Collect the counters for each stage of the IO
+ * \param[in]  f  An IO instance (may be NULL)
+ * \param[out] s  Where to add the counters
+ *
+ * Adds what has been counted so far to s, and starts counting again
+ * from zero; counters are always kept, for every file.
+ */
+extern void io_stats_collect(IO_HANDLE f, io_stats_t *s) __attribute__((nonnull(2)));
+
+/*!
+ * \brief         Add one set of counters to another
+ * \param[out] s  Where to add the counters
+ * \param[in]  x  The counters to add
+ */
+extern void io_stats_add(io_stats_t *s, const io_stats_t *x) __attribute__((nonnull(1, 2)));
+
+/*!
+ * \brief         Get the name of a stage of the IO
+ * \param[in]  s  The stage
+ * \return        Its name
+ */
+extern const char *io_stat_name(io_stat_e s);
+
 #endif /* ! _ENCRYPT_CRYPTIO_H_ */
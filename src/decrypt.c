@@ -59,6 +59,43 @@ static void skip_random_data(crypto_t *);
 static void decrypt_directory(crypto_t *, const char *);
 static void decrypt_stream(crypto_t *);
 static void decrypt_file(crypto_t *);
+static void decrypt_range(crypto_t *);
+static void decrypt_extract(crypto_t *);
+static void decrypt_list(crypto_t *);
+
+/*!
+ * \brief  The last path read (from 2027.05 each path is stored as how it differs from it)
+ */
+typedef struct
+{
+	char *path;    /*!< The path */
+	size_t length; /*!< Its length */
+	size_t size;   /*!< Size of the buffer */
+}
+last_path_t;
+
+/*!
+ * \brief  An entry found in the index of a directory
+ */
+typedef struct
+{
+	uint64_t offset; /*!< Where the entry starts */
+	char *path;      /*!< Its path */
+}
+entry_t;
+
+static void skip_manifest(crypto_t *);
+static bool read_entry(crypto_t *, last_path_t *, file_type_e *, uint64_t *, char **);
+static char *read_string(crypto_t *, uint64_t *);
+static const char *read_path(crypto_t *, last_path_t *, uint64_t *);
+static bool read_length(crypto_t *, uint64_t *, uint64_t *);
+static void list_entry(crypto_t *, file_type_e, const char *, const uint64_t *, const char *);
+
+static void skip_entry_index(crypto_t *);
+static entry_t *find_entries(crypto_t *, const char *, bool, size_t *);
+static void free_entries(entry_t *, size_t);
+static bool extract_entry(crypto_t *, const entry_t *, const char *);
+static bool read_at(crypto_t *, void *, size_t, uint64_t *);
 
 extern crypto_t *decrypt_init(const char * const restrict i,
                               const char * const restrict o,
@@ -89,6 +126,9 @@ extern crypto_t *decrypt_init(const char * const restrict i,
 
 	z->path = NULL;
 	z->compressed = false;
+	z->codec = CODEC_XZ;
+	z->compress_level = CODEC_LEVEL_DEFAULT;
+	z->compress_threads = 1;
 	z->directory = false;
 
 	if (o)
@@ -178,6 +218,12 @@ static void *process(void *ptr)
 	if (!c || c->status != STATUS_INIT)
 		return NULL;
 
+	if (c->direct_io)
+	{
+		io_direct_init(c->source);
+		io_direct_init(c->output);
+	}
+
 	/*
 	 * read encrypt file header
 	 */
@@ -221,6 +267,13 @@ static void *process(void *ptr)
 		case VERSION_2020_01:
 		case VERSION_2022_01:
 		case VERSION_2024_01:
+		case VERSION_2027_01:
+		case VERSION_2027_02:
+		case VERSION_2027_03:
+		case VERSION_2027_04:
+		case VERSION_2027_05:
+		case VERSION_2027_06:
+		case VERSION_2027_07:
 			//c->kdf_iterations = KEY_ITERATIONS_DEFAULT;
 			break;
 		default:
@@ -232,13 +285,33 @@ static void *process(void *ptr)
 	 * length; and up until 2017.XX a kdf was not used; from 2020.01 the
 	 * kdf iterations can be user defined
 	 */
-	io_extra_t iox = { iv_type, false };
+	/*
+	 * a range is found using the index of chunks added in 2027.02, and
+	 * by seeking through the encrypted file, so there’s no point deriving
+	 * the key without either; whether it was a single file (and not a
+	 * stream) is only known once the (encrypted) metadata has been read
+	 */
+	if (c->range && c->version < VERSION_2027_02)
+		return c->status = STATUS_FAILED_RANGE_VERSION , (void *)c->status;
+	if (c->range && io_seek(c->source, 0, SEEK_CUR) < 0)
+		return c->status = STATUS_FAILED_RANGE_SOURCE , (void *)c->status;
+
+	io_extra_t iox = { iv_type, false, c->threads, c->version >= VERSION_2027_02, c->version >= VERSION_2027_06, c->version >= VERSION_2027_07, c->master };
 	if (!io_encryption_init(c->source, c->cipher, c->hash, c->mode, c->mac, c->kdf_iterations, c->key, c->length, iox))
 		return (c->status = STATUS_FAILED_GCRYPT_INIT , (void *)c->status);
 
 	c->status = STATUS_RUNNING;
 	gcry_free(c->key);
 	c->key = NULL;
+	/*
+	 * reading the input and error correction can happen while the
+	 * previous data is being decrypted (unless we’re single threaded,
+	 * or only decrypting a range or a single entry, where the input is
+	 * read out of order)
+	 */
+	bool partial = c->range || c->extract || c->list;
+	if (c->threads != 1 && !partial)
+		io_pipeline_init(c->source, false);
 
 	if (!c->raw)
 	{
@@ -254,6 +327,11 @@ static void *process(void *ptr)
 	if (!read_metadata(c))
 		return (void *)c->status;
 
+	if (c->range && c->directory)
+		return c->status = STATUS_FAILED_RANGE_DIRECTORY , (void *)c->status;
+	if (c->range && c->blocksize)
+		return c->status = STATUS_FAILED_RANGE_STREAM , (void *)c->status;
+
 	if (!skip_some_random && !c->raw)
 		skip_random_data(c);
 
@@ -261,7 +339,10 @@ static void *process(void *ptr)
 	 * main decryption loop
 	 */
 	if (c->compressed)
-		io_compression_init(c->source);
+	{
+		io_compress_t ioz = { c->codec, c->compress_level, c->compress_threads, c->compress_block };
+		io_compression_init(c->source, ioz);
+	}
 
 	/*
 	 * The ever-expanding decrypt function!
@@ -279,8 +360,19 @@ static void *process(void *ptr)
 	 */
 	io_encryption_checksum_init(c->source, c->hash);
 
-	if (c->directory)
+	if (c->list)
+		decrypt_list(c);
+	else if (c->range)
+		decrypt_range(c);
+	else if (c->extract)
+	{
+		decrypt_extract(c);
+		c->current.display = FINISHING_UP;
+	}
+	else if (c->directory)
 	{
+		if (c->version >= VERSION_2027_04)
+			skip_manifest(c);
 		decrypt_directory(c, c->path);
 		c->current.display = FINISHING_UP;
 	}
@@ -297,7 +389,11 @@ static void *process(void *ptr)
 	c->current.offset = c->current.size;
 	c->total.offset = c->total.size;
 
-	if (c->version != VERSION_2011_08 && !c->raw)
+	/*
+	 * with only part of the data, there’s no checksum (or MAC) to
+	 * verify; each chunk it came from was authenticated instead
+	 */
+	if (c->version != VERSION_2011_08 && !c->raw && !partial)
 	{
 		/*
 		 * verify checksum (on versions which calculated it correctly)
@@ -313,10 +409,10 @@ static void *process(void *ptr)
 		gcry_free(b);
 	}
 
-	if (!c->raw)
+	if (!c->raw && !partial)
 		skip_random_data(c);
 
-	if (c->kdf_iterations && c->version >= VERSION_2020_01)
+	if (c->kdf_iterations && c->version >= VERSION_2020_01 && !partial)
 	{
 		uint8_t *mac = NULL;
 		size_t mac_length = 0;
@@ -334,6 +430,8 @@ static void *process(void *ptr)
 	 */
 	if (c->output)
 		io_sync(c->output);
+	io_stats_collect(c->source, &c->stats);
+	io_stats_collect(c->output, &c->stats);
 	if (c->status == STATUS_RUNNING)
 		c->status = STATUS_SUCCESS;
 
@@ -407,9 +505,12 @@ static bool read_verification_sum(crypto_t *c)
 	uint64_t x = 0;
 	uint64_t y = 0;
 	uint64_t z = 0;
-	io_read(c->source, &x, sizeof x);
-	io_read(c->source, &y, sizeof y);
-	io_read(c->source, &z, sizeof z);
+	/*
+	 * a chunk which couldn’t be read (because its tag didn’t match)
+	 * would otherwise leave them all as 0, which is valid
+	 */
+	if (io_read(c->source, &x, sizeof x) != sizeof x || io_read(c->source, &y, sizeof y) != sizeof y || io_read(c->source, &z, sizeof z) != sizeof z)
+		return c->status = STATUS_FAILED_DECRYPTION, false;
 	x = ntohll(x);
 	y = ntohll(y);
 	z = ntohll(z);
@@ -424,20 +525,38 @@ static bool read_metadata(crypto_t *c)
 	 * read the original file metadata - skip any unknown tag values
 	 */
 	uint8_t h = 0;
-	TLV tlv = tlv_init();
 	io_read(c->source, &h, sizeof h);
+	/*
+	 * read all the tags into one buffer, just as they were written,
+	 * and use them from there
+	 */
+	size_t l = 0;
+	size_t z = BLOCK_SIZE;
+	uint8_t *b = gcry_malloc_secure(z);
+	if (!b)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
 	for (int i = 0; i < h; i++)
 	{
-		tlv_t t;
-		io_read(c->source, &t.tag, sizeof( byte_t ));
-		io_read(c->source, &t.length, sizeof t.length);
-		t.length = ntohs(t.length);
-		if (!(t.value = gcry_malloc_secure(t.length)))
-			die(_("Out of memory @ %s:%d:%s [%d]"), __FILE__, __LINE__, __func__, t.length);
-		io_read(c->source, t.value, t.length);
-		tlv_append(tlv, t);
-		gcry_free(t.value);
+		uint8_t tag;
+		uint16_t length;
+		io_read(c->source, &tag, sizeof tag);
+		io_read(c->source, &length, sizeof length);
+		size_t n = sizeof tag + sizeof length + ntohs(length);
+		if (l + n > z)
+		{
+			while (l + n > z)
+				z *= 2;
+			uint8_t *x = gcry_realloc(b, z);
+			if (!x)
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+			b = x;
+		}
+		b[l] = tag;
+		memcpy(b + l + sizeof tag, &length, sizeof length);
+		io_read(c->source, b + l + sizeof tag + sizeof length, ntohs(length));
+		l += n;
 	}
+	TLV tlv = tlv_import(b, l, h);
 
 	if (tlv_has_tag(tlv, TAG_SIZE))
 	{
@@ -455,8 +574,42 @@ static bool read_metadata(crypto_t *c)
 		c->blocksize = 0;
 
 	c->compressed = tlv_has_tag(tlv, TAG_COMPRESSED) ? tlv_value_of(tlv, TAG_COMPRESSED)[0] : false;
+	if (c->compressed && tlv_has_tag(tlv, TAG_CODEC))
+	{
+		/*
+		 * unlike other tags, the data can’t be read without knowing
+		 * how it was compressed
+		 */
+		c->codec = tlv_value_of(tlv, TAG_CODEC)[0];
+		if (tlv_length_of(tlv, TAG_CODEC) > sizeof( uint8_t ))
+			c->compress_level = tlv_value_of(tlv, TAG_CODEC)[1];
+		if (!io_codec_available(c->codec))
+		{
+			tlv_deinit(tlv);
+			gcry_free(b);
+			return c->status = STATUS_FAILED_UNKNOWN_TAG , false;
+		}
+	}
 	c->directory = tlv_has_tag(tlv, TAG_DIRECTORY) ? tlv_value_of(tlv, TAG_DIRECTORY)[0] : false;
-	if (c->directory)
+	if (c->list)
+	{
+		/*
+		 * nothing is decrypted, only the list is written
+		 */
+		if (!c->directory && tlv_has_tag(tlv, TAG_FILENAME))
+		{
+			if (c->name)
+				free(c->name);
+			c->name = strndup((char *)tlv_value_of(tlv, TAG_FILENAME), tlv_length_of(tlv, TAG_FILENAME));
+		}
+		if (!io_is_initialised(c->output))
+		{
+			io_release(c->output);
+			if (!(c->output = io_open(c->path, O_CREAT | O_TRUNC | O_WRONLY | F_WRLCK | O_BINARY, S_IRUSR | S_IWUSR)))
+				c->status = STATUS_FAILED_IO;
+		}
+	}
+	else if (c->directory)
 	{
 		struct stat s;
 		stat(c->path, &s);
@@ -493,10 +646,13 @@ static bool read_metadata(crypto_t *c)
 				c->status = STATUS_FAILED_OUTPUT_MISMATCH;
 			if (!(c->output = io_open(c->path, O_CREAT | O_TRUNC | O_WRONLY | F_WRLCK | O_BINARY, S_IRUSR | S_IWUSR)))
 				c->status = STATUS_FAILED_IO;
+			else if (c->direct_io)
+				io_direct_init(c->output);
 		}
 	}
 
 	tlv_deinit(tlv);
+	gcry_free(b);
 	return c->status == STATUS_RUNNING;
 }
 
@@ -518,20 +674,20 @@ static void skip_random_data(crypto_t *c)
 static void decrypt_directory(crypto_t *c, const char *dir)
 {
 	bool lnerr = false;
+	last_path_t last = { NULL, 0, 0 };
 	for (c->total.offset = 0; c->total.offset < c->total.size && c->status == STATUS_RUNNING; c->total.offset++)
 	{
 		file_type_e tp = 0x0;
 		io_read(c->source, &tp, sizeof( byte_t ));
-		uint64_t l;
-		io_read(c->source, &l, sizeof l);
-		l = ntohll(l);
-		char *filename = NULL;
-		if (!(filename = gcry_calloc_secure(l + sizeof( byte_t ), sizeof( char ))))
-			die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ));
-		io_read(c->source, filename, l);
+		const char *filename = read_path(c, &last, NULL);
+		if (!filename)
+		{
+			c->status = STATUS_FAILED_IO;
+			break;
+		}
 		char *fullpath = NULL;
 		if (!asprintf(&fullpath, "%s/%s", dir, filename))
-			die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, strlen(dir) + l + 2 * sizeof( byte_t ));
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(dir) + last.length + 2 * sizeof( byte_t ));
 		c->current.display = fullpath;
 		switch (tp)
 		{
@@ -540,28 +696,31 @@ static void decrypt_directory(crypto_t *c, const char *dir)
 				break;
 			case FILE_SYMLINK:
 			case FILE_LINK:
-				io_read(c->source, &l, sizeof l);
-				l = ntohll(l);
-				char *lnk = gcry_calloc_secure(l + sizeof( byte_t ), sizeof( byte_t ));
-				if (!lnk)
-					die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ));
-				io_read(c->source, lnk, l);
-				if (tp == FILE_SYMLINK)
 				{
+					char *lnk = read_string(c, NULL);
+					if (!lnk)
+					{
+						c->status = STATUS_FAILED_IO;
+						break;
+					}
+					if (tp == FILE_SYMLINK)
+					{
 #ifndef _WIN32
-					symlink(lnk, fullpath);
+						symlink(lnk, fullpath);
 #else
-					lnerr = true;
+						lnerr = true;
 #endif
-				}
-				else
-				{
-					char *hl = NULL;
-					if (!asprintf(&hl, "%s/%s", dir, lnk))
-						die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(dir) + strlen(lnk) + 2);
-					/* NB: on Windows this is just a copy not a link */
-					link(hl, fullpath);
-					free(hl);
+					}
+					else
+					{
+						char *hl = NULL;
+						if (!asprintf(&hl, "%s/%s", dir, lnk))
+							die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(dir) + strlen(lnk) + 2);
+						/* NB: on Windows this is just a copy not a link */
+						link(hl, fullpath);
+						free(hl);
+					}
+					gcry_free(lnk);
 				}
 				break;
 			case FILE_REGULAR:
@@ -571,16 +730,37 @@ static void decrypt_directory(crypto_t *c, const char *dir)
 				if (c->output)
 					io_close(c->output);
 				c->output = io_open(fullpath, O_CREAT | O_TRUNC | O_WRONLY | F_WRLCK | O_BINARY, S_IRUSR | S_IWUSR);
+				if (c->direct_io && c->output)
+					io_direct_init(c->output);
+				if (c->output)
+					io_stats_init(c->output, &c->stats);
+				/*
+				 * files that wouldn’t compress were stored as they are
+				 */
+				byte_t x = false;
+				if (c->compressed && c->version >= VERSION_2027_01)
+					io_read(c->source, &x, sizeof x);
+				if (x && !io_compression_pause(c->source))
+					c->status = STATUS_FAILED_LZMA;
 				decrypt_file(c);
+				if (x)
+					io_compression_resume(c->source);
 				io_close(c->output);
 				c->output = NULL;
 				c->current.offset = c->total.size;
 				break;
 		}
 		c->current.display = NULL;
-		gcry_free(filename);
 		gcry_free(fullpath);
 	}
+	if (last.path)
+		gcry_free(last.path);
+	/*
+	 * from 2027.03 the entries are followed by an index of where they
+	 * are, which is only needed when extracting
+	 */
+	if (c->version >= VERSION_2027_03 && c->status == STATUS_RUNNING)
+		skip_entry_index(c);
 	if (lnerr)
 		c->status = STATUS_WARNING_LINK;
 	return;
@@ -592,6 +772,8 @@ static void decrypt_stream(crypto_t *c)
 	uint8_t *buffer;
 	if (!(buffer = gcry_malloc_secure(c->blocksize + sizeof b)))
 		die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, c->blocksize + sizeof b);
+	if (c->threads != 1)
+		io_pipeline_init(c->output, true);
 	while (b && c->status == STATUS_RUNNING)
 	{
 		errno = EXIT_SUCCESS;
@@ -619,6 +801,11 @@ static void decrypt_stream(crypto_t *c)
 static void decrypt_file(crypto_t *c)
 {
 	uint8_t buffer[BLOCK_SIZE];
+	/*
+	 * write out while the next data is being decrypted
+	 */
+	if (c->threads != 1)
+		io_pipeline_init(c->output, true);
 	for (c->current.offset = 0; c->current.offset < c->current.size && c->status == STATUS_RUNNING; c->current.offset += BLOCK_SIZE)
 	{
 		errno = EXIT_SUCCESS;
@@ -635,3 +822,483 @@ static void decrypt_file(crypto_t *c)
 	}
 	return;
 }
+
+static void decrypt_range(crypto_t *c)
+{
+	/*
+	 * process() has already checked this is a single file (which wasn’t
+	 * split into blocks) with an index of its chunks
+	 */
+	uint64_t s = c->total.size;
+	uint64_t o = c->range_offset < s ? c->range_offset : s;
+	uint64_t l = c->range_length && c->range_length < s - o ? c->range_length : s - o;
+	/*
+	 * offsets are from the start of the file’s data
+	 */
+	o += io_chunk_position(c->source);
+	c->current.size = l;
+	c->total.size = 1;
+	uint8_t buffer[BLOCK_SIZE];
+	if (c->threads != 1)
+		io_pipeline_init(c->output, true);
+	for (c->current.offset = 0; c->current.offset < c->current.size && c->status == STATUS_RUNNING; )
+	{
+		size_t n = c->current.size - c->current.offset < BLOCK_SIZE ? c->current.size - c->current.offset : BLOCK_SIZE;
+		int64_t r = io_chunk_read(c->source, buffer, n, o + c->current.offset);
+		if (r <= 0)
+		{
+			c->status = STATUS_FAILED_IO;
+			break;
+		}
+		io_write(c->output, buffer, r);
+		c->current.offset += r;
+	}
+	return;
+}
+
+static void decrypt_extract(crypto_t *c)
+{
+	/*
+	 * only directories from 2027.03 have an index of their entries
+	 */
+	if (!c->directory || c->version < VERSION_2027_03)
+		return c->status = STATUS_FAILED_UNKNOWN_TAG , (void)NULL;
+	for (char *sl = c->extract + strlen(c->extract); sl > c->extract && *(sl - 1) == '/'; sl--)
+		*(sl - 1) = '\0';
+	/*
+	 * a directory is extracted along with everything in it
+	 */
+	size_t n = 0;
+	entry_t *e = find_entries(c, c->extract, true, &n);
+	if (!e)
+		return;
+	if (!n)
+		c->status = STATUS_FAILED_NOT_FOUND;
+	c->total.size = n;
+	bool lnerr = false;
+	for (c->total.offset = 0; c->total.offset < c->total.size && c->status == STATUS_RUNNING; c->total.offset++)
+		if (!extract_entry(c, &e[c->total.offset], NULL))
+			lnerr = true;
+	free_entries(e, n);
+	if (lnerr && c->status == STATUS_RUNNING)
+		c->status = STATUS_WARNING_LINK;
+	return;
+}
+
+static void skip_entry_index(crypto_t *c)
+{
+	uint64_t n = 0;
+	if (io_read(c->source, &n, sizeof n) != sizeof n)
+		return c->status = STATUS_FAILED_IO , (void)NULL;
+	last_path_t last = { NULL, 0, 0 };
+	for (n = ntohll(n); n && c->status == STATUS_RUNNING; n--)
+	{
+		uint64_t o;
+		if (io_read(c->source, &o, sizeof o) != sizeof o || !read_path(c, &last, NULL))
+			c->status = STATUS_FAILED_IO;
+	}
+	if (last.path)
+		gcry_free(last.path);
+	return;
+}
+
+static entry_t *find_entries(crypto_t *c, const char *p, bool t, size_t *n)
+{
+	/*
+	 * the index is found from the bookmark kept with the index of
+	 * chunks; each entry is where it is and its path
+	 */
+	uint64_t o = io_chunk_bookmark(c->source);
+	uint64_t y = 0;
+	if (!o || !read_at(c, &y, sizeof y, &o))
+		return c->status = STATUS_FAILED_IO , NULL;
+	size_t l = strlen(p);
+	last_path_t last = { NULL, 0, 0 };
+	entry_t *e = NULL;
+	size_t s = 0;
+	*n = 0;
+	for (y = ntohll(y); y && c->status == STATUS_RUNNING; y--)
+	{
+		uint64_t x;
+		const char *path;
+		if (!read_at(c, &x, sizeof x, &o) || !(path = read_path(c, &last, &o)))
+		{
+			c->status = STATUS_FAILED_IO;
+			break;
+		}
+		size_t k = last.length;
+		if (k < l || memcmp(path, p, l) || (k > l && (!t || path[l] != '/')))
+			continue;
+		if (*n == s)
+		{
+			s = s ? s * 2 : BLOCK_SIZE;
+			entry_t *q = realloc(e, s * sizeof( entry_t ));
+			if (!q)
+				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, s * sizeof( entry_t ));
+			e = q;
+		}
+		e[*n].offset = ntohll(x);
+		if (!(e[*n].path = strdup(path)))
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, k);
+		(*n)++;
+	}
+	if (last.path)
+		gcry_free(last.path);
+	if (c->status != STATUS_RUNNING)
+	{
+		free_entries(e, *n);
+		return NULL;
+	}
+	/*
+	 * an empty list (rather than none at all) when there’s no match
+	 */
+	if (!e && !(e = malloc(sizeof( entry_t ))))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( entry_t ));
+	return e;
+}
+
+static void free_entries(entry_t *e, size_t n)
+{
+	for (size_t i = 0; e && i < n; i++)
+		free(e[i].path);
+	free(e);
+	return;
+}
+
+static bool extract_entry(crypto_t *c, const entry_t *e, const char *as)
+{
+	/*
+	 * the entry is just as it would be in the directory stream, but
+	 * read from where it is; every chunk it’s read from is verified
+	 */
+	bool r = true;
+	uint64_t o = e->offset;
+	file_type_e tp = 0x0;
+	if (!read_at(c, &tp, sizeof( byte_t ), &o))
+		return c->status = STATUS_FAILED_IO , r;
+	/*
+	 * from 2027.05 only the end of the path is stored, so start from
+	 * where the index says it is; either way it has to match
+	 */
+	size_t l = strlen(e->path);
+	last_path_t last = { gcry_malloc_secure(l + sizeof( byte_t )), l, l + sizeof( byte_t ) };
+	if (!last.path)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ));
+	memcpy(last.path, e->path, last.size);
+	const char *filename = read_path(c, &last, &o);
+	if (!filename || strcmp(filename, e->path))
+	{
+		gcry_free(last.path);
+		return c->status = filename ? STATUS_FAILED_DECRYPTION : STATUS_FAILED_IO , r;
+	}
+	char *fullpath = NULL;
+	if (!asprintf(&fullpath, "%s/%s", c->path, as ? : filename))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(c->path) + strlen(as ? : filename) + 2 * sizeof( byte_t ));
+	/*
+	 * whatever contains it probably hasn’t been extracted
+	 */
+	char *parent = dir_get_path(fullpath);
+	dir_mk_recursive(parent, S_IRUSR | S_IWUSR | S_IXUSR);
+	free(parent);
+	c->current.display = fullpath;
+	switch (tp)
+	{
+		case FILE_DIRECTORY:
+			dir_mk_recursive(fullpath, S_IRUSR | S_IWUSR | S_IXUSR);
+			break;
+		case FILE_SYMLINK:
+		case FILE_LINK:
+			{
+				char *lnk = read_string(c, &o);
+				if (!lnk)
+					c->status = STATUS_FAILED_IO;
+				else if (tp == FILE_SYMLINK)
+				{
+#ifndef _WIN32
+					symlink(lnk, fullpath);
+#else
+					r = false;
+#endif
+				}
+				else
+				{
+					char *hl = NULL;
+					if (!asprintf(&hl, "%s/%s", c->path, lnk))
+						die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(c->path) + strlen(lnk) + 2);
+					/*
+					 * if what it’s linked to wasn’t extracted then
+					 * extract that here instead
+					 */
+					if (link(hl, fullpath) < 0)
+					{
+						size_t n = 0;
+						entry_t *t = find_entries(c, lnk, false, &n);
+						if (t && n)
+							r = extract_entry(c, t, as ? : filename);
+						else if (t)
+							c->status = STATUS_FAILED_NOT_FOUND;
+						free_entries(t, n);
+					}
+					free(hl);
+				}
+				if (lnk)
+					gcry_free(lnk);
+			}
+			break;
+		case FILE_REGULAR:
+			c->current.offset = 0;
+			if (!read_at(c, &c->current.size, sizeof c->current.size, &o))
+			{
+				c->status = STATUS_FAILED_IO;
+				break;
+			}
+			c->current.size = ntohll(c->current.size);
+			/*
+			 * whether the file was compressed doesn’t matter here
+			 */
+			if (c->compressed && c->version >= VERSION_2027_01)
+				o += sizeof( byte_t );
+			if (c->output)
+				io_close(c->output);
+			if (!(c->output = io_open(fullpath, O_CREAT | O_TRUNC | O_WRONLY | F_WRLCK | O_BINARY, S_IRUSR | S_IWUSR)))
+			{
+				c->status = STATUS_FAILED_IO;
+				break;
+			}
+			if (c->direct_io)
+				io_direct_init(c->output);
+			io_stats_init(c->output, &c->stats);
+			if (c->threads != 1)
+				io_pipeline_init(c->output, true);
+			uint8_t buffer[BLOCK_SIZE];
+			for (c->current.offset = 0; c->current.offset < c->current.size && c->status == STATUS_RUNNING; )
+			{
+				size_t n = c->current.size - c->current.offset < BLOCK_SIZE ? c->current.size - c->current.offset : BLOCK_SIZE;
+				if (!read_at(c, buffer, n, &o))
+				{
+					c->status = STATUS_FAILED_IO;
+					break;
+				}
+				io_write(c->output, buffer, n);
+				c->current.offset += n;
+			}
+			io_close(c->output);
+			c->output = NULL;
+			break;
+		default:
+			/*
+			 * the index doesn’t match what’s actually there
+			 */
+			c->status = STATUS_FAILED_DECRYPTION;
+			break;
+	}
+	c->current.display = NULL;
+	gcry_free(last.path);
+	gcry_free(fullpath);
+	return r;
+}
+
+static bool read_at(crypto_t *c, void *d, size_t l, uint64_t *o)
+{
+	/*
+	 * without an offset it’s just the next thing in the source
+	 */
+	if (!l)
+		return true;
+	if (!o)
+		return io_read(c->source, d, l) == (ssize_t)l;
+	ssize_t r = io_chunk_read(c->source, d, l, *o);
+	if (r < 0 || (size_t)r != l)
+		return false;
+	*o += l;
+	return true;
+}
+
+static void decrypt_list(crypto_t *c)
+{
+	if (!c->directory)
+	{
+		/*
+		 * a single file (whose size isn’t known if it was split into
+		 * blocks)
+		 */
+		uint64_t z = c->total.size;
+		c->total.offset = c->total.size = 1;
+		return list_entry(c, FILE_REGULAR, c->name ? : "-", c->blocksize ? NULL : &z, NULL);
+	}
+	/*
+	 * only directories from 2027.04 have a manifest; everything would
+	 * have to be decrypted otherwise
+	 */
+	if (c->version < VERSION_2027_04)
+		return c->status = STATUS_FAILED_UNKNOWN_TAG , (void)NULL;
+	uint64_t n = 0;
+	if (io_read(c->source, &n, sizeof n) != sizeof n)
+		return c->status = STATUS_FAILED_IO , (void)NULL;
+	c->total.size = ntohll(n);
+	last_path_t last = { NULL, 0, 0 };
+	for (c->total.offset = 0; c->total.offset < c->total.size && c->status == STATUS_RUNNING; c->total.offset++)
+	{
+		file_type_e tp = 0x0;
+		uint64_t z = 0;
+		char *ln = NULL;
+		if (!read_entry(c, &last, &tp, &z, &ln))
+		{
+			c->status = STATUS_FAILED_IO;
+			break;
+		}
+		list_entry(c, tp, last.path, tp == FILE_REGULAR ? &z : NULL, ln);
+		if (ln)
+			gcry_free(ln);
+	}
+	if (last.path)
+		gcry_free(last.path);
+	return;
+}
+
+static void skip_manifest(crypto_t *c)
+{
+	uint64_t n = 0;
+	if (io_read(c->source, &n, sizeof n) != sizeof n)
+		return c->status = STATUS_FAILED_IO , (void)NULL;
+	last_path_t last = { NULL, 0, 0 };
+	for (n = ntohll(n); n && c->status == STATUS_RUNNING; n--)
+	{
+		file_type_e tp = 0x0;
+		uint64_t z = 0;
+		char *ln = NULL;
+		if (!read_entry(c, &last, &tp, &z, &ln))
+			c->status = STATUS_FAILED_IO;
+		if (ln)
+			gcry_free(ln);
+	}
+	if (last.path)
+		gcry_free(last.path);
+	return;
+}
+
+static bool read_entry(crypto_t *c, last_path_t *last, file_type_e *tp, uint64_t *z, char **ln)
+{
+	/*
+	 * an entry in the manifest is the same as in the directory, just
+	 * without the data of any files; its path is left in last
+	 */
+	if (io_read(c->source, tp, sizeof( byte_t )) != sizeof( byte_t ) || !read_path(c, last, NULL))
+		return false;
+	switch (*tp)
+	{
+		case FILE_DIRECTORY:
+			return true;
+		case FILE_SYMLINK:
+		case FILE_LINK:
+			return (*ln = read_string(c, NULL));
+		case FILE_REGULAR:
+			if (io_read(c->source, z, sizeof *z) == sizeof *z)
+				return *z = ntohll(*z) , true;
+			break;
+	}
+	return false;
+}
+
+static char *read_string(crypto_t *c, uint64_t *o)
+{
+	uint64_t l = 0;
+	if (!read_length(c, &l, o) || l > SIZE_MAX - sizeof( byte_t ))
+		return NULL;
+	char *s = gcry_calloc_secure(l + sizeof( byte_t ), sizeof( char ));
+	if (!s)
+		die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ));
+	if (!read_at(c, s, l, o))
+	{
+		gcry_free(s);
+		return NULL;
+	}
+	return s;
+}
+
+static const char *read_path(crypto_t *c, last_path_t *last, uint64_t *o)
+{
+	/*
+	 * from 2027.05 a path is how much of it is the same as the last
+	 * one, and then the rest of it
+	 */
+	uint64_t s = 0;
+	uint64_t l = 0;
+	if (c->version >= VERSION_2027_05 && !read_length(c, &s, o))
+		return NULL;
+	if (s > last->length || !read_length(c, &l, o) || l > SIZE_MAX - s - sizeof( byte_t ))
+		return NULL;
+	if (s + l + sizeof( byte_t ) > last->size)
+	{
+		size_t z = last->size ? : BLOCK_SIZE;
+		while (s + l + sizeof( byte_t ) > z)
+			z *= 2;
+		char *x = last->path ? gcry_realloc(last->path, z) : gcry_malloc_secure(z);
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+		last->path = x;
+		last->size = z;
+	}
+	if (!read_at(c, last->path + s, l, o))
+		return NULL;
+	last->length = s + l;
+	last->path[last->length] = '\0';
+	return last->path;
+}
+
+static bool read_length(crypto_t *c, uint64_t *l, uint64_t *o)
+{
+	if (c->version < VERSION_2027_05)
+	{
+		if (!read_at(c, l, sizeof *l, o))
+			return false;
+		return *l = ntohll(*l) , true;
+	}
+	/*
+	 * 7 bits at a time, least significant first, with the top bit set
+	 * on all but the last byte
+	 */
+	*l = 0;
+	for (unsigned i = 0; i < 64; i += 7)
+	{
+		uint8_t b;
+		if (!read_at(c, &b, sizeof b, o))
+			return false;
+		*l |= (uint64_t)(b & 0x7F) << i;
+		if (!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+static void list_entry(crypto_t *c, file_type_e tp, const char *p, const uint64_t *z, const char *ln)
+{
+	/*
+	 * much like ls -l: what it is, how big it is, and where it is
+	 */
+	char t = '-';
+	switch (tp)
+	{
+		case FILE_DIRECTORY:
+			t = 'd';
+			break;
+		case FILE_SYMLINK:
+			t = 'l';
+			break;
+		case FILE_LINK:
+			t = 'h';
+			break;
+		case FILE_REGULAR:
+			break;
+	}
+	char s[0x20] = "-";
+	if (z)
+		snprintf(s, sizeof s, "%" PRIu64, *z);
+	char *x = NULL;
+	if (!asprintf(&x, "%c %12s  %s%s%s\n", t, s, p, ln ? (tp == FILE_LINK ? " link to " : " -> ") : "", ln ? : ""))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(s) + strlen(p) + (ln ? strlen(ln) : 0) + 0x10);
+	if (io_write(c->output, x, strlen(x)) < 0)
+		c->status = STATUS_FAILED_IO;
+	free(x);
+	return;
+}
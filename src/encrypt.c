@@ -47,6 +47,7 @@
 #include "common/ccrypt.h"
 #include "common/tlv.h"
 #include "common/dir.h"
+#include "common/walk.h"
 
 #include "crypt.h"
 #include "encrypt.h"
@@ -59,14 +60,46 @@ static inline void write_verification_sum(crypto_t *);
 static inline void write_metadata(crypto_t *);
 static inline void write_random_data(crypto_t *);
 
-static int64_t count_entries(crypto_t *, const char *);
+/*!
+ * \brief  The last path written (from 2027.05 each path is stored as how it differs from it)
+ */
+typedef struct
+{
+	char *path;    /*!< The path */
+	size_t length; /*!< Its length */
+	size_t size;   /*!< Size of the buffer */
+}
+last_path_t;
 
-static void encrypt_directory(crypto_t *, const char *);
-static char *encrypt_link(crypto_t *, char *, struct stat);
+/*!
+ * \brief  Where each entry in a directory starts (from 2027.03)
+ */
+typedef struct
+{
+	uint8_t *data;     /*!< The index, as it will be written */
+	size_t length;     /*!< Length of the index so far */
+	size_t size;       /*!< Size of the buffer */
+	uint64_t count;    /*!< Number of entries */
+	bool front_coded;  /*!< Whether paths are stored as how they differ from the last (from 2027.05) */
+	last_path_t last;  /*!< The last path in the index */
+}
+entry_index_t;
+
+static void write_manifest(crypto_t *, const char *);
+static void encrypt_directory(crypto_t *, entry_index_t *, last_path_t *, const char *);
+static char *encrypt_path(const char *, const char *);
+static void write_path(crypto_t *, last_path_t *, const char *);
+static void write_length(crypto_t *, uint64_t);
+static size_t path_shared(last_path_t *, const char *);
+static size_t varint(uint8_t *, uint64_t);
+static bool encrypt_type(crypto_t *, const walk_entry_t *, file_type_e *, char **);
+static char *encrypt_link(crypto_t *, const walk_entry_t *);
+#ifndef _WIN32
+static char *encrypt_symlink(const char *);
+#endif
 static void encrypt_stream(crypto_t *);
 static void encrypt_file(crypto_t *);
-
-static int comp_links(const void *a, const void *b);
+static bool is_compressible(crypto_t *);
 
 typedef struct
 {
@@ -76,11 +109,69 @@ typedef struct
 }
 link_count_t;
 
-static void free_link(void *l)
+/*!
+ * \brief  Files which might be hard links, indexed by device and inode
+ */
+typedef struct
+{
+	link_count_t *table; /*!< Open addressed hash table; empty slots have no path */
+	size_t size;         /*!< Number of slots (always a power of 2) */
+	size_t count;        /*!< Number of slots used */
+}
+link_table_t;
+
+static void links_reset(link_table_t *);
+#ifndef _WIN32
+static void links_grow(link_table_t *);
+static size_t links_hash(dev_t, ino_t);
+#endif
+
+static void index_append(entry_index_t *, uint64_t, const char *);
+
+#define MAP_BLOCK      (256 * KILOBYTE) /*!< How much of a mapped file to encrypt at a time */
+
+#define LINKS_SIZE     0x400 /*!< Initial number of slots in the table of hard links */
+
+#define INDEX_SIZE     (64 * KILOBYTE) /*!< Initial size of the index of directory entries */
+
+#define VARINT_MAX     10 /*!< Most bytes a 64 bit length can take once it’s encoded */
+
+#define SAMPLE_SIZE    4096 /*!< How much of a file to look at when deciding whether to compress it */
+#define SAMPLE_MINIMUM 1024 /*!< The smallest sample worth checking for randomness */
+#define SAMPLE_RANDOM  115  /*!< How much more often bytes can repeat than in random data (as a percentage) and still not be worth compressing */
+
+/*!
+ * \brief  Magic numbers of file types that are already compressed
+ */
+typedef struct
 {
-	free(((link_count_t *)l)->path);
-	free(l);
+	size_t offset;
+	size_t length;
+	const char *magic;
 }
+magic_t;
+
+static const magic_t COMPRESSED[] =
+{
+	{ 0, 3, "\xFF\xD8\xFF" },                    /* JPEG */
+	{ 0, 8, "\x89PNG\r\n\x1A\n" },               /* PNG */
+	{ 0, 4, "GIF8" },                            /* GIF */
+	{ 8, 4, "WEBP" },                            /* WebP */
+	{ 4, 4, "ftyp" },                            /* MP4, MOV, HEIC, etc */
+	{ 0, 4, "\x1A\x45\xDF\xA3" },                /* Matroska, WebM */
+	{ 0, 4, "OggS" },                            /* Ogg */
+	{ 0, 4, "fLaC" },                            /* FLAC */
+	{ 0, 3, "ID3" },                             /* MP3 */
+	{ 0, 4, "PK\x03\x04" },                      /* zip, jar, docx, odt, etc */
+	{ 0, 2, "\x1F\x8B" },                        /* gzip */
+	{ 0, 3, "BZh" },                             /* bzip2 */
+	{ 0, 6, "\xFD" "7zXZ\x00" },                 /* xz */
+	{ 0, 4, "\x28\xB5\x2F\xFD" },                /* zstd */
+	{ 0, 4, "\x04\x22\x4D\x18" },                /* lz4 */
+	{ 0, 6, "7z\xBC\xAF\x27\x1C" },              /* 7-Zip */
+	{ 0, 4, "Rar!" },                            /* RAR */
+	{ 0, 8, "\x36\x97\xDE\x5D\x96\xFC\xA0\xFA" } /* encrypt */
+};
 
 extern crypto_t *encrypt_init(const char * const restrict i,
                               const char * const restrict o,
@@ -195,6 +286,9 @@ extern crypto_t *encrypt_init(const char * const restrict i,
 
 	z->blocksize = BLOCK_SIZE;
 	z->compressed = x;
+	z->codec = CODEC_XZ;
+	z->compress_level = CODEC_LEVEL_DEFAULT;
+	z->compress_threads = 1;
 	z->follow_links = f;
 
 	/* if the user wants to skip the header information then they either
@@ -249,6 +343,13 @@ extern crypto_t *encrypt_init(const char * const restrict i,
 		case VERSION_2020_01:
 		case VERSION_2022_01:
 		case VERSION_2024_01:
+		case VERSION_2027_01:
+		case VERSION_2027_02:
+		case VERSION_2027_03:
+		case VERSION_2027_04:
+		case VERSION_2027_05:
+		case VERSION_2027_06:
+		case VERSION_2027_07:
 			z->kdf_iterations = n ? : KEY_ITERATIONS_DEFAULT;
 		// case VERSION_CURRENT:
 			/*
@@ -262,6 +363,15 @@ extern crypto_t *encrypt_init(const char * const restrict i,
 	return z;
 }
 
+extern crypto_status_e encrypt_codec_check(io_codec_e z, version_e v)
+{
+	if (!io_codec_available(z))
+		return STATUS_FAILED_UNKNOWN_TAG;
+	if (z != CODEC_XZ && v && v < VERSION_2027_01)
+		return STATUS_FAILED_OUTPUT_MISMATCH;
+	return STATUS_INIT;
+}
+
 static void *process(void *ptr)
 {
 	crypto_t *c = (crypto_t *)ptr;
@@ -269,6 +379,14 @@ static void *process(void *ptr)
 	if (!c || c->status != STATUS_INIT)
 		return NULL;
 
+	if (c->compressed && (c->status = encrypt_codec_check(c->codec, c->version)) != STATUS_INIT)
+		return (void *)c->status;
+
+	if (c->direct_io)
+	{
+		io_direct_init(c->source);
+		io_direct_init(c->output);
+	}
 	if (!c->raw)
 		write_header(c);
 
@@ -294,6 +412,13 @@ static void *process(void *ptr)
 		case VERSION_2020_01:
 		case VERSION_2022_01:
 		case VERSION_2024_01:
+		case VERSION_2027_01:
+		case VERSION_2027_02:
+		case VERSION_2027_03:
+		case VERSION_2027_04:
+		case VERSION_2027_05:
+		case VERSION_2027_06:
+		case VERSION_2027_07:
 		default:
 			/* no changes */
 			break;
@@ -304,13 +429,19 @@ static void *process(void *ptr)
 	 * of the IV and salt, both of which are auto-generated during
 	 * the encryption initialisation)
 	 */
-	io_extra_t iox = { iv_type, true };
+	io_extra_t iox = { iv_type, true, c->threads, c->version >= VERSION_2027_02, c->version >= VERSION_2027_06, c->version >= VERSION_2027_07, c->master };
 	if (!io_encryption_init(c->output, c->cipher, c->hash, c->mode, c->mac, c->kdf_iterations, c->key, c->length, iox))
 		return (c->status = STATUS_FAILED_GCRYPT_INIT , (void *)c->status);
 
 	c->status = STATUS_RUNNING;
 	gcry_free(c->key);
 	c->key = NULL;
+	/*
+	 * error correction and writing the output can happen while the
+	 * next data is being encrypted (unless we’re single threaded)
+	 */
+	if (c->threads != 1)
+		io_pipeline_init(c->output, true);
 
 	if (!c->raw)
 	{
@@ -329,20 +460,24 @@ static void *process(void *ptr)
 	 * everything from here will be compressed (if necessary)
 	 */
 	if (c->compressed)
-		io_compression_init(c->output);
+	{
+		io_compress_t ioz = { c->codec, c->compress_level, c->compress_threads, c->compress_block };
+		io_compression_init(c->output, ioz);
+	}
 
 	io_encryption_checksum_init(c->output, c->hash);
 
 	if (c->directory)
 	{
-		io_write(c->output, &((file_type_e){FILE_DIRECTORY}), sizeof( byte_t ));
 		/*
-		 * strip leading directories and trailing /
+		 * strip leading directories and trailing /; entries are found
+		 * from the directory they were in (rather than changing to it,
+		 * as that would affect anything else being encrypted too)
 		 */
 		char *ps = c->path + (strlen(c->path) - 1);
 		if (*ps == '/')
 			*ps = '\0';
-		char *cwd = NULL;
+		char *parent = NULL;
 #ifndef _WIN32
 		char *dir = strrchr(c->path, '/');
 #else
@@ -352,26 +487,49 @@ static void *process(void *ptr)
 		{
 			*dir = '\0';
 			dir++;
-			cwd = getcwd(NULL, 0);
-			chdir(c->path);
-			free(c->path);
+			parent = c->path;
 			if (!(c->path = strdup(dir)))
 				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(dir));
 		}
-		uint64_t l = htonll(strlen(c->path));
-		io_write(c->output, &l, sizeof l);
-		io_write(c->output, c->path, strlen(c->path));
+		link_table_t links = { NULL, 0, 0 };
+		c->misc = &links;
+		if (c->version >= VERSION_2027_04)
+		{
+			/*
+			 * hard links are found again (in the same order) when
+			 * everything is encrypted
+			 */
+			write_manifest(c, parent);
+			links_reset(&links);
+			walk_rewind(c->tree);
+		}
+		last_path_t last = { NULL, 0, 0 };
+		io_write(c->output, &((file_type_e){FILE_DIRECTORY}), sizeof( byte_t ));
+		write_path(c, &last, c->path);
 		c->total.offset = 1;
-		c->misc = list_init(comp_links, false, false);
-		encrypt_directory(c, c->path);
+		entry_index_t index = { NULL, 0, 0, 0, c->version >= VERSION_2027_05, { NULL, 0, 0 } };
+		encrypt_directory(c, c->version >= VERSION_2027_03 ? &index : NULL, &last, parent);
 		c->current.display = FINISHING_UP;
-		list_deinit(c->misc, free_link);
-		c->misc = NULL;
-		if (cwd)
+		if (c->version >= VERSION_2027_03 && c->status == STATUS_RUNNING)
 		{
-			chdir(cwd);
-			gcry_free(cwd);
+			/*
+			 * where each entry is comes after them all; it’s
+			 * bookmarked so a single entry can be found (and
+			 * decrypted) without reading everything first
+			 */
+			io_chunk_bookmark_set(c->output, io_chunk_position(c->output));
+			uint64_t n = htonll(index.count);
+			io_write(c->output, &n, sizeof n);
+			io_write(c->output, index.data, index.length);
 		}
+		free(index.data);
+		free(index.last.path);
+		free(last.path);
+		links_reset(&links);
+		c->misc = NULL;
+		walk_deinit(c->tree);
+		c->tree = NULL;
+		free(parent);
 	}
 	else
 	{
@@ -416,6 +574,8 @@ static void *process(void *ptr)
 	 * done
 	 */
 	io_sync(c->output);
+	io_stats_collect(c->source, &c->stats);
+	io_stats_collect(c->output, &c->stats);
 	c->status = STATUS_SUCCESS;
 
 #ifndef __DEBUG__
@@ -490,7 +650,15 @@ static inline void write_verification_sum(crypto_t *c)
 static inline void write_metadata(crypto_t *c)
 {
 	if (c->directory)
-		c->total.size = count_entries(c, c->path);
+	{
+		/*
+		 * find everything that’s going to be encrypted now; the count
+		 * is needed up front, and the order is then the same as when
+		 * the entries are actually encrypted
+		 */
+		c->tree = walk_init(c->path, c->follow_links, c->threads);
+		c->total.size = walk_count(c->tree) + 1;
+	}
 	else
 	{
 		c->total.size = io_seek(c->source, 0, SEEK_END);
@@ -517,6 +685,12 @@ static inline void write_metadata(crypto_t *c)
 		tlv_t t = { TAG_COMPRESSED, sizeof b, &b };
 		tlv_append(tlv, t);
 	}
+	if (c->compressed && c->version >= VERSION_2027_01)
+	{
+		uint8_t z[] = { c->codec, io_codec_level(c->codec, c->compress_level) };
+		tlv_t t = { TAG_CODEC, sizeof z, z };
+		tlv_append(tlv, t);
+	}
 	if (c->directory)
 	{
 		bool b = c->directory;
@@ -557,182 +731,246 @@ static inline void write_random_data(crypto_t *c)
 	return (void)c;
 }
 
-static int64_t count_entries(crypto_t *c, const char *dir)
+static void write_manifest(crypto_t *c, const char *parent)
 {
-	struct dirent **eps = NULL;
-	int n = 0;
-	int64_t e = 1;
-	errno = 0;
-	if ((n = scandir(dir, &eps, NULL, NULL)))
+	/*
+	 * everything in the directory, as it will be encrypted, but without
+	 * any of the data; so it can be listed without reading any further
+	 */
+	uint64_t n = htonll(c->total.size);
+	io_write(c->output, &n, sizeof n);
+	last_path_t last = { NULL, 0, 0 };
+	io_write(c->output, &((file_type_e){FILE_DIRECTORY}), sizeof( byte_t ));
+	write_path(c, &last, c->path);
+	for (const walk_entry_t *e; (e = walk_next(c->tree)); )
 	{
-		for (int i = 0; i < n; ++i)
+		file_type_e tp;
+		char *ln = NULL;
+		if (!encrypt_type(c, e, &tp, &ln))
+			continue;
+		io_write(c->output, &tp, sizeof( byte_t ));
+		write_path(c, &last, e->path);
+		switch (tp)
 		{
-			if (!strcmp(".", eps[i]->d_name) || !strcmp("..", eps[i]->d_name))
-				continue;
-			size_t l = strlen(eps[i]->d_name);
-			char *filename = NULL;
-			if (!asprintf(&filename, "%s/%s", dir, eps[i]->d_name))
-				die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(dir) + l + 2);
-			struct stat s;
-			c->follow_links ? stat(filename, &s) : lstat(filename, &s);
-			if (S_ISDIR(s.st_mode))
-				e += count_entries(c, filename);
-			else if (S_ISREG(s.st_mode))
-				e++;
+			case FILE_DIRECTORY:
+				break;
+			case FILE_SYMLINK:
 #ifndef _WIN32
-			else if (!c->follow_links && S_ISLNK(s.st_mode))
-				e++;
+				{
+					char *p = encrypt_path(parent, e->path);
+					char *sl = encrypt_symlink(p);
+					write_length(c, strlen(sl));
+					io_write(c->output, sl, strlen(sl));
+					gcry_free(sl);
+					free(p);
+				}
 #endif
-			gcry_free(filename);
+				break;
+			case FILE_LINK:
+				write_length(c, strlen(ln));
+				io_write(c->output, ln, strlen(ln));
+				break;
+			case FILE_REGULAR:
+				/*
+				 * as it was when the directory was scanned
+				 */
+				n = htonll(e->size);
+				io_write(c->output, &n, sizeof n);
+				break;
 		}
 	}
-	for (int i = 0; i < n; ++i)
-		gcry_free(eps[i]);
-	gcry_free(eps);
-	return e;
+	free(last.path);
+	return;
 }
 
-static void encrypt_directory(crypto_t *c, const char *dir)
+static void encrypt_directory(crypto_t *c, entry_index_t *index, last_path_t *last, const char *parent)
 {
-	struct dirent **eps = NULL;
-	int n = 0;
-	if ((n = scandir(dir, &eps, NULL, NULL)))
+	for (const walk_entry_t *e; c->status == STATUS_RUNNING && (e = walk_next(c->tree)); )
 	{
-		for (int i = 0; i < n && c->status == STATUS_RUNNING; ++i)
+		const char *filename = e->path;
+		c->current.display = (char *)filename;
+		file_type_e tp;
+		char *ln = NULL;
+		if (!encrypt_type(c, e, &tp, &ln))
+			continue;
+		if (index)
+			index_append(index, io_chunk_position(c->output), filename);
+		io_write(c->output, &tp, sizeof( byte_t ));
+		write_path(c, last, filename);
+		switch (tp)
 		{
-			if (!strcmp(".", eps[i]->d_name) || !strcmp("..", eps[i]->d_name))
-				continue;
-			uint64_t l = strlen(eps[i]->d_name);
-			char *filename = NULL;
-			if (!asprintf(&filename, "%s/%s", dir, eps[i]->d_name))
-				die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, strlen(dir) + l + 2);
-			c->current.display = filename;
-			file_type_e tp;
-			struct stat s;
-			c->follow_links ? stat(filename, &s) : lstat(filename, &s);
-			char *ln = NULL;
-			switch (s.st_mode & S_IFMT)
-			{
-				case S_IFDIR:
-					tp = FILE_DIRECTORY;
-					break;
-#ifndef _WIN32
-				case S_IFLNK:
-					tp = (ln = encrypt_link(c, filename, s)) ? FILE_LINK : FILE_SYMLINK;
-					break;
-#endif
-				case S_IFREG:
-					tp = (ln = encrypt_link(c, filename, s)) ? FILE_LINK : FILE_REGULAR;
-					break;
-				default:
-					gcry_free(filename);
-					continue;
-			}
-			io_write(c->output, &tp, sizeof( byte_t ));
-			l = htonll(strlen(filename));
-			io_write(c->output, &l, sizeof l);
-			io_write(c->output, filename, strlen(filename));
-			switch (tp)
-			{
-				case FILE_DIRECTORY:
-					/*
-					 * recurse into each directory as necessary
-					 */
-					encrypt_directory(c, filename);
-					break;
-				case FILE_SYMLINK:
+			case FILE_DIRECTORY:
+				/*
+				 * its entries come next
+				 */
+				break;
+			case FILE_SYMLINK:
 #ifndef _WIN32
-					{
-						/*
-						 * store the link instead of the file/directory
-						 * it points to
-						 */
-						char *sl = gcry_malloc_secure(sizeof( byte_t ));
-						for (l = BLOCK_SIZE; ; l += BLOCK_SIZE)
-						{
-							char *x = gcry_realloc(sl, l + sizeof( byte_t ));
-							if (!x)
-								die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ) );
-							sl = x;
-							if (readlink(filename, sl, BLOCK_SIZE + l) < (int64_t)l)
-								break;
-						}
-						l = htonll(strlen(sl));
-						io_write(c->output, &l, sizeof l);
-						io_write(c->output, sl, strlen(sl));
-					}
+				{
+					char *p = encrypt_path(parent, filename);
+					char *sl = encrypt_symlink(p);
+					write_length(c, strlen(sl));
+					io_write(c->output, sl, strlen(sl));
+					gcry_free(sl);
+					free(p);
+				}
 #endif
-					break;
-				case FILE_LINK:
+				break;
+			case FILE_LINK:
 #ifndef _WIN32
-					/*
-					 * store a hard link; it’s basically the same as a
-					 * symlink at this point, but will be handled
-					 * differently upon decryption
-					 */
-					l = htonll(strlen(ln));
-					io_write(c->output, &l, sizeof l);
-					io_write(c->output, ln, strlen(ln));
+				/*
+				 * store a hard link; it’s basically the same as a
+				 * symlink at this point, but will be handled
+				 * differently upon decryption
+				 */
+				write_length(c, strlen(ln));
+				io_write(c->output, ln, strlen(ln));
 #endif
-					break;
-				case FILE_REGULAR:
+				break;
+			case FILE_REGULAR:
+				/*
+				 * when we have a file:
+				 */
+				if (c->source)
+					io_close(c->source);
+				char *p = encrypt_path(parent, filename);
+				c->source = io_open(p, O_RDONLY | F_RDLCK | O_BINARY, S_IRUSR | S_IWUSR);
+				free(p);
+				if (c->direct_io && c->source)
+					io_direct_init(c->source);
+				if (c->source)
+					io_stats_init(c->source, &c->stats);
+				c->current.offset = 0;
+				c->current.size = io_seek(c->source, 0, SEEK_END);
+				uint64_t z = htonll(c->current.size);
+				io_write(c->output, &z, sizeof z);
+				io_seek(c->source, 0, SEEK_SET);
+				if (c->compressed && c->version >= VERSION_2027_01 && !is_compressible(c))
+				{
 					/*
-					 * when we have a file:
+					 * don’t waste time trying to compress files
+					 * that won’t get any smaller
 					 */
-					if (c->source)
-						io_close(c->source);
-					c->source = io_open(filename, O_RDONLY | F_RDLCK | O_BINARY, S_IRUSR | S_IWUSR);
-					c->current.offset = 0;
-					c->current.size = io_seek(c->source, 0, SEEK_END);
-					uint64_t z = htonll(c->current.size);
-					io_write(c->output, &z, sizeof z);
-					io_seek(c->source, 0, SEEK_SET);
+					io_write(c->output, &((byte_t){true}), sizeof( byte_t ));
+					io_compression_pause(c->output);
 					encrypt_file(c);
-					c->current.offset = c->current.size;
-					io_close(c->source);
-					c->source = NULL;
-					break;
-			}
-			gcry_free(filename);
-			c->total.offset++;
-			c->current.display = NULL;
+					io_compression_resume(c->output);
+				}
+				else
+				{
+					if (c->compressed && c->version >= VERSION_2027_01)
+						io_write(c->output, &((byte_t){false}), sizeof( byte_t ));
+					encrypt_file(c);
+				}
+				c->current.offset = c->current.size;
+				io_close(c->source);
+				c->source = NULL;
+				break;
 		}
-		/*
-		 * no more files in this directory
-		 */
+		c->total.offset++;
+		c->current.display = NULL;
 	}
-	for (int i = 0; i < n; ++i)
-		gcry_free(eps[i]);
-	gcry_free(eps);
 	return;
 }
 
-static char *encrypt_link(crypto_t *c, char *filename, struct stat s)
+static char *encrypt_path(const char *d, const char *p)
 {
-	LIST links = c->misc;
-	link_count_t *link = calloc(1, sizeof (link_count_t));
-	link->dev   = s.st_dev;
-	link->inode = s.st_ino;
-	link->path  = strdup(filename);
-#ifndef _WIN32
-	link_count_t *existing = NULL;
-	if ((existing = (link_count_t *)list_contains(links, link)))
+	/*
+	 * where an entry actually is, from the directory containing the
+	 * top directory
+	 */
+	char *x = NULL;
+	if (!d)
+		x = strdup(p);
+	else if (asprintf(&x, "%s%s%s", d, DIR_SEPARATOR, p) < 0)
+		x = NULL;
+	if (!x)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, (d ? strlen(d) : 0) + strlen(p) + 2 * sizeof( byte_t ));
+	return x;
+}
+
+static bool encrypt_type(crypto_t *c, const walk_entry_t *e, file_type_e *tp, char **ln)
+{
+	switch (e->type)
 	{
-		free(link->path);
-		free(link);
-		return existing->path;
+		case WALK_DIRECTORY:
+			*tp = FILE_DIRECTORY;
+			break;
+#ifndef _WIN32
+		case WALK_SYMLINK:
+			*tp = (*ln = encrypt_link(c, e)) ? FILE_LINK : FILE_SYMLINK;
+			break;
+#endif
+		case WALK_REGULAR:
+			*tp = (*ln = encrypt_link(c, e)) ? FILE_LINK : FILE_REGULAR;
+			break;
+		default:
+			return false;
 	}
+	return true;
+}
+
+static char *encrypt_link(crypto_t *c, const walk_entry_t *e)
+{
+#ifndef _WIN32
+	/*
+	 * only a file with more than one link can be seen again (unless
+	 * symlinks are being followed, in which case anything can)
+	 */
+	if (e->links < 2 && !c->follow_links)
+		return NULL;
+	link_table_t *links = c->misc;
+	if ((links->count + 1) * 4 > links->size * 3)
+		links_grow(links);
+	size_t i = links_hash(e->dev, e->inode) & (links->size - 1);
+	for (; links->table[i].path; i = (i + 1) & (links->size - 1))
+		if (links->table[i].dev == e->dev && links->table[i].inode == e->inode)
+			return links->table[i].path;
+	links->table[i].dev   = e->dev;
+	links->table[i].inode = e->inode;
+	if (!(links->table[i].path = strdup(e->path)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(e->path));
+	links->count++;
+#else
+	(void)c;
+	(void)e;
 #endif
-	list_add(links, link);
 	return NULL;
 }
 
+#ifndef _WIN32
+static char *encrypt_symlink(const char *p)
+{
+	/*
+	 * store the link instead of the file/directory it points to
+	 */
+	char *sl = gcry_malloc_secure(sizeof( byte_t ));
+	if (!sl)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, sizeof( byte_t ));
+	for (size_t l = BLOCK_SIZE; ; l += BLOCK_SIZE)
+	{
+		char *x = gcry_realloc(sl, l + sizeof( byte_t ));
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, l + sizeof( byte_t ));
+		sl = x;
+		ssize_t r = readlink(p, sl, l);
+		if (r < (ssize_t)l)
+		{
+			sl[r < 0 ? 0 : r] = '\0';
+			return sl;
+		}
+	}
+}
+#endif
+
 static void encrypt_stream(crypto_t *c)
 {
 	bool b = true;
 	uint8_t *buffer;
 	if (!(buffer = gcry_malloc_secure(c->blocksize + sizeof b)))
 		die(_("Out of memory @ %s:%d:%s [%" PRIu64 "]"), __FILE__, __LINE__, __func__, c->blocksize + sizeof b);
+	if (c->threads != 1)
+		io_pipeline_init(c->source, false);
 	do
 	{
 		errno = EXIT_SUCCESS;
@@ -764,15 +1002,43 @@ static void encrypt_stream(crypto_t *c)
 
 static void encrypt_file(crypto_t *c)
 {
+	/*
+	 * regular files are encrypted straight from the page cache; the
+	 * data isn’t copied anywhere first
+	 */
+	const void *m = NULL;
+	int64_t r = io_map(c->source, &m, c->current.size < MAP_BLOCK ? c->current.size : MAP_BLOCK);
+	if (r >= 0)
+	{
+		for (c->current.offset = 0; r > 0 && c->status == STATUS_RUNNING; )
+		{
+			io_write(c->output, m, r);
+			/*
+			 * keep going until there’s nothing left, so that the file
+			 * being truncated underneath us is noticed (even after the
+			 * last of it)
+			 */
+			c->current.offset += r;
+			r = io_map(c->source, &m, c->current.size - c->current.offset < MAP_BLOCK ? c->current.size - c->current.offset : MAP_BLOCK);
+		}
+		if (r < 0)
+			c->status = STATUS_FAILED_IO;
+		return;
+	}
+
 	uint8_t buffer[BLOCK_SIZE];
+	/*
+	 * read ahead while the previous data is being encrypted
+	 */
+	if (c->threads != 1)
+		io_pipeline_init(c->source, false);
 	for (c->current.offset = 0; c->current.offset < c->current.size && c->status == STATUS_RUNNING; c->current.offset += BLOCK_SIZE)
 	{
 		errno = EXIT_SUCCESS;
 		/*
 		 * read plaintext file, write encrypted data
 		 */
-		int64_t r = io_read(c->source, buffer, BLOCK_SIZE);
-		if (r < 0)
+		if ((r = io_read(c->source, buffer, BLOCK_SIZE)) < 0)
 		{
 			c->status = STATUS_FAILED_IO;
 			break;
@@ -782,11 +1048,183 @@ static void encrypt_file(crypto_t *c)
 	return;
 }
 
-static int comp_links(const void *a, const void *b)
+static bool is_compressible(crypto_t *c)
+{
+	uint8_t sample[SAMPLE_SIZE];
+	ssize_t n = io_read(c->source, sample, sizeof sample);
+	io_seek(c->source, 0, SEEK_SET);
+	if (n <= 0)
+		return true;
+	for (size_t i = 0; i < sizeof COMPRESSED / sizeof COMPRESSED[0]; i++)
+		if ((size_t)n >= COMPRESSED[i].offset + COMPRESSED[i].length && !memcmp(sample + COMPRESSED[i].offset, COMPRESSED[i].magic, COMPRESSED[i].length))
+			return false;
+	if (n < SAMPLE_MINIMUM)
+		return true;
+	/*
+	 * data that’s already compressed (or encrypted) looks random; find
+	 * how often any two bytes in the sample are the same compared to
+	 * how often they would be if it was random (1 in 256)
+	 */
+	uint64_t f[0x100] = { 0 };
+	for (ssize_t i = 0; i < n; i++)
+		f[sample[i]]++;
+	uint64_t m = 0;
+	for (unsigned i = 0; i < 0x100; i++)
+		m += f[i] * (f[i] - (f[i] ? 1 : 0));
+	return m * 0x100 * 100 > (uint64_t)n * (n - 1) * SAMPLE_RANDOM;
+}
+
+static void links_reset(link_table_t *links)
+{
+	for (size_t i = 0; i < links->size; i++)
+		free(links->table[i].path);
+	free(links->table);
+	links->table = NULL;
+	links->size = 0;
+	links->count = 0;
+	return;
+}
+
+#ifndef _WIN32
+static void links_grow(link_table_t *links)
 {
-	const link_count_t *x = a;
-	const link_count_t *y = b;
-	if (x->dev != y->dev)
-		return x->dev - y->dev;
-	return x->inode - y->inode;
+	size_t z = links->size ? links->size * 2 : LINKS_SIZE;
+	link_count_t *t = calloc(z, sizeof( link_count_t ));
+	if (!t)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z * sizeof( link_count_t ));
+	for (size_t i = 0; i < links->size; i++)
+		if (links->table[i].path)
+		{
+			size_t j = links_hash(links->table[i].dev, links->table[i].inode) & (z - 1);
+			while (t[j].path)
+				j = (j + 1) & (z - 1);
+			t[j] = links->table[i];
+		}
+	free(links->table);
+	links->table = t;
+	links->size = z;
+	return;
+}
+
+static size_t links_hash(dev_t d, ino_t i)
+{
+	/*
+	 * inodes are often close together, so mix the bits up (splitmix64)
+	 * to stop them all ending up in the same part of the table
+	 */
+	uint64_t x = (uint64_t)i ^ ((uint64_t)d * 0x9E3779B97F4A7C15LLU);
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9LLU;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBLLU;
+	return x ^ (x >> 31);
+}
+#endif
+
+static void index_append(entry_index_t *index, uint64_t o, const char *p)
+{
+	/*
+	 * each entry is where it starts (in the plaintext) and its path
+	 */
+	uint64_t l = strlen(p);
+	size_t n = sizeof o + 2 * VARINT_MAX + l;
+	if (index->length + n > index->size)
+	{
+		size_t z = index->size ? : INDEX_SIZE;
+		while (index->length + n > z)
+			z *= 2;
+		uint8_t *x = realloc(index->data, z);
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+		index->data = x;
+		index->size = z;
+	}
+	uint8_t *d = index->data + index->length;
+	o = htonll(o);
+	memcpy(d, &o, sizeof o);
+	d += sizeof o;
+	if (index->front_coded)
+	{
+		size_t s = path_shared(&index->last, p);
+		d += varint(d, s);
+		d += varint(d, l - s);
+		memcpy(d, p + s, l - s);
+		d += l - s;
+	}
+	else
+	{
+		l = htonll(l);
+		memcpy(d, &l, sizeof l);
+		d += sizeof l;
+		memcpy(d, p, strlen(p));
+		d += strlen(p);
+	}
+	index->length = d - index->data;
+	index->count++;
+	return;
+}
+
+static void write_path(crypto_t *c, last_path_t *last, const char *p)
+{
+	/*
+	 * from 2027.05 a path is how much of it is the same as the last
+	 * one, and then the rest of it; most entries are next to others in
+	 * the same directory, so all that’s left is usually just the name
+	 */
+	size_t l = strlen(p);
+	size_t s = 0;
+	if (c->version >= VERSION_2027_05)
+	{
+		s = path_shared(last, p);
+		write_length(c, s);
+	}
+	write_length(c, l - s);
+	io_write(c->output, p + s, l - s);
+	return;
+}
+
+static void write_length(crypto_t *c, uint64_t l)
+{
+	if (c->version < VERSION_2027_05)
+	{
+		l = htonll(l);
+		io_write(c->output, &l, sizeof l);
+		return;
+	}
+	uint8_t b[VARINT_MAX];
+	io_write(c->output, b, varint(b, l));
+	return;
+}
+
+static size_t path_shared(last_path_t *last, const char *p)
+{
+	size_t s = 0;
+	while (s < last->length && last->path[s] == p[s])
+		s++;
+	size_t l = strlen(p);
+	if (l + sizeof( byte_t ) > last->size)
+	{
+		size_t z = last->size ? : BLOCK_SIZE;
+		while (l + sizeof( byte_t ) > z)
+			z *= 2;
+		char *x = realloc(last->path, z);
+		if (!x)
+			die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, z);
+		last->path = x;
+		last->size = z;
+	}
+	memcpy(last->path + s, p + s, l - s + sizeof( byte_t ));
+	last->length = l;
+	return s;
+}
+
+static size_t varint(uint8_t *b, uint64_t v)
+{
+	/*
+	 * 7 bits at a time, least significant first, with the top bit set
+	 * on all but the last byte
+	 */
+	size_t n = 0;
+	for (; v > 0x7F; v >>= 7)
+		b[n++] = (v & 0x7F) | 0x80;
+	b[n++] = v;
+	return n;
 }
@@ -64,4 +64,16 @@ extern crypto_t *encrypt_init(const char * const restrict i,
                               const void * const restrict k,
                               size_t l, uint64_t n, bool r, bool x, bool f, version_e v) __attribute__((nonnull(3, 4, 5, 6, 7)));
 
+/*!
+ * \brief         Check a compression codec can be used
+ * \param[in]  z  The compression codec
+ * \param[in]  v  Backwards compatibility version
+ * \return        STATUS_INIT if the codec can be used; otherwise why not
+ *
+ * Check the codec before anything is created: it must have been built
+ * in, and only xz can be used with versions before 2027.01 (they have no
+ * way of recording which codec was used).
+ */
+extern crypto_status_e encrypt_codec_check(io_codec_e z, version_e v);
+
 #endif /* ! _ENCRYPT_ENCRYPT_H */
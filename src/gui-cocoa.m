@@ -77,7 +77,7 @@ static key_source_e key_source = KEY_SOURCE_PASSWORD;
 	};
 	config_init(about);
 
-	LIST args = list_init(config_named_compare, false, false);
+	LIST args = list_init(config_named_compare, false, false, LIST_VECTOR);
 	// TODO If there's no CLI then remove the display text
 	list_add(args, &((config_named_t){ 'c', "cipher",         _("algorithm"),  _("Algorithm to use to encrypt data; use ‘list’ to show available cipher algorithms"),                                      CONFIG_ARG_REQ_STRING,  { .string  = NULL  }, false, false, false, false }));
 	list_add(args, &((config_named_t){ 's', "hash",           _("algorithm"),  _("Hash algorithm to generate key; use ‘list’ to show available hash algorithms"),                                          CONFIG_ARG_REQ_STRING,  { .string  = NULL  }, false, false, false, false }));
@@ -25,6 +25,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdarg.h>
+#include <ctype.h>
 
 #include <pthread.h>
 
@@ -57,6 +58,8 @@
 #include "crypt.h"
 #include "encrypt.h"
 #include "decrypt.h"
+#include "batch.h"
+#include "benchmark.h"
 
 #ifdef BUILD_GUI
 	#include "gui.h"
@@ -76,7 +79,13 @@ static bool list_ciphers(void);
 static bool list_hashes(void);
 static bool list_modes(void);
 static bool list_macs(void);
+static bool list_codecs(void);
 
+static bool parse_compress(const char *, uint64_t *, uint64_t *);
+static bool parse_range(const char *, uint64_t *, uint64_t *);
+static uint64_t parse_size(const char *, char **);
+static void parse_codec(const char *, io_codec_e *, int *);
+static void report_stats(const io_stats_t *);
 static void self_test(void) __attribute__((noreturn));
 
 static config_about_t about =
@@ -108,14 +117,14 @@ int main(int argc, char **argv)
 	version_check_for_update(ENCRYPT_VERSION, UPDATE_URL, DOWNLOAD_URL_TEMPLATE);
 #endif
 
-	LIST args = list_init(config_named_compare, false, false);
+	LIST args = list_init(config_named_compare, false, false, LIST_VECTOR);
 #ifdef BUILD_GUI
 	#ifndef _WIN32
 	list_add(args, &((config_named_t){ 'g', "no-gui",         NULL,            _("Do not use the GUI, even if it’s available"),                                                                            { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, false, false, false }));
 	#endif
 	list_add(args, &((config_named_t){ 0x1, "key-source",     _("key source"), _("Key data source"),                                                                                                       { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, false, true,  false }));
-	list_add(args, &((config_named_t){ 0x2, "compress",       NULL,            _("Compress the plain text using the xz algorithm"),                                                                        { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, false, true,  false }));
 #endif
+	list_add(args, &((config_named_t){ 0x2, "compress",       _("threads"),    _("Compress using the xz block encoder on this many threads (0 for one per CPU), optionally followed by the block size; eg 4:16M"), { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
 	list_add(args, &((config_named_t){ 'u', "no-cli",         NULL,            _("Do not display the CLI progress bar"),                                                                                   { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, false, false, false }));
 	list_add(args, &((config_named_t){ 'c', "cipher",         _("algorithm"),  _("Algorithm to use to encrypt data; use ‘list’ to show available cipher algorithms"),                                      { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, true,  false, false, false }));
 	list_add(args, &((config_named_t){ 's', "hash",           _("algorithm"),  _("Hash algorithm to generate key; use ‘list’ to show available hash algorithms"),                                          { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, true,  false, false, false }));
@@ -128,6 +137,16 @@ int main(int argc, char **argv)
 	list_add(args, &((config_named_t){ 'f', "follow",         NULL,            _("Follow symlinks, the default is to store the link itself"),                                                              { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, false, false, false }));
 	list_add(args, &((config_named_t){ 'b', "back-compat",    _("version"),    _("Create an encrypted file that is backwards compatible"),                                                                 { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
 	list_add(args, &((config_named_t){ 'r', "raw",            NULL,            _("Don’t generate or look for an encrypt header; this IS NOT recommended, but can be useful in some (limited) situations"), { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 't', "threads",        _("threads"),    _("Number of threads to use for encryption (CTR, XTS and ECB modes only); 0 for one per CPU, 1 to also read/write on the same thread"), { CONFIG_ARG_REQ_INTEGER, { .integer = 0                      } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 'z', "codec",          _("codec"),      _("Compression algorithm (xz, zstd or lz4), optionally followed by the level; eg zstd:3. Use ‘list’ to show available codecs"), { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 'd', "direct-io",      NULL,            _("Read and write files without going through the page cache; for very large files"),                                      { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x4, "range",          _("offset"),     _("Only decrypt this much of a file, starting from the given offset; eg 2G:512M (from 2027.02)"),                           { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x5, "extract",        _("path"),       _("Only decrypt this file (or directory) from an encrypted directory (from 2027.03)"),                                      { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x6, "list",           NULL,            _("List what was encrypted, without decrypting any of it (directories from 2027.04)"),                                      { CONFIG_ARG_REQ_BOOLEAN, { .boolean = false                  } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x7, "batch",          _("jobs"),       _("Encrypt (or decrypt) every file given, this many at once (0 for one per CPU); encrypted files are decrypted, everything else is encrypted"), { CONFIG_ARG_REQ_INTEGER, { .integer = 0                      } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x8, "batch-list",     _("file"),       _("Also encrypt (or decrypt) every file named in this file (- for stdin), one per line or NUL separated"),                 { CONFIG_ARG_REQ_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0x9, "benchmark",      _("json"),       _("Measure how quickly each algorithm runs on this machine (in memory), optionally writing the results as JSON"),            { CONFIG_ARG_OPT_STRING,  { .string  = NULL                   } }, false, true,  false, false }));
+	list_add(args, &((config_named_t){ 0xA, "stats",          NULL,            _("Once done, show how much time was spent reading, hashing, compressing, encrypting, error correcting and writing"),       { CONFIG_ARG_BOOLEAN,     { .boolean = false                  } }, false, true,  false, false }));
 	list_add(args, &((config_named_t){ 0x3, "self-test",      NULL,            _("Perform self-test routine"),                                                                                             { CONFIG_ARG_BOOLEAN,     { .boolean = false                  } }, false, true,  true,  false }));
 
 	LIST extra = list_default();
@@ -141,6 +160,7 @@ int main(int argc, char **argv)
 	list_add(notes, _("When encrypting, -c, -s -m, and -a are required to specify the algorithms you wish to use; when decrypting the algorithms originally used are read from the encrypted file, (although you can omit the algorithm options if you have configured defaults in ~/.encryptrc)."));
 	list_add(notes, _("If you encrypted data using --raw then you will need to pass the algorithms as arguments when decrypting."));
 	list_add(notes, _("You can toggle compression and how symbolic links are handled in the configuration file ~/.encryptrc"));
+	list_add(notes, _("With --batch every file given is a source; each is encrypted to a file of the same name with .X added, and decrypted back to its original name."));
 
 #ifndef _WIN32
 	bool dude = false;
@@ -154,6 +174,8 @@ int main(int argc, char **argv)
 		x++;
 		((config_named_t *)list_get(args, ++x))->hidden = true;
 		((config_named_t *)list_get(args, ++x))->hidden = true;
+#else
+		x++; /* compress; the threads are used for decompression too */
 #endif
 		((config_named_t *)list_get(args, ++x))->hidden = true;
 		((config_named_t *)list_get(args, ++x))->hidden = true;
@@ -164,6 +186,8 @@ int main(int argc, char **argv)
 		((config_named_t *)list_get(args, ++x))->hidden = true;
 		((config_named_t *)list_get(args, ++x))->hidden = true;
 		((config_named_t *)list_get(args, ++x))->hidden = true;
+		x += 2;
+		((config_named_t *)list_get(args, ++x))->hidden = true;
 	}
 	else
 #endif
@@ -179,14 +203,13 @@ int main(int argc, char **argv)
 	char *output   = ((config_unnamed_t *)list_get(extra, 1))->response.value.string;
 
 	int x = -1;
-	bool compress;
 #ifdef BUILD_GUI
 	#ifndef _WIN32
 	bool gui         = !((config_named_t *)list_get(args, ++x))->response.value.boolean; // gui by default unless --no-gui is specified
 	#endif
 	char *key_source =  ((config_named_t *)list_get(args, ++x))->response.value.string;
-	compress         =  ((config_named_t *)list_get(args, ++x))->response.value.boolean; // compress by default unless --no-compress is specified
 #endif
+	char *xz         =  ((config_named_t *)list_get(args, ++x))->response.value.string;
 	bool cli         = !((config_named_t *)list_get(args, ++x))->response.value.boolean; // cli by default unless --no-cli is specified
 
 	char *cipher     =  ((config_named_t *)list_get(args, ++x))->response.value.string;
@@ -198,16 +221,44 @@ int main(int argc, char **argv)
 	char *key        =  ((config_named_t *)list_get(args, ++x))->response.value.string;
 	char *password   =  ((config_named_t *)list_get(args, ++x))->response.value.string;
 
-	compress         = !((config_named_t *)list_get(args, ++x))->response.value.boolean; // compress by default unless --no-compress is specified
+	bool compress    = !((config_named_t *)list_get(args, ++x))->response.value.boolean; // compress by default unless --no-compress is specified
 	bool follow      =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
 
 	char *version    =  ((config_named_t *)list_get(args, ++x))->response.value.string;
 	bool raw         =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
+	uint64_t threads =  ((config_named_t *)list_get(args, ++x))->response.value.integer;
+	char *algorithm  =  ((config_named_t *)list_get(args, ++x))->response.value.string;
+	bool direct      =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
+	char *range      =  ((config_named_t *)list_get(args, ++x))->response.value.string;
+	char *extract    =  ((config_named_t *)list_get(args, ++x))->response.value.string;
+	bool list        =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
+	bool batch       =  ((config_named_t *)list_get(args, ++x))->seen;
+	uint64_t jobs    =  ((config_named_t *)list_get(args, x))->response.value.integer;
+	char *batch_list =  ((config_named_t *)list_get(args, ++x))->response.value.string;
+	bool bench       =  ((config_named_t *)list_get(args, ++x))->seen;
+	char *bench_json =  ((config_named_t *)list_get(args, x))->response.value.string;
+	bool stats       =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
 	bool test        =  ((config_named_t *)list_get(args, ++x))->response.value.boolean;
 
 	if (test)
 		self_test();
 
+	uint64_t xz_threads = 1;
+	uint64_t xz_block = 0;
+	if (!parse_compress(xz, &xz_threads, &xz_block))
+		compress = false;
+	io_codec_e codec = CODEC_XZ;
+	int level = CODEC_LEVEL_DEFAULT;
+	if (algorithm)
+		parse_codec(algorithm, &codec, &level);
+	uint64_t range_offset = 0;
+	uint64_t range_length = 0;
+	if (range && !parse_range(range, &range_offset, &range_length))
+	{
+		cli_fprintf(stderr, ANSI_COLOUR_RED "%s: %s" ANSI_COLOUR_RESET "\n", range, _("Invalid range; expected an offset, optionally followed by a colon and a length, each with an optional K, M or G suffix (eg 2G:512M)"));
+		goto clean_up;
+	}
+
 	/*
 	 * list available algorithms if asked to (possibly both hash and
 	 * crypto)
@@ -221,10 +272,18 @@ int main(int argc, char **argv)
 		la = list_modes();
 	if (mac && !strcasecmp(mac, "list"))
 		la = list_macs();
+	if (algorithm && !strcasecmp(algorithm, "list"))
+		la = list_codecs();
 	if (la)
 		goto clean_up;
 
-	if (source)
+	if (bench)
+	{
+		benchmark(bench_json && !strcasecmp(bench_json, "json"), kdf);
+		goto clean_up;
+	}
+
+	if (source && !batch && !batch_list)
 	{
 		char *ptr = malloc(0);
 		char *c = ptr;
@@ -431,15 +490,77 @@ int main(int argc, char **argv)
 
 	list_deinit(args);
 
+	if (batch || batch_list)
+	{
+		/*
+		 * every file is encrypted (or decrypted) as if on its own, a
+		 * few at a time
+		 */
+		batch_options_t o = { cipher, hash, mode, mac, key_data, key_length, kdf, raw, compress, follow, dude, parse_version(version), codec, level, threads, xz_threads, xz_block, direct };
+		batch_t *b = batch_init(jobs, &o);
+		for (size_t i = 0; i < list_size(extra); i++)
+		{
+			const char *f = ((config_unnamed_t *)list_get(extra, i))->response.value.string;
+			if (f)
+				batch_add(b, f);
+		}
+		if (batch_list && !batch_add_from(b, batch_list))
+			cli_fprintf(stderr, ANSI_COLOUR_RED "%s: %s" ANSI_COLOUR_RESET "\n", batch_list, strerror(errno));
+		batch_execute(b);
+#ifndef __DEBUG__
+		if (isatty(STDERR_FILENO) && cli)
+		{
+			cli_t p = { (cli_status_e *)&b->status, &b->current, &b->total };
+			cli_display(&p);
+		}
+		else
+#endif
+			while (b->status == STATUS_INIT || b->status == STATUS_RUNNING)
+			{
+				struct timespec s = { 0, 10 * MILLION }; /* 10 milliseconds */
+				nanosleep(&s, NULL);
+			}
+		batch_report(b);
+		if (stats)
+			report_stats(&b->stats);
+		batch_deinit(&b);
+		goto clean_up;
+	}
+
 	/*
 	 * here we go ...
 	 */
 	crypto_t *c;
+	crypto_status_e s;
 
-	if (dude || (source && is_encrypted(source)))
+	if (dude || list || (source && is_encrypted(source)))
 		c = decrypt_init(source, output, cipher, hash, mode, mac, key_data, key_length, kdf, raw);
+	else if (compress && (s = encrypt_codec_check(codec, raw ? VERSION_CURRENT : parse_version(version))) != STATUS_INIT)
+	{
+		/*
+		 * fail before the output is created, rather than leave an
+		 * empty file behind
+		 */
+		cli_fprintf(stderr, ANSI_COLOUR_RED "%s" ANSI_COLOUR_RESET "\n", _(status_message(s)));
+		goto clean_up;
+	}
 	else
+	{
 		c = encrypt_init(source, output, cipher, hash, mode, mac, key_data, key_length, kdf, raw, compress, follow, parse_version(version));
+		c->codec = codec;
+		c->compress_level = level;
+	}
+
+	c->threads = threads;
+	c->compress_threads = xz_threads;
+	c->compress_block = xz_block;
+	c->direct_io = direct;
+	c->range = range != NULL;
+	c->range_offset = range_offset;
+	c->range_length = range_length;
+	if (extract && !(c->extract = gcry_strdup(extract)))
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(extract));
+	c->list = list;
 
 	if (c->status == STATUS_INIT)
 	{
@@ -453,7 +574,7 @@ int main(int argc, char **argv)
 		fstat(STDOUT_FILENO, &t);
 
 		bool ui = isatty(STDERR_FILENO) && (!io_is_stdout(c->output) || c->path || S_ISREG(t.st_mode));
-		if (ui && cli)
+		if (ui && cli && !list)
 		{
 			cli_t p = { (cli_status_e *)&c->status, &c->current, &c->total };
 			cli_display(&p);
@@ -471,6 +592,8 @@ int main(int argc, char **argv)
 
 	if (c->status != STATUS_SUCCESS)
 		cli_fprintf(stderr, ANSI_COLOUR_RED "%s" ANSI_COLOUR_RESET "\n", _(status(c)));
+	else if (stats)
+		report_stats(&c->stats);
 
 	deinit(&c);
 #endif /* ! _WIN32 */
@@ -480,6 +603,18 @@ clean_up:
 	if (key_source)
 		free(key_source);
 #endif
+	if (xz)
+		free(xz);
+	if (algorithm)
+		free(algorithm);
+	if (range)
+		free(range);
+	if (extract)
+		free(extract);
+	if (batch_list)
+		free(batch_list);
+	if (bench_json)
+		free(bench_json);
 	if (cipher)
 		free(cipher);
 	if (hash)
@@ -495,10 +630,12 @@ clean_up:
 	if (version)
 		free(version);
 
-	if (((config_unnamed_t *)list_get(extra, 0))->response.value.string)
-		free(((config_unnamed_t *)list_get(extra, 0))->response.value.string);
-	if (((config_unnamed_t *)list_get(extra, 1))->response.value.string)
-		free(((config_unnamed_t *)list_get(extra, 1))->response.value.string);
+	/*
+	 * with --batch there can be more than just the source and output
+	 */
+	for (size_t i = 0; i < list_size(extra); i++)
+		if (((config_unnamed_t *)list_get(extra, i))->response.value.string)
+			free(((config_unnamed_t *)list_get(extra, i))->response.value.string);
 
 	list_deinit(extra);
 
@@ -548,6 +685,125 @@ static bool list_macs(void)
 	return true;
 }
 
+static bool list_codecs(void)
+{
+	for (io_codec_e z = CODEC_XZ; z < CODEC_UNKNOWN; z++)
+		if (io_codec_available(z))
+			cli_eprintf("%s\n", io_codec_name(z));
+	return true;
+}
+
+static void parse_codec(const char *s, io_codec_e *c, int *l)
+{
+	/*
+	 * an unknown codec is left for encryption to reject, alongside any
+	 * which are known but weren’t available when we were built
+	 */
+	char *n = strdup(s);
+	if (!n)
+		die(_("Out of memory @ %s:%d:%s [%zu]"), __FILE__, __LINE__, __func__, strlen(s));
+	char *v = strchr(n, ':');
+	if (v)
+	{
+		*v++ = '\0';
+		*l = strtol(v, NULL, 0);
+	}
+	*c = io_codec_from_name(n);
+	free(n);
+	return;
+}
+
+static bool parse_compress(const char *s, uint64_t *t, uint64_t *b)
+{
+	/*
+	 * the config file has always had compress set to either true or
+	 * false; otherwise it’s the number of threads, and the block size
+	 */
+	if (!s || !strcasecmp(s, CONF_TRUE))
+		return true;
+	if (!strcasecmp(s, CONF_FALSE))
+		return false;
+	char *e = NULL;
+	errno = 0;
+	uint64_t n = strtoull(s, &e, 0);
+	if (errno || e == s)
+		return true;
+	*t = n;
+	if (*e != ':')
+		return true;
+	s = e + 1;
+	n = parse_size(s, &e);
+	if (errno || e == s)
+		return true;
+	*b = n;
+	return true;
+}
+
+static bool parse_range(const char *s, uint64_t *o, uint64_t *l)
+{
+	/*
+	 * the offset, optionally followed by the length (otherwise it’s
+	 * everything to the end)
+	 */
+	char *e = NULL;
+	errno = 0;
+	*o = parse_size(s, &e);
+	if (errno || e == s)
+		return false;
+	*l = 0;
+	if (*e == '\0')
+		return true;
+	if (*e != ':')
+		return false;
+	s = e + 1;
+	*l = parse_size(s, &e);
+	return !errno && e != s && *e == '\0';
+}
+
+static uint64_t parse_size(const char *s, char **e)
+{
+	uint64_t n = strtoull(s, e, 0);
+	if (*e == s)
+		return n;
+	switch (toupper(**e))
+	{
+		case 'G':
+			n *= GIGABYTE;
+			break;
+		case 'M':
+			n *= MEGABYTE;
+			break;
+		case 'K':
+			n *= KILOBYTE;
+			break;
+		default:
+			return n;
+	}
+	(*e)++;
+	return n;
+}
+
+static void report_stats(const io_stats_t *s)
+{
+	/*
+	 * stages which didn’t happen (no compression, say) aren’t shown
+	 */
+	cli_eprintf(_("\n%-12s %18s %10s %10s %12s %10s\n"), _("Stage"), _("Bytes"), _("Calls"), _("Syscalls"), _("Time (ms)"), _("MB/s"));
+	for (io_stat_e i = IO_STAT_READ; i < IO_STATS; i++)
+	{
+		const io_stat_t *x = &s->stage[i];
+		if (!x->calls)
+			continue;
+		double t = (double)x->time / THOUSAND_MILLION;
+		cli_eprintf("%-12s %'18" PRIu64 " %'10" PRIu64 " %'10" PRIu64 " %'12.1f ", io_stat_name(i), x->bytes, x->calls, x->syscalls, t * THOUSAND);
+		if (t > 0 && x->bytes)
+			cli_eprintf("%'10.1f\n", x->bytes / t / MEGABYTE);
+		else
+			cli_eprintf("%10s\n", "-");
+	}
+	return;
+}
+
 static void self_test(void)
 {
 	/*